@@ -36,6 +36,8 @@ either blocking or dropping is unacceptable</li>
     <dd>
     - \ref zm_modes "Text and binary modes"
     - \ref zm_queueing "Queueing messages for delayed sending"
+    - \ref zm_packed "Packed mode: many small parts in one frame"
+    - \ref zm_codec "Compression of large parts"
     </dd>
   </li>
   <li><a class="el" href="examples.html">Examples</a></li>
@@ -204,6 +206,17 @@ and in real apps performance costs probably will be unnoticeable.
 
 We make 10 contiguous test runs and we get <b>20%</b> of average overhead.
 
+<h3>Heap allocations</h3>
+Define \ref ZMQMESSAGE_ALLOC_STATS and include zmqmessage/AllocHooks.hpp
+in one .cpp file to count heap allocations per thread,
+attributed to library call sites (see ZmqMessage::AllocStats).
+\ref tests/AllocTest.cpp "Allocation test" checks that steady-state
+receive-handle-reply loop with StackPartsStorage or ExternalPartsStorage
+makes no heap allocations within library,
+and DynamicPartsStorage makes exactly one per incoming message.
+Note, that text mode conversions of non-string types
+go through @c stringstream and may allocate.
+
  */
 
 /** \page zm_modes
@@ -295,6 +308,109 @@ See example zserialize.cpp for details.
 </ul>
  */
 
+/** \page zm_packed
+<h2>Packed mode</h2>
+<hr>
+Every message part is a separate zmq frame: it's framed on the wire,
+written to pipe and passed through Sink state machine separately.
+For messages with many tiny parts (ids, flags, small numbers)
+this per-part overhead dominates.
+
+In packed mode Sink writes all parts (except routing ones)
+as length-prefixed fields into one buffer
+and sends it as single zmq frame on flush:
+\code
+ZmqMessage::Outgoing<ZmqMessage::XRouting> outgoing(
+  sock, ZmqMessage::OutOptions::PACKED);
+outgoing << id << flags << 12 << payload << ZmqMessage::Flush;
+\endcode
+
+Receiver must be Incoming with packed mode set.
+It exposes logical parts through the same @c size(), @c operator>>,
+@c operator[] and iterators, as if they were received separately:
+\code
+ZmqMessage::Incoming<ZmqMessage::XRouting> incoming(sock);
+incoming.set_packed(true);
+incoming.receive(4, part_names, true);
+incoming >> id >> flags >> num >> payload;
+\endcode
+Logical parts share received frame without copying
+(frame is released when the last of them is closed),
+except very small ones, which are cheaper to copy
+inside zmq message itself.
+
+Packed frame starts with a marker (and format version),
+so Incoming in packed mode receives usual (not packed) messages as well:
+peers may be switched to packed sending one by one,
+after all receivers set packed mode.
+Receivers not in packed mode get packed frame as one opaque part.
+
+Note, that SendObserver is notified on packed frame only,
+and nothing is sent until flush.
+ */
+
+/** \page zm_codec
+<h2>Compression of large parts</h2>
+<hr>
+Large textual parts (JSON, logs, serialized records) are often
+several times smaller when compressed, and fast compression costs less
+than sending extra bytes over the network.
+
+ZmqMessage::PartCodec compresses parts transparently.
+Set the same codec type on both sides:
+\code
+ZmqMessage::LzCodec codec; //parts of 1024 bytes and more
+ZmqMessage::Outgoing<ZmqMessage::XRouting> outgoing(sock, 0);
+outgoing.set_codec(&codec);
+outgoing << id << json << ZmqMessage::Flush;
+...
+ZmqMessage::Incoming<ZmqMessage::XRouting> incoming(sock);
+incoming.set_codec(&codec);
+incoming.receive(2, part_names, true);
+incoming >> id >> json; //decompressed here
+\endcode
+
+Sink compresses every part but routing ones, if it's not smaller
+than codec's threshold, and sends the part as is, if compression
+does not make it smaller. In packed mode the whole packed frame
+is compressed.
+
+Incoming decompresses lazily: a part is decoded in place
+on first access by @c operator[], @c operator>> or iterator.
+Parts skipped or forwarded to another Outgoing are never decompressed
+(Sink sends them still encoded, so receiver decodes them).
+
+ZmqMessage::LzCodec is a fast LZ77-family compressor
+shipped within the library (no external dependencies).
+Other algorithms may be plugged in by deriving from PartCodec.
+Codec counts encoded and decoded parts, bytes and time spent,
+see PartCodec::Stats. Codec is not thread-safe,
+so use one codec object per thread.
+
+Encoded part starts with a marker (which is never met in UTF-8 text),
+so receiver with codec set accepts not encoded parts as well,
+but receiver without codec gets encoded parts as they are.
+Benchmark CodecPerfTest.cpp compares throughput with and without
+compression.
+
+Between processes on the same host large parts need not be copied
+through the socket at all. ZmqMessage::ShmCodec writes parts
+of 64K and more to a ring in POSIX shared memory segment
+and sends a small descriptor instead:
+\code
+ZmqMessage::ShmCodec shm("/frames", 256 * 1024 * 1024); //creates segment
+outgoing.set_codec(&shm);
+...
+ZmqMessage::ShmCodec shm("/frames"); //maps it on the first descriptor
+incoming.set_codec(&shm);
+\endcode
+Receiver gets parts pointing into the segment (no copy),
+the block is given back to sender when the part is released.
+Set it only on sockets connected via ipc:// or inproc://
+(see ShmCodec::is_local()): remote peers cannot map the segment.
+If the ring is full, parts are sent as is.
+ */
+
 /** \page zm_tutorial
 
 <h2>Tutorial</h2>
@@ -16,6 +16,17 @@
 #include <zmqmessage/exceptions.hpp>
 #include <zmqmessage/send.hpp>
 #include <zmqmessage/Multipart.hpp>
+#include <zmqmessage/Packed.hpp>
+#include <zmqmessage/PartCodec.hpp>
+#include <zmqmessage/Relay.hpp>
+#include <zmqmessage/Destination.hpp>
+#include <zmqmessage/FanOut.hpp>
+#include <zmqmessage/ShardedSink.hpp>
+#include <zmqmessage/TimerWheel.hpp>
+#include <zmqmessage/Reactor.hpp>
+#include <zmqmessage/SpinWait.hpp>
+#include <zmqmessage/AsyncLoop.hpp>
+#include <zmqmessage/SocketWatcher.hpp>
 #include <zmqmessage/PartsStorage.hpp>
 #include <zmqmessage/MultipartContainer.hpp>
 #include <zmqmessage/Incoming.hpp>
@@ -23,6 +34,19 @@
 #include <zmqmessage/OutOptions.hpp>
 #include <zmqmessage/Sink.hpp>
 #include <zmqmessage/Outgoing.hpp>
+#include <zmqmessage/BufferPool.hpp>
+#include <zmqmessage/MessageBuilder.hpp>
+#include <zmqmessage/RpcClient.hpp>
+#include <zmqmessage/RouteHandle.hpp>
+#include <zmqmessage/Broker.hpp>
+#include <zmqmessage/ScatterGather.hpp>
+#include <zmqmessage/TopicDispatcher.hpp>
+#include <zmqmessage/Conflater.hpp>
+#include <zmqmessage/LocalChannel.hpp>
+#include <zmqmessage/Transport.hpp>
+#include <zmqmessage/Handoff.hpp>
+#include <zmqmessage/MappedFile.hpp>
+#include <zmqmessage/ShmCodec.hpp>
 
 #ifndef ZMQMESSAGE_HPP_
 #define ZMQMESSAGE_HPP_
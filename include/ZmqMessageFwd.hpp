@@ -14,6 +14,10 @@ namespace ZmqMessage
 {
   class Part;
 
+  class PartAllocator;
+
+  class PartCodec;
+
   //parts storage policies
 
   template <size_t N>
@@ -32,6 +36,8 @@ namespace ZmqMessage
 
   class ReceiveObserver;
 
+  class SpinWait;
+
   template <class RoutingPolicy, class PartsStorage>
   class Incoming;
 
@@ -44,6 +50,13 @@ namespace ZmqMessage
   template <class RoutingPolicy>
   class Outgoing;
 
+  class RouteHandle;
+
+  class Transport;
+
+  template <typename T>
+  struct Handoff;
+
 }
 
 #endif /* ZMQMESSAGE_ZMQMESSAGEFWD_HPP_ */
@@ -18,6 +18,30 @@
 
 #include "zmqmessage/ZmqMessageFullImpl.hpp"
 #include "zmqmessage/ZmqToolsFullImpl.hpp"
+#include "zmqmessage/BufferPoolFullImpl.hpp"
+#include "zmqmessage/MessageBuilderFullImpl.hpp"
+#include "zmqmessage/PackedFullImpl.hpp"
+#include "zmqmessage/PartCodecFullImpl.hpp"
+#include "zmqmessage/RelayFullImpl.hpp"
+#include "zmqmessage/DestinationFullImpl.hpp"
+#include "zmqmessage/FanOutFullImpl.hpp"
+#include "zmqmessage/ShardedSinkFullImpl.hpp"
+#include "zmqmessage/TimerWheelFullImpl.hpp"
+#include "zmqmessage/ReactorFullImpl.hpp"
+#include "zmqmessage/SpinWaitFullImpl.hpp"
+#include "zmqmessage/AsyncLoopFullImpl.hpp"
+#include "zmqmessage/SocketWatcherFullImpl.hpp"
+#include "zmqmessage/RpcClientFullImpl.hpp"
+#include "zmqmessage/RouteHandleFullImpl.hpp"
+#include "zmqmessage/BrokerFullImpl.hpp"
+#include "zmqmessage/ScatterGatherFullImpl.hpp"
+#include "zmqmessage/TopicDispatcherFullImpl.hpp"
+#include "zmqmessage/ConflaterFullImpl.hpp"
+#include "zmqmessage/LocalChannelFullImpl.hpp"
+#include "zmqmessage/TransportFullImpl.hpp"
+#include "zmqmessage/HandoffFullImpl.hpp"
+#include "zmqmessage/MappedFileFullImpl.hpp"
+#include "zmqmessage/ShmCodecFullImpl.hpp"
 
 namespace ZmqMessage
 {
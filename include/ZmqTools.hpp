@@ -8,15 +8,18 @@
 #ifndef ZMQMESSAGE_ZMQ_TOOLS_INCLUDED_
 #define ZMQMESSAGE_ZMQ_TOOLS_INCLUDED_
 
+#include <stdint.h>
 #include <cstdlib>
 #include <ctime>
 
 #include <string>
 #include <sstream>
 
+#include "ZmqMessageFwd.hpp"
 #include "zmqmessage/Config.hpp"
 #include "zmqmessage/MetaTypes.hpp"
 #include "zmqmessage/RawMessage.hpp"
+#include "zmqmessage/AllocStats.hpp"
 
 namespace ZmqMessage
 {
@@ -81,6 +84,7 @@ namespace ZmqMessage
     typename Private::DisableIf<Private::IsStr<T>::value>::type* = 0,
     typename Private::DisableIf<Private::IsRaw<T>::value>::type* = 0)
   {
+    ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_EXTRACT);
     std::stringstream ss;
     ss.write(static_cast<char*>(message.data()), message.size());
     T t = T();
@@ -138,6 +142,7 @@ namespace ZmqMessage
     typename Private::DisableIf<Private::IsStr<T>::value>::type* = 0,
     typename Private::DisableIf<Private::IsRaw<T>::value>::type* = 0)
   {
+    ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_EXTRACT);
     t = T();
     std::stringstream ss;
     ss.write(static_cast<char*>(message.data()), message.size());
@@ -256,6 +261,22 @@ namespace ZmqMessage
   time_t
   get_time(zmq::message_t& message);
 
+  /**
+   * @return microseconds of monotonic clock (CLOCK_MONOTONIC),
+   * for measuring intervals and deadlines
+   */
+  ZMQMESSAGE_DLL_PUBLIC
+  uint64_t
+  monotonic_usec();
+
+  /**
+   * @return nanoseconds of monotonic clock, for intervals
+   * too short for monotonic_usec()
+   */
+  ZMQMESSAGE_DLL_PUBLIC
+  uint64_t
+  monotonic_nsec();
+
   /**
    * Compare message contents to specified memory region.
    * @return like @c memcmp
@@ -344,6 +365,7 @@ namespace ZmqMessage
            typename Private::DisableIf<Private::IsStr<T>::value>::type* = 0,
            typename Private::DisableIf<Private::IsRaw<T>::value>::type* = 0)
   {
+    ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_INIT_MSG);
     std::ostringstream os;
     os << t;
     const std::string& s = os.str();
@@ -405,6 +427,91 @@ namespace ZmqMessage
   }
 
 
+  /**
+   * Initialize zmq message with copy of given data (binary),
+   * taking buffer from allocator.
+   */
+  ZMQMESSAGE_DLL_PUBLIC
+  void
+  init_msg(const void* t, size_t sz, zmq::message_t& msg,
+    PartAllocator& alloc);
+
+  /**
+   * @overload
+   * For string objects.
+   */
+  template <class T>
+  ZMQMESSAGE_DLL_PUBLIC
+  inline
+  void
+  init_msg(const T& t, zmq::message_t& msg, PartAllocator& alloc,
+    typename Private::EnableIf<Private::IsStr<T>::value>::type* = 0)
+  {
+    init_msg(t.data(), t.length(), msg, alloc);
+  }
+
+  /**
+   * @overload
+   * For arbitrary (non-string) types that can be written to output stream.
+   */
+  template <class T>
+  ZMQMESSAGE_DLL_PUBLIC
+  inline
+  void
+  init_msg(const T& t, zmq::message_t& msg, PartAllocator& alloc,
+           typename Private::DisableIf<Private::IsStr<T>::value>::type* = 0,
+           typename Private::DisableIf<Private::IsRaw<T>::value>::type* = 0)
+  {
+    ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_INIT_MSG);
+    std::ostringstream os;
+    os << t;
+    const std::string& s = os.str();
+    init_msg(s, msg, alloc);
+  }
+
+  /**
+   * @overload
+   * For types explicitly marked as raw (containing raw_mark typedef)
+   */
+  template <class T>
+  ZMQMESSAGE_DLL_PUBLIC
+  inline
+  void
+  init_msg(const T& t, zmq::message_t& msg, PartAllocator& alloc,
+           typename Private::DisableIf<Private::IsStr<T>::value>::type* = 0,
+           typename Private::EnableIf<Private::IsRaw<T>::value>::type* = 0)
+  {
+    init_msg(&t, sizeof(T), msg, alloc);
+  }
+
+  /**
+   * @overload
+   * For zero-terminated strings.
+   */
+  ZMQMESSAGE_DLL_PUBLIC
+  inline
+  void
+  init_msg(const char* t, zmq::message_t& msg, PartAllocator& alloc)
+  {
+    init_msg(t, strlen(t), msg, alloc);
+  }
+
+  /**
+   * @overload
+   * Variable treated either as binary data or
+   * something that can be written to stream.
+   */
+  template <class T>
+  ZMQMESSAGE_DLL_PUBLIC
+  inline
+  void
+  init_msg(const T& t, zmq::message_t& msg, bool binary_mode,
+    PartAllocator& alloc)
+  {
+    binary_mode ?
+      init_msg(&t, sizeof(T), msg, alloc) : init_msg(t, msg, alloc);
+  }
+
   /**
    * throw exception: either unwrapped zmq::error_t or wrapped exception,
    * depending on configuration
@@ -514,6 +621,51 @@ namespace ZmqMessage
   bool
   has_more(zmq::socket_t& sock);
 
+  /**
+   * Wait until socket has message to receive.
+   * @param timeout microseconds as in zmq_poll, -1 means infinite
+   * @return false if timeout expired
+   */
+  ZMQMESSAGE_DLL_PUBLIC
+  bool
+  wait_readable(zmq::socket_t& sock, long timeout) throw(ZmqErrorType);
+
+  /**
+   * Absolute point in time (monotonic clock) to pass timeouts
+   * of several operations with common deadline:
+   * @code
+   * ZmqMessage::Deadline deadline(100000); //100 ms from now
+   * while (incoming.try_receive_all(deadline.remaining()))
+   * ...
+   * @endcode
+   */
+  class ZMQMESSAGE_DLL_PUBLIC Deadline
+  {
+  public:
+    /**
+     * @param timeout microseconds from now, -1 means never
+     */
+    explicit
+    Deadline(long timeout);
+
+    /**
+     * @return microseconds left (0 if expired, -1 if never)
+     * as zmq_poll timeout
+     */
+    long
+    remaining() const;
+
+    inline
+    bool
+    expired() const
+    {
+      return remaining() == 0;
+    }
+
+  private:
+    uint64_t at_; //!< usec of monotonic clock, 0 if never
+  };
+
   /**
    * Relays all pending messages (until no more)
    * from src to dst
@@ -0,0 +1,111 @@
+/**
+ * @file AllocHooks.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Replacement global operators new and delete maintaining AllocStats.
+ * This file should be included in ONE .cpp file in your application
+ * (tests, profiling builds), when \ref ZMQMESSAGE_ALLOC_STATS is defined.
+ */
+
+#ifndef ZMQMESSAGE_ALLOCHOOKS_HPP_
+#define ZMQMESSAGE_ALLOCHOOKS_HPP_
+
+#include <cstdlib>
+#include <new>
+
+#include <zmqmessage/AllocStats.hpp>
+
+#ifdef ZMQMESSAGE_CPP11
+# define ZMQMESSAGE_NEW_THROW
+# define ZMQMESSAGE_DELETE_NOTHROW noexcept
+#else
+# define ZMQMESSAGE_NEW_THROW throw(std::bad_alloc)
+# define ZMQMESSAGE_DELETE_NOTHROW throw()
+#endif
+
+namespace ZmqMessage
+{
+  namespace Private
+  {
+    inline
+    void*
+    counted_alloc(std::size_t sz)
+    {
+      AllocStats& stats = AllocStats::current();
+      ++stats.allocs[stats.site];
+      stats.bytes[stats.site] += sz;
+      return ::malloc(sz ? sz : 1);
+    }
+
+    inline
+    void
+    counted_free(void* p)
+    {
+      if (p)
+      {
+        ++AllocStats::current().frees;
+        ::free(p);
+      }
+    }
+  }
+}
+
+void*
+operator new(std::size_t sz) ZMQMESSAGE_NEW_THROW
+{
+  void* p = ZmqMessage::Private::counted_alloc(sz);
+  if (!p)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void*
+operator new[](std::size_t sz) ZMQMESSAGE_NEW_THROW
+{
+  return operator new(sz);
+}
+
+void*
+operator new(std::size_t sz, const std::nothrow_t&) ZMQMESSAGE_DELETE_NOTHROW
+{
+  return ZmqMessage::Private::counted_alloc(sz);
+}
+
+void*
+operator new[](std::size_t sz, const std::nothrow_t&) ZMQMESSAGE_DELETE_NOTHROW
+{
+  return ZmqMessage::Private::counted_alloc(sz);
+}
+
+void
+operator delete(void* p) ZMQMESSAGE_DELETE_NOTHROW
+{
+  ZmqMessage::Private::counted_free(p);
+}
+
+void
+operator delete[](void* p) ZMQMESSAGE_DELETE_NOTHROW
+{
+  ZmqMessage::Private::counted_free(p);
+}
+
+void
+operator delete(void* p, const std::nothrow_t&) ZMQMESSAGE_DELETE_NOTHROW
+{
+  ZmqMessage::Private::counted_free(p);
+}
+
+void
+operator delete[](void* p, const std::nothrow_t&) ZMQMESSAGE_DELETE_NOTHROW
+{
+  ZmqMessage::Private::counted_free(p);
+}
+
+#undef ZMQMESSAGE_NEW_THROW
+#undef ZMQMESSAGE_DELETE_NOTHROW
+
+#endif /* ZMQMESSAGE_ALLOCHOOKS_HPP_ */
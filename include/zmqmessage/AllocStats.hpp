@@ -0,0 +1,167 @@
+/**
+ * @file AllocStats.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Per-thread heap allocation accounting, attributed to library call sites.
+ * See \ref ZMQMESSAGE_ALLOC_STATS.
+ */
+
+#ifndef ZMQMESSAGE_ALLOCSTATS_HPP_
+#define ZMQMESSAGE_ALLOCSTATS_HPP_
+
+#include <cstddef>
+
+#include <zmqmessage/Config.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * Library call sites heap allocations are attributed to.
+   * When sites are nested (ex. iterator converting part via @c get),
+   * allocation is attributed to the outermost one.
+   */
+  enum AllocSite
+  {
+    ALLOC_SITE_OTHER = 0, //!< not within library call site (application, libzmq)
+    ALLOC_SITE_PARTS_STORAGE, //!< DynamicPartsStorage buffers, detaching
+    ALLOC_SITE_SINK_QUEUE, //!< Sink outgoing queue on would-block sends
+    ALLOC_SITE_INIT_MSG, //!< init_msg converting non-string types via stream
+    ALLOC_SITE_EXTRACT, //!< get and Incoming::operator>> conversions
+    ALLOC_SITE_ITERATOR, //!< Multipart::iterator conversions
+    ALLOC_SITE_LOGGING, //!< composing log records
+    ALLOC_SITES_NUM
+  };
+
+  /**
+   * @brief Heap allocation counters of calling thread.
+   *
+   * Counters are maintained only when \ref ZMQMESSAGE_ALLOC_STATS is defined
+   * and global operator new/delete hooks are linked in
+   * (see zmqmessage/AllocHooks.hpp).
+   * Counters are per thread, so allocations made by other threads
+   * (including libzmq I/O threads) do not interfere.
+   */
+  struct ZMQMESSAGE_DLL_PUBLIC AllocStats
+  {
+    size_t allocs[ALLOC_SITES_NUM]; //!< number of allocations per site
+    size_t bytes[ALLOC_SITES_NUM]; //!< bytes allocated per site
+    size_t frees; //!< number of deallocations (any site)
+    AllocSite site; //!< site we are currently in
+
+    /**
+     * @return counters of calling thread
+     */
+    static
+    inline
+    AllocStats&
+    current()
+    {
+      static __thread AllocStats stats;
+      return stats;
+    }
+
+    /**
+     * Zero all counters (current site is kept)
+     */
+    inline
+    void
+    reset()
+    {
+      for (size_t i = 0; i < ALLOC_SITES_NUM; ++i)
+      {
+        allocs[i] = 0;
+        bytes[i] = 0;
+      }
+      frees = 0;
+    }
+
+    /**
+     * @return all allocations counted, including ALLOC_SITE_OTHER
+     */
+    inline
+    size_t
+    total_allocs() const
+    {
+      size_t n = 0;
+      for (size_t i = 0; i < ALLOC_SITES_NUM; ++i)
+      {
+        n += allocs[i];
+      }
+      return n;
+    }
+
+    /**
+     * @return allocations attributed to library call sites
+     */
+    inline
+    size_t
+    library_allocs() const
+    {
+      return total_allocs() - allocs[ALLOC_SITE_OTHER];
+    }
+
+    static
+    inline
+    const char*
+    site_name(AllocSite site)
+    {
+      switch (site)
+      {
+      case ALLOC_SITE_OTHER: return "other";
+      case ALLOC_SITE_PARTS_STORAGE: return "parts storage";
+      case ALLOC_SITE_SINK_QUEUE: return "sink queue";
+      case ALLOC_SITE_INIT_MSG: return "init_msg";
+      case ALLOC_SITE_EXTRACT: return "extract";
+      case ALLOC_SITE_ITERATOR: return "iterator";
+      case ALLOC_SITE_LOGGING: return "logging";
+      default: return "unknown";
+      }
+    }
+  };
+
+  namespace Private
+  {
+    /**
+     * Attributes allocations within scope to given site
+     * (unless we are already within some site).
+     */
+    class ZMQMESSAGE_DLL_LOCAL AllocScope
+    {
+    private:
+      const bool entered_;
+
+      AllocScope(const AllocScope&);
+      AllocScope& operator=(const AllocScope&);
+
+    public:
+      explicit
+      AllocScope(AllocSite site) :
+        entered_(AllocStats::current().site == ALLOC_SITE_OTHER)
+      {
+        if (entered_)
+        {
+          AllocStats::current().site = site;
+        }
+      }
+
+      ~AllocScope()
+      {
+        if (entered_)
+        {
+          AllocStats::current().site = ALLOC_SITE_OTHER;
+        }
+      }
+    };
+  }
+}
+
+#ifdef ZMQMESSAGE_ALLOC_STATS
+# define ZMQMESSAGE_ALLOC_SCOPE(site) \
+  ::ZmqMessage::Private::AllocScope zmqmessage_alloc_scope_(site)
+#else
+# define ZMQMESSAGE_ALLOC_SCOPE(site)
+#endif
+
+#endif /* ZMQMESSAGE_ALLOCSTATS_HPP_ */
@@ -0,0 +1,197 @@
+/**
+ * @file AsyncLoop.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_ASYNCLOOP_HPP_
+#define ZMQMESSAGE_ASYNCLOOP_HPP_
+
+#include <deque>
+#include <map>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/Reactor.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Event loop of asynchronous receive and flush operations.
+   *
+   * Operation is started with async_receive() or async_flush()
+   * and its handler (continuation) is called from poll() or run()
+   * when it can be completed without blocking.
+   * Many logical sessions may wait on the same socket:
+   * receive handlers are called in FIFO order, one message each,
+   * queued messages are sent in order of async_flush() calls.
+   *
+   * Sockets are watched with epoll(7) on their ZMQ_FD.
+   * This descriptor only signals that socket state may have changed,
+   * so ZMQ_EVENTS of every socket with pending operations
+   * is checked after each wakeup, until no operation can progress.
+   *
+   * @code
+   * class Session : public ZmqMessage::Reactor::IncomingHandler<
+   *   ZmqMessage::SimpleRouting>
+   * {
+   *   void
+   *   handle(ZmqMessage::Incoming<ZmqMessage::SimpleRouting>& incoming)
+   *   {
+   *     incoming.receive_all();
+   *     ...
+   *     ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(reply_sock,
+   *       ZmqMessage::OutOptions::NONBLOCK |
+   *       ZmqMessage::OutOptions::CACHE_ON_BLOCK);
+   *     out << ... << ZmqMessage::Flush;
+   *     loop.async_flush(out); //resent when socket is writable
+   *     loop.async_receive(sock, *this); //wait for next message
+   *   }
+   * };
+   * @endcode
+   * AsyncLoop is to be used by one thread (but stop()).
+   * It does not own sockets and handlers, they must outlive
+   * pending operations.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC AsyncLoop : private Private::NonCopyable
+  {
+  public:
+    /**
+     * Continuation of async_receive(): Handler::on_readable()
+     * is called once, when socket has message to receive.
+     * Reactor::IncomingHandler receives it with Incoming.
+     */
+    typedef Reactor::Handler ReceiveHandler;
+
+    /**
+     * Continuation of async_flush()
+     */
+    class ZMQMESSAGE_DLL_PUBLIC FlushHandler
+    {
+    public:
+      virtual
+      ~FlushHandler();
+
+      /**
+       * All messages queued by the sink are sent
+       */
+      virtual
+      void
+      on_flushed(zmq::socket_t& sock) = 0;
+    };
+
+    static const long DEFAULT_CHECK_INTERVAL = 100000; //100 ms
+
+    AsyncLoop() throw(ZmqErrorType);
+
+    /**
+     * Deletes messages not sent yet
+     */
+    ~AsyncLoop();
+
+    /**
+     * Call handler when message can be received from socket
+     */
+    void
+    async_receive(zmq::socket_t& sock, ReceiveHandler& handler)
+      throw(ZmqErrorType);
+
+    /**
+     * Take messages queued by flushed sink
+     * (OutOptions::CACHE_ON_BLOCK) and send them (in order)
+     * when destination socket becomes writable, then call handler.
+     * Sink over transport without socket (see Sink::has_dst())
+     * is rejected with EINVAL error.
+     * @return false if sink has nothing queued
+     *  (operation is not started and handler is not called)
+     */
+    bool
+    async_flush(Sink& sink, FlushHandler* handler = 0)
+      throw(ZmqErrorType);
+
+    /**
+     * @return number of operations not completed
+     */
+    size_t
+    pending() const;
+
+    /**
+     * Wait for events up to @c timeout (microseconds as in zmq_poll,
+     * -1 means infinite), then call handlers of operations completed.
+     * @return number of handlers called
+     */
+    size_t
+    poll(long timeout) throw(ZmqErrorType);
+
+    /**
+     * Call handlers until stop() is called.
+     * @param check_interval how often (microseconds) stop flag is checked
+     */
+    void
+    run(long check_interval = DEFAULT_CHECK_INTERVAL) throw(ZmqErrorType);
+
+    /**
+     * Make run() return (now or as soon as it's called).
+     * May be called from other thread.
+     */
+    inline
+    void
+    stop()
+    {
+      stopped_ = true;
+    }
+
+  private:
+    struct Flush
+    {
+      Multipart* queue; //!< owned
+      FlushHandler* handler;
+    };
+
+    /**
+     * Pending operations of one socket
+     */
+    struct Watch
+    {
+      zmq::socket_t* sock;
+      int fd;
+      std::deque<ReceiveHandler*> readers;
+      std::deque<Flush> flushes;
+    };
+
+    typedef std::map<zmq::socket_t*, Watch*> Watches;
+
+    Watches watches_; //!< owned
+
+    int epoll_fd_;
+
+    bool ready_; //!< operations were added, check sockets without waiting
+
+    volatile bool stopped_;
+
+    ZMQMESSAGE_DLL_LOCAL
+    Watch&
+    watch(zmq::socket_t& sock) throw(ZmqErrorType);
+
+    /**
+     * Complete operations of socket while it's possible
+     * @return number of handlers called
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    size_t
+    service(Watch& w) throw(ZmqErrorType);
+
+    /**
+     * Stop watching sockets with no pending operations
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    cleanup();
+  };
+}
+
+#endif /* ZMQMESSAGE_ASYNCLOOP_HPP_ */
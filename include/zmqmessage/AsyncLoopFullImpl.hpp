@@ -0,0 +1,242 @@
+/**
+ * @file AsyncLoopFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of AsyncLoop methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_ASYNCLOOPFULLIMPL_HPP_
+#define ZMQMESSAGE_ASYNCLOOPFULLIMPL_HPP_
+
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <memory>
+
+namespace ZmqMessage
+{
+  AsyncLoop::FlushHandler::~FlushHandler()
+  {}
+
+  AsyncLoop::AsyncLoop() throw(ZmqErrorType) :
+    epoll_fd_(::epoll_create(16)), ready_(false), stopped_(false)
+  {
+    if (epoll_fd_ < 0)
+    {
+      throw_zmq_exception(zmq::error_t());
+    }
+  }
+
+  AsyncLoop::~AsyncLoop()
+  {
+    for (Watches::iterator it = watches_.begin(); it != watches_.end(); ++it)
+    {
+      Watch* w = it->second;
+      for (size_t i = 0; i < w->flushes.size(); ++i)
+      {
+        delete w->flushes[i].queue;
+      }
+      delete w;
+    }
+    ::close(epoll_fd_);
+  }
+
+  AsyncLoop::Watch&
+  AsyncLoop::watch(zmq::socket_t& sock) throw(ZmqErrorType)
+  {
+    Watches::iterator it = watches_.find(&sock);
+    if (it != watches_.end())
+    {
+      return *it->second;
+    }
+
+    std::auto_ptr<Watch> w(new Watch);
+    w->sock = &sock;
+    w->fd = -1;
+    size_t sz = sizeof(w->fd);
+    try
+    {
+      sock.getsockopt(ZMQ_FD, &w->fd, &sz);
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = w.get();
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, w->fd, &ev) < 0)
+    {
+      throw_zmq_exception(zmq::error_t());
+    }
+    watches_.insert(std::make_pair(&sock, w.get()));
+    return *w.release();
+  }
+
+  void
+  AsyncLoop::async_receive(zmq::socket_t& sock, ReceiveHandler& handler)
+    throw(ZmqErrorType)
+  {
+    watch(sock).readers.push_back(&handler);
+    //edge might be consumed already
+    ready_ = true;
+  }
+
+  bool
+  AsyncLoop::async_flush(Sink& sink, FlushHandler* handler)
+    throw(ZmqErrorType)
+  {
+    if (!sink.has_dst())
+    {
+      errno = EINVAL;
+      throw_zmq_exception(zmq::error_t());
+    }
+    if (!sink.is_queued())
+    {
+      return false;
+    }
+    Watch& w = watch(sink.dst());
+    Flush flush = {sink.detach(), handler};
+    try
+    {
+      w.flushes.push_back(flush);
+    }
+    catch (...)
+    {
+      delete flush.queue;
+      throw;
+    }
+    ready_ = true;
+    return true;
+  }
+
+  size_t
+  AsyncLoop::pending() const
+  {
+    size_t n = 0;
+    for (Watches::const_iterator it = watches_.begin();
+         it != watches_.end(); ++it)
+    {
+      n += it->second->readers.size() + it->second->flushes.size();
+    }
+    return n;
+  }
+
+  size_t
+  AsyncLoop::service(Watch& w) throw(ZmqErrorType)
+  {
+    size_t calls = 0;
+    for (bool progress = true; progress; )
+    {
+      progress = false;
+      uint32_t events = 0;
+      size_t sz = sizeof(events);
+      try
+      {
+        w.sock->getsockopt(ZMQ_EVENTS, &events, &sz);
+      }
+      catch (const zmq::error_t& e)
+      {
+        throw_zmq_exception(e);
+      }
+
+      if ((events & ZMQ_POLLOUT) && !w.flushes.empty())
+      {
+        Flush& flush = w.flushes.front();
+        Outgoing<SimpleRouting> out(*w.sock,
+          OutOptions::NONBLOCK | OutOptions::CACHE_ON_BLOCK);
+        out.send_incoming_messages(*flush.queue, false);
+        out.flush();
+        delete flush.queue;
+        flush.queue = out.detach();
+        if (!flush.queue)
+        {
+          FlushHandler* handler = flush.handler;
+          w.flushes.pop_front();
+          if (handler)
+          {
+            ++calls;
+            handler->on_flushed(*w.sock);
+          }
+          progress = true;
+        }
+      }
+
+      if ((events & ZMQ_POLLIN) && !w.readers.empty())
+      {
+        ReceiveHandler* handler = w.readers.front();
+        w.readers.pop_front();
+        ++calls;
+        handler->on_readable(*w.sock);
+        progress = true;
+      }
+    }
+    return calls;
+  }
+
+  void
+  AsyncLoop::cleanup()
+  {
+    for (Watches::iterator it = watches_.begin(); it != watches_.end(); )
+    {
+      Watch* w = it->second;
+      if (!w->readers.empty() || !w->flushes.empty())
+      {
+        ++it;
+        continue;
+      }
+      ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, w->fd, 0);
+      delete w;
+      watches_.erase(it++);
+    }
+  }
+
+  size_t
+  AsyncLoop::poll(long timeout) throw(ZmqErrorType)
+  {
+    const int wait_ms = ready_ ? 0 :
+      (timeout < 0 ? -1 : static_cast<int>((timeout + 999) / 1000));
+    epoll_event events[64];
+    const int rc = ::epoll_wait(epoll_fd_, events, 64, wait_ms);
+    if (rc < 0 && errno != EINTR)
+    {
+      throw_zmq_exception(zmq::error_t());
+    }
+    if (rc <= 0 && !ready_)
+    {
+      return 0;
+    }
+    ready_ = false;
+
+    //handlers may operate on any socket and consume its edge,
+    //so all sockets with pending operations are checked again
+    //until no handler is called
+    size_t calls = 0;
+    for (size_t called = 1; called; calls += called)
+    {
+      called = 0;
+      for (Watches::iterator it = watches_.begin();
+           it != watches_.end(); ++it)
+      {
+        called += service(*it->second);
+      }
+    }
+    cleanup();
+    return calls;
+  }
+
+  void
+  AsyncLoop::run(long check_interval) throw(ZmqErrorType)
+  {
+    while (!stopped_)
+    {
+      poll(check_interval);
+    }
+  }
+}
+
+#endif /* ZMQMESSAGE_ASYNCLOOPFULLIMPL_HPP_ */
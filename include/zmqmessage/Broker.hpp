@@ -0,0 +1,248 @@
+/**
+ * @file Broker.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_BROKER_HPP_
+#define ZMQMESSAGE_BROKER_HPP_
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/Part.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Least-recently-used load balancing broker.
+   *
+   * Clients (REQ or RpcClient) connect to frontend XREP socket,
+   * workers (REQ) connect to backend XREP socket.
+   * Worker announces itself with READY message,
+   * then every request is sent to the worker idle for the longest time,
+   * with envelope of worker and then of client:
+   * @verbatim
+   * client -> frontend: [client route][""][request]
+   * backend -> worker:  [worker route][""][client route][""][request]
+   * worker -> backend:  [worker route][""][client route][""][reply]
+   * frontend -> client: [client route][""][reply]
+   * @endverbatim
+   * Worker just sends the envelope received back with the reply
+   * and becomes idle again.
+   * Parts (envelopes and bodies) are moved between sockets, never copied.
+   *
+   * Requests coming when no worker is idle are kept in backlog
+   * (up to @c max_backlog, then frontend is not read, so clients
+   * are pushed back by socket buffers).
+   * Idle workers and backlog are FIFO queues, all operations are O(1).
+   *
+   * Counters show queue depths, request wait time (for a worker)
+   * and worker utilization.
+   * @code
+   * ZmqMessage::Broker broker(front, back);
+   * broker.run(); //until stop() is called
+   * @endcode
+   * Broker is to be used by one thread (but stop()).
+   * Workers are not checked for liveness: worker which is gone
+   * while busy is just not used any more, one gone while idle
+   * will get (and lose) a request.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC Broker : private Private::NonCopyable
+  {
+  public:
+    /**
+     * Body of message worker announces itself with
+     */
+    static const char* const READY;
+
+    struct Stats
+    {
+      uint64_t requests; //!< requests received from clients
+      uint64_t replies; //!< replies sent to clients
+      uint64_t malformed; //!< messages without envelope, dropped
+      uint64_t wait_usec; //!< total time requests waited for worker
+      uint64_t max_wait_usec; //!< max time request waited for worker
+      uint64_t busy_usec; //!< total time of workers busy (per worker)
+      uint64_t worker_usec; //!< total time of workers known (per worker)
+
+      Stats();
+    };
+
+    static const size_t DEFAULT_MAX_BACKLOG = 1000;
+
+    static const size_t DEFAULT_BUDGET = 64;
+
+    static const long DEFAULT_CHECK_INTERVAL = 100000; //100 ms
+
+    /**
+     * @param max_backlog max requests waiting for idle worker
+     * @param budget max messages read from each socket per wakeup
+     */
+    Broker(zmq::socket_t& frontend, zmq::socket_t& backend,
+      size_t max_backlog = DEFAULT_MAX_BACKLOG,
+      size_t budget = DEFAULT_BUDGET);
+
+    /**
+     * Drops requests in backlog
+     */
+    ~Broker();
+
+    /**
+     * Wait for messages up to @c timeout
+     * (microseconds as in zmq_poll, -1 means infinite),
+     * then pass available requests and replies.
+     * @return number of messages received
+     */
+    size_t
+    poll(long timeout) throw(ZmqErrorType);
+
+    /**
+     * Pass messages until stop() is called.
+     * @param check_interval how often (microseconds) stop flag is checked
+     */
+    void
+    run(long check_interval = DEFAULT_CHECK_INTERVAL) throw(ZmqErrorType);
+
+    /**
+     * Make run() return (now or as soon as it's called).
+     * May be called from other thread.
+     */
+    inline
+    void
+    stop()
+    {
+      stopped_ = true;
+    }
+
+    /**
+     * @return number of idle workers
+     */
+    inline
+    size_t
+    idle_workers() const
+    {
+      return idle_.size();
+    }
+
+    /**
+     * @return number of workers processing requests
+     */
+    inline
+    size_t
+    busy_workers() const
+    {
+      return busy_;
+    }
+
+    /**
+     * @return number of requests waiting for idle worker
+     */
+    inline
+    size_t
+    backlog() const
+    {
+      return backlog_.size();
+    }
+
+    /**
+     * @return share of time workers were busy (0..1)
+     *  since start or reset_stats()
+     */
+    double
+    utilization() const;
+
+    inline
+    const Stats&
+    stats() const
+    {
+      return stats_;
+    }
+
+    inline
+    void
+    reset_stats()
+    {
+      stats_ = Stats();
+    }
+
+  private:
+    typedef std::vector<Part> Parts;
+
+    struct Request
+    {
+      Parts parts; //!< client route, delimiter and body
+      uint64_t arrived;
+    };
+
+    zmq::socket_t& frontend_;
+
+    zmq::socket_t& backend_;
+
+    const size_t max_backlog_;
+
+    const size_t budget_;
+
+    std::deque<Parts*> idle_; //!< owned, routes of idle workers, LRU first
+
+    std::deque<Request*> backlog_; //!< owned
+
+    size_t busy_;
+
+    uint64_t last_usec_; //!< time worker counters are updated to
+
+    Stats stats_;
+
+    volatile bool stopped_;
+
+    /**
+     * Update worker time counters
+     * @return current time
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    uint64_t
+    account();
+
+    /**
+     * Receive message as is (with envelopes) into @c parts
+     * @return index of first empty part or 0 if there is none
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    static
+    size_t
+    receive(zmq::socket_t& sock, Parts& parts) throw(ZmqErrorType);
+
+    /**
+     * Send parts from @c idx_from, moving them
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    static
+    void
+    send(zmq::socket_t& sock, Parts& parts, size_t idx_from,
+      bool more = false) throw(ZmqErrorType);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    from_frontend() throw(ZmqErrorType);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    from_backend() throw(ZmqErrorType);
+
+    /**
+     * Send oldest request to least recently used worker
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    dispatch(uint64_t now) throw(ZmqErrorType);
+  };
+}
+
+#endif /* ZMQMESSAGE_BROKER_HPP_ */
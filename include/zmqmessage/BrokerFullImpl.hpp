@@ -0,0 +1,245 @@
+/**
+ * @file BrokerFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of Broker methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_BROKERFULLIMPL_HPP_
+#define ZMQMESSAGE_BROKERFULLIMPL_HPP_
+
+#include <cstring>
+#include <memory>
+
+namespace ZmqMessage
+{
+  const char* const Broker::READY = "READY";
+
+  Broker::Stats::Stats() :
+    requests(0), replies(0), malformed(0), wait_usec(0), max_wait_usec(0),
+    busy_usec(0), worker_usec(0)
+  {}
+
+  Broker::Broker(zmq::socket_t& frontend, zmq::socket_t& backend,
+    size_t max_backlog, size_t budget) :
+    frontend_(frontend), backend_(backend),
+    max_backlog_(max_backlog ? max_backlog : 1),
+    budget_(budget ? budget : 1), busy_(0), last_usec_(monotonic_usec()),
+    stopped_(false)
+  {}
+
+  Broker::~Broker()
+  {
+    for (size_t i = 0; i < idle_.size(); ++i)
+    {
+      delete idle_[i];
+    }
+    for (size_t i = 0; i < backlog_.size(); ++i)
+    {
+      delete backlog_[i];
+    }
+  }
+
+  uint64_t
+  Broker::account()
+  {
+    const uint64_t now = monotonic_usec();
+    const uint64_t elapsed = now - last_usec_;
+    stats_.busy_usec += busy_ * elapsed;
+    stats_.worker_usec += (busy_ + idle_.size()) * elapsed;
+    last_usec_ = now;
+    return now;
+  }
+
+  double
+  Broker::utilization() const
+  {
+    const uint64_t elapsed = monotonic_usec() - last_usec_;
+    const uint64_t busy = stats_.busy_usec + busy_ * elapsed;
+    const uint64_t total =
+      stats_.worker_usec + (busy_ + idle_.size()) * elapsed;
+    return total ? static_cast<double>(busy) / total : 0;
+  }
+
+  size_t
+  Broker::receive(zmq::socket_t& sock, Parts& parts) throw(ZmqErrorType)
+  {
+    size_t delimiter = 0;
+    do
+    {
+      parts.push_back(Part());
+      recv_msg(sock, parts.back().msg());
+      if (!delimiter && parts.size() > 1 && !parts.back().msg().size())
+      {
+        delimiter = parts.size() - 1;
+      }
+    }
+    while (has_more(sock));
+    return delimiter;
+  }
+
+  void
+  Broker::send(zmq::socket_t& sock, Parts& parts, size_t idx_from,
+    bool more) throw(ZmqErrorType)
+  {
+    for (size_t i = idx_from; i < parts.size(); ++i)
+    {
+      const bool last = (i == parts.size() - 1) && !more;
+      send_msg(sock, parts[i].msg(), last ? 0 : ZMQ_SNDMORE);
+    }
+  }
+
+  void
+  Broker::dispatch(uint64_t now) throw(ZmqErrorType)
+  {
+    std::auto_ptr<Parts> worker(idle_.front());
+    idle_.pop_front();
+    std::auto_ptr<Request> request(backlog_.front());
+    backlog_.pop_front();
+    ++busy_;
+
+    const uint64_t wait = now - request->arrived;
+    stats_.wait_usec += wait;
+    if (wait > stats_.max_wait_usec)
+    {
+      stats_.max_wait_usec = wait;
+    }
+
+    send(backend_, *worker, 0, true);
+    send(backend_, request->parts, 0);
+  }
+
+  void
+  Broker::from_frontend() throw(ZmqErrorType)
+  {
+    std::auto_ptr<Request> request(new Request);
+    const size_t delimiter = receive(frontend_, request->parts);
+    const uint64_t now = account();
+    if (!delimiter)
+    {
+      ++stats_.malformed;
+      return;
+    }
+    ++stats_.requests;
+    request->arrived = now;
+    backlog_.push_back(request.get());
+    request.release();
+    if (!idle_.empty())
+    {
+      dispatch(now);
+    }
+  }
+
+  void
+  Broker::from_backend() throw(ZmqErrorType)
+  {
+    std::auto_ptr<Parts> worker(new Parts);
+    Parts& parts = *worker;
+    const size_t delimiter = receive(backend_, parts);
+    const uint64_t now = account();
+    if (!delimiter)
+    {
+      ++stats_.malformed;
+      return;
+    }
+
+    const size_t body = delimiter + 1;
+    const size_t ready_sz = ::strlen(READY);
+    const bool ready = parts.size() == body + 1 &&
+      parts[body].msg().size() == ready_sz &&
+      !::memcmp(parts[body].msg().data(), READY, ready_sz);
+    if (!ready)
+    {
+      if (busy_)
+      {
+        --busy_;
+      }
+      //client route must end with delimiter too
+      size_t client_delimiter = body + 1;
+      while (client_delimiter < parts.size() &&
+        parts[client_delimiter].msg().size())
+      {
+        ++client_delimiter;
+      }
+      if (client_delimiter < parts.size())
+      {
+        send(frontend_, parts, body);
+        ++stats_.replies;
+      }
+      else
+      {
+        ++stats_.malformed;
+      }
+    }
+
+    parts.resize(body); //worker route
+    idle_.push_back(worker.get());
+    worker.release();
+    if (!backlog_.empty())
+    {
+      dispatch(now);
+    }
+  }
+
+  size_t
+  Broker::poll(long timeout) throw(ZmqErrorType)
+  {
+    zmq::pollitem_t items[2];
+    items[0].socket = frontend_;
+    items[1].socket = backend_;
+    for (size_t i = 0; i < 2; ++i)
+    {
+      items[i].fd = 0;
+      items[i].events = ZMQ_POLLIN;
+      items[i].revents = 0;
+    }
+    //requests are not read while backlog is full
+    if (backlog_.size() >= max_backlog_)
+    {
+      items[0].events = 0;
+    }
+
+    int rc = 0;
+    try
+    {
+      rc = zmq::poll(items, 2, timeout);
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+    if (rc <= 0)
+    {
+      return 0;
+    }
+
+    size_t received = 0;
+    //replies first: they free workers for requests
+    for (size_t n = 0; n < budget_ && wait_readable(backend_, 0); ++n)
+    {
+      from_backend();
+      ++received;
+    }
+    for (size_t n = 0; n < budget_ && backlog_.size() < max_backlog_ &&
+      wait_readable(frontend_, 0); ++n)
+    {
+      from_frontend();
+      ++received;
+    }
+    return received;
+  }
+
+  void
+  Broker::run(long check_interval) throw(ZmqErrorType)
+  {
+    while (!stopped_)
+    {
+      poll(check_interval);
+    }
+  }
+}
+
+#endif /* ZMQMESSAGE_BROKERFULLIMPL_HPP_ */
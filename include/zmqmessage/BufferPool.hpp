@@ -0,0 +1,163 @@
+/**
+ * @file BufferPool.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_BUFFERPOOL_HPP_
+#define ZMQMESSAGE_BUFFERPOOL_HPP_
+
+#include <stdint.h>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/PartAllocator.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Pool of preallocated payload buffers for outgoing message parts.
+   *
+   * Buffers are grouped in size classes (powers of 2,
+   * from @c MIN_BUFFER_SIZE up to @c max_buffer_size given to constructor),
+   * every class has fixed number of buffers allocated at construction.
+   * Free buffers of every class are kept in lock-free list,
+   * so buffers may be taken by several sending threads
+   * and returned by zmq deleter from any thread (libzmq I/O threads).
+   *
+   * When class is exhausted or requested size is larger than
+   * the largest class, message is initialized as usual
+   * (buffer is allocated by zmq), that is counted as miss.
+   *
+   * Note, that zmq still allocates small reference-counted
+   * content descriptor for every message with external buffer,
+   * but payload itself is neither allocated nor freed.
+   *
+   * Pool must outlive all messages composed with its buffers
+   * (in particular, zmq context should be terminated before pool
+   * is destroyed if messages may be still queued).
+   *
+   * @code
+   * ZmqMessage::BufferPool pool(16 * 1024, 128);
+   * ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(
+   *   ZmqMessage::OutOptions(sock, 0, 0, &pool));
+   * out << big_string << ZmqMessage::Flush;
+   * @endcode
+   */
+  class ZMQMESSAGE_DLL_PUBLIC BufferPool :
+    public PartAllocator, private Private::NonCopyable
+  {
+  public:
+    static const int MIN_BUFFER_BITS = 6;
+
+    /**
+     * Capacity of smallest size class
+     */
+    static const size_t MIN_BUFFER_SIZE = 1 << MIN_BUFFER_BITS;
+
+    static const size_t MAX_SIZE_CLASSES = 24;
+
+    /**
+     * @brief Snapshot of pool counters
+     */
+    struct Stats
+    {
+      size_t hits; //!< parts initialized with pooled buffer
+      size_t misses; //!< parts initialized without pool (exhausted or too large)
+      size_t recycled; //!< pooled buffers returned by zmq
+    };
+
+    /**
+     * Create pool and preallocate buffers.
+     * @param max_buffer_size capacity of the largest size class
+     *  (rounded up to power of 2)
+     * @param buffers_per_class number of buffers in every size class
+     */
+    BufferPool(size_t max_buffer_size, size_t buffers_per_class);
+
+    virtual
+    ~BufferPool();
+
+    /**
+     * @return snapshot of counters
+     */
+    Stats
+    stats() const;
+
+    /**
+     * @return number of pooled buffers currently owned by messages
+     */
+    size_t
+    in_use() const;
+
+    inline
+    size_t
+    max_buffer_size() const
+    {
+      return MIN_BUFFER_SIZE << (classes_num_ - 1);
+    }
+
+  protected:
+    virtual
+    void*
+    do_init(zmq::message_t& msg, size_t sz) throw(ZmqErrorType);
+
+  private:
+    /**
+     * Placed right before every pooled buffer, passed to zmq as hint.
+     */
+    struct BufferHeader
+    {
+      BufferPool* pool;
+      uint32_t cls;
+      uint32_t index;
+    };
+
+    struct SizeClass
+    {
+      size_t slot_size; //!< header and buffer, aligned
+      char* slab;
+      /**
+       * Free list links: index of next free buffer + 1, 0 terminates.
+       */
+      uint32_t* next;
+      /**
+       * Free list head: ABA tag in high 32 bits, index + 1 in low ones.
+       */
+      volatile uint64_t head;
+    };
+
+    SizeClass classes_[MAX_SIZE_CLASSES];
+    size_t classes_num_;
+    size_t buffers_per_class_;
+
+    volatile size_t hits_;
+    volatile size_t misses_;
+    volatile size_t recycled_;
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    free_classes();
+
+    ZMQMESSAGE_DLL_LOCAL
+    int
+    size_class(size_t sz) const;
+
+    ZMQMESSAGE_DLL_LOCAL
+    BufferHeader*
+    pop(size_t cls);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    push(size_t cls, uint32_t index);
+
+    ZMQMESSAGE_DLL_LOCAL
+    static
+    void
+    recycle(void* data, void* hint);
+  };
+}
+
+#endif /* ZMQMESSAGE_BUFFERPOOL_HPP_ */
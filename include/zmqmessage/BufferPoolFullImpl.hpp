@@ -0,0 +1,194 @@
+/**
+ * @file BufferPoolFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of BufferPool methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_BUFFERPOOLFULLIMPL_HPP_
+#define ZMQMESSAGE_BUFFERPOOLFULLIMPL_HPP_
+
+#include <climits>
+#include <cstdlib>
+#include <new>
+
+namespace ZmqMessage
+{
+  BufferPool::BufferPool(size_t max_buffer_size, size_t buffers_per_class) :
+    classes_num_(0), buffers_per_class_(buffers_per_class),
+    hits_(0), misses_(0), recycled_(0)
+  {
+    assert(buffers_per_class_ < 0xffffffffu);
+
+    for (size_t sz = MIN_BUFFER_SIZE;
+         classes_num_ < MAX_SIZE_CLASSES; sz <<= 1)
+    {
+      SizeClass& c = classes_[classes_num_];
+      //keep buffers aligned like malloc'ed ones
+      c.slot_size = (sizeof(BufferHeader) + sz + 15) & ~size_t(15);
+      c.slab = static_cast<char*>(::malloc(c.slot_size * buffers_per_class_));
+      c.next = static_cast<uint32_t*>(
+        ::malloc(sizeof(uint32_t) * buffers_per_class_));
+      if (!c.slab || !c.next)
+      {
+        ::free(c.slab);
+        ::free(c.next);
+        free_classes();
+        throw std::bad_alloc();
+      }
+      ++classes_num_;
+
+      for (size_t i = 0; i < buffers_per_class_; ++i)
+      {
+        BufferHeader* h =
+          reinterpret_cast<BufferHeader*>(c.slab + c.slot_size * i);
+        h->pool = this;
+        h->cls = classes_num_ - 1;
+        h->index = i;
+        c.next[i] = (i + 1 < buffers_per_class_) ? i + 2 : 0;
+      }
+      c.head = buffers_per_class_ ? 1 : 0;
+
+      if (sz >= max_buffer_size)
+      {
+        break;
+      }
+    }
+  }
+
+  BufferPool::~BufferPool()
+  {
+    if (in_use())
+    {
+      ZMQMESSAGE_LOG_STREAM << "BufferPool destroyed while " << in_use()
+        << " buffers are still owned by messages" << ZMQMESSAGE_LOG_TERM;
+    }
+    free_classes();
+  }
+
+  void
+  BufferPool::free_classes()
+  {
+    for (size_t i = 0; i < classes_num_; ++i)
+    {
+      ::free(classes_[i].slab);
+      ::free(classes_[i].next);
+    }
+    classes_num_ = 0;
+  }
+
+  BufferPool::Stats
+  BufferPool::stats() const
+  {
+    Stats s;
+    s.hits = hits_;
+    s.misses = misses_;
+    s.recycled = recycled_;
+    return s;
+  }
+
+  size_t
+  BufferPool::in_use() const
+  {
+    return hits_ - recycled_;
+  }
+
+  int
+  BufferPool::size_class(size_t sz) const
+  {
+    if (sz <= MIN_BUFFER_SIZE)
+    {
+      return 0;
+    }
+    //smallest power of 2 not less than sz is 2^bits
+    const int bits = sizeof(unsigned long) * CHAR_BIT -
+      __builtin_clzl(static_cast<unsigned long>(sz - 1));
+    const int cls = bits - MIN_BUFFER_BITS;
+    return (cls < static_cast<int>(classes_num_)) ? cls : -1;
+  }
+
+  BufferPool::BufferHeader*
+  BufferPool::pop(size_t cls)
+  {
+    SizeClass& c = classes_[cls];
+    for (;;)
+    {
+      const uint64_t old_head = c.head;
+      const uint32_t idx = static_cast<uint32_t>(old_head);
+      if (!idx)
+      {
+        return 0;
+      }
+      const uint64_t new_head =
+        (((old_head >> 32) + 1) << 32) | c.next[idx - 1];
+      if (__sync_bool_compare_and_swap(&c.head, old_head, new_head))
+      {
+        return reinterpret_cast<BufferHeader*>(
+          c.slab + c.slot_size * (idx - 1));
+      }
+    }
+  }
+
+  void
+  BufferPool::push(size_t cls, uint32_t index)
+  {
+    SizeClass& c = classes_[cls];
+    for (;;)
+    {
+      const uint64_t old_head = c.head;
+      c.next[index] = static_cast<uint32_t>(old_head);
+      const uint64_t new_head = (((old_head >> 32) + 1) << 32) | (index + 1);
+      if (__sync_bool_compare_and_swap(&c.head, old_head, new_head))
+      {
+        return;
+      }
+    }
+  }
+
+  void
+  BufferPool::recycle(void* data, void* hint)
+  {
+    BufferHeader* h = static_cast<BufferHeader*>(hint);
+    h->pool->push(h->cls, h->index);
+    __sync_fetch_and_add(&h->pool->recycled_, 1);
+  }
+
+  void*
+  BufferPool::do_init(zmq::message_t& msg, size_t sz) throw(ZmqErrorType)
+  {
+    const int cls = size_class(sz);
+    BufferHeader* h = (cls >= 0) ? pop(cls) : 0;
+    try
+    {
+      if (h)
+      {
+        void* data = h + 1;
+        try
+        {
+          msg.rebuild(data, sz, &BufferPool::recycle, h);
+        }
+        catch (...)
+        {
+          push(h->cls, h->index);
+          throw;
+        }
+        __sync_fetch_and_add(&hits_, 1);
+        return data;
+      }
+
+      __sync_fetch_and_add(&misses_, 1);
+      msg.rebuild(sz);
+      return msg.data();
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+    return 0;
+  }
+}
+
+#endif /* ZMQMESSAGE_BUFFERPOOLFULLIMPL_HPP_ */
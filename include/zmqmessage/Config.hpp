@@ -138,6 +138,39 @@
 //  ::ZmqMessage::DynamicPartsStorage<std::allocator<::ZmqMessage::Part> >
 #endif
 
+/**
+ * @def ZMQMESSAGE_POOL_MIN_PART_SIZE
+ * Parts of this size or less are initialized as usual
+ * even if PartAllocator is given: zmq stores them inline
+ * in message (very small messages) without heap allocation anyway.
+ * By default it's zmq very small message size.
+ */
+#ifndef ZMQMESSAGE_POOL_MIN_PART_SIZE
+# ifdef ZMQ_MAX_VSM_SIZE
+#  define ZMQMESSAGE_POOL_MIN_PART_SIZE ZMQ_MAX_VSM_SIZE
+# else
+#  define ZMQMESSAGE_POOL_MIN_PART_SIZE 29
+# endif
+#endif
+
+/**
+ * @def ZMQMESSAGE_ALLOC_STATS
+ * If defined, heap allocations made by the calling thread are counted
+ * and attributed to library call sites (parts storage, outgoing queue,
+ * stream conversions, iterators, logging),
+ * see ZmqMessage::AllocStats.
+ * Counting requires global operator new/delete hooks:
+ * include zmqmessage/AllocHooks.hpp in ONE .cpp file of your application.
+ * Intended for tests and profiling builds.
+ * For non header-only builds must be the same in shared library
+ * and client code, just like \ref ZMQMESSAGE_WRAP_ZMQ_ERROR
+ */
+#ifndef ZMQMESSAGE_ALLOC_STATS
+//just to generate correct docs
+# define ZMQMESSAGE_ALLOC_STATS 1
+# undef ZMQMESSAGE_ALLOC_STATS
+#endif
+
 /**
  * @def ZMQMESSAGE_EXCEPTION_MACRO
  * Macro to generate exception class definition by exception name.
@@ -0,0 +1,183 @@
+/**
+ * @file Conflater.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_CONFLATER_HPP_
+#define ZMQMESSAGE_CONFLATER_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/Part.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Receiving with conflation: only the newest message per key.
+   *
+   * When consumer falls behind, processing of every queued update
+   * is wasted if only the latest value per key (e.g. instrument) matters.
+   * drain() receives all messages available on socket (without blocking),
+   * keeps the newest one per key and then passes them to handler,
+   * in order of first appearance of the key.
+   *
+   * Key is content of message part (by index) or computed by KeyExtractor.
+   * Table of @c max_keys entries is allocated once, message parts
+   * are received into Part objects of entries and reused
+   * (message replaced by newer one gives its parts for the next one).
+   * @code
+   * ZmqMessage::Conflater conflater(sub_sock, 0); //part 0 is instrument
+   * for (;;)
+   * {
+   *   ZmqMessage::wait_readable(sub_sock, -1);
+   *   conflater.drain(handler);
+   * }
+   * @endcode
+   * Counters show how many messages were collapsed.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC Conflater : private Private::NonCopyable
+  {
+  public:
+    typedef std::vector<Part> Parts;
+
+    class ZMQMESSAGE_DLL_PUBLIC Handler
+    {
+    public:
+      virtual
+      ~Handler();
+
+      /**
+       * @param parts of the newest message of key,
+       *  valid until handler returns
+       * @param received number of messages of key received by drain()
+       *  (received - 1 are collapsed)
+       */
+      virtual
+      void
+      on_message(Parts& parts, size_t received) = 0;
+    };
+
+    class ZMQMESSAGE_DLL_PUBLIC KeyExtractor
+    {
+    public:
+      virtual
+      ~KeyExtractor();
+
+      /**
+       * @return key of message, messages with the same key are conflated
+       */
+      virtual
+      uint64_t
+      key(Parts& parts) = 0;
+    };
+
+    struct Stats
+    {
+      uint64_t received; //!< messages received
+      uint64_t delivered; //!< messages passed to handler
+      uint64_t collapsed; //!< messages replaced by newer ones
+      uint64_t drains; //!< drain() calls
+
+      Stats();
+    };
+
+    static const size_t DEFAULT_MAX_KEYS = 1024;
+
+    /**
+     * Key is content of part @c key_idx (empty if there is no such part)
+     * @param max_keys max distinct keys kept by one drain()
+     */
+    Conflater(zmq::socket_t& sock, size_t key_idx,
+      size_t max_keys = DEFAULT_MAX_KEYS);
+
+    /**
+     * Key is computed by extractor (not owned)
+     */
+    Conflater(zmq::socket_t& sock, KeyExtractor& extractor,
+      size_t max_keys = DEFAULT_MAX_KEYS);
+
+    /**
+     * Receive messages available on socket and pass the newest one
+     * of every key to handler.
+     * Receiving stops when @c max_keys distinct keys are received,
+     * or @c max_messages are received (0 means no limit),
+     * the rest is left for the next call.
+     * Not re-entrant: handler gets parts of table entries,
+     * so it must not call drain() of the same Conflater.
+     * @return number of messages passed to handler
+     */
+    size_t
+    drain(Handler& handler, size_t max_messages = 0) throw(ZmqErrorType);
+
+    inline
+    const Stats&
+    stats() const
+    {
+      return stats_;
+    }
+
+    inline
+    void
+    reset_stats()
+    {
+      stats_ = Stats();
+    }
+
+  private:
+    struct Entry
+    {
+      Parts parts;
+      uint64_t hash;
+      size_t received;
+      size_t slot; //!< index in slots_
+    };
+
+    static const size_t NO_ENTRY = ~static_cast<size_t>(0);
+
+    zmq::socket_t& sock_;
+
+    const size_t key_idx_;
+
+    KeyExtractor* const extractor_;
+
+    std::vector<Entry> entries_; //!< max_keys, first used_ ones are used
+
+    size_t used_;
+
+    Entry scratch_; //!< message being received
+
+    std::vector<size_t> slots_; //!< open addressing: index of entry
+
+    Stats stats_;
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    init(size_t max_keys);
+
+    /**
+     * Receive message into scratch_
+     * @return false if there is no message
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    bool
+    receive() throw(ZmqErrorType);
+
+    ZMQMESSAGE_DLL_LOCAL
+    uint64_t
+    hash(Parts& parts) const;
+
+    ZMQMESSAGE_DLL_LOCAL
+    bool
+    same_key(Entry& lhs, Entry& rhs) const;
+  };
+}
+
+#endif /* ZMQMESSAGE_CONFLATER_HPP_ */
@@ -0,0 +1,179 @@
+/**
+ * @file ConflaterFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of Conflater methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_CONFLATERFULLIMPL_HPP_
+#define ZMQMESSAGE_CONFLATERFULLIMPL_HPP_
+
+#include <algorithm>
+#include <cstring>
+
+namespace ZmqMessage
+{
+  Conflater::Handler::~Handler()
+  {}
+
+  Conflater::KeyExtractor::~KeyExtractor()
+  {}
+
+  Conflater::Stats::Stats() :
+    received(0), delivered(0), collapsed(0), drains(0)
+  {}
+
+  Conflater::Conflater(zmq::socket_t& sock, size_t key_idx,
+    size_t max_keys) :
+    sock_(sock), key_idx_(key_idx), extractor_(0), used_(0)
+  {
+    init(max_keys);
+  }
+
+  Conflater::Conflater(zmq::socket_t& sock, KeyExtractor& extractor,
+    size_t max_keys) :
+    sock_(sock), key_idx_(0), extractor_(&extractor), used_(0)
+  {
+    init(max_keys);
+  }
+
+  void
+  Conflater::init(size_t max_keys)
+  {
+    max_keys = std::max(max_keys, static_cast<size_t>(1));
+    Entry entry;
+    entry.hash = 0;
+    entry.received = 0;
+    entry.slot = 0;
+    entries_.resize(max_keys, entry);
+    scratch_ = entry;
+    size_t capacity = 2;
+    while (capacity < 2 * max_keys)
+    {
+      capacity *= 2;
+    }
+    const size_t no_entry = NO_ENTRY;
+    slots_.resize(capacity, no_entry);
+  }
+
+  bool
+  Conflater::receive() throw(ZmqErrorType)
+  {
+    Parts& parts = scratch_.parts;
+    if (parts.empty())
+    {
+      parts.push_back(Part());
+    }
+    if (!try_recv_msg(sock_, parts[0].msg()))
+    {
+      return false;
+    }
+    size_t n = 1;
+    for (; has_more(sock_); ++n)
+    {
+      if (n == parts.size())
+      {
+        parts.push_back(Part());
+      }
+      recv_msg(sock_, parts[n].msg());
+    }
+    if (n < parts.size())
+    {
+      parts.resize(n);
+    }
+    return true;
+  }
+
+  uint64_t
+  Conflater::hash(Parts& parts) const
+  {
+    if (extractor_)
+    {
+      return extractor_->key(parts);
+    }
+    if (key_idx_ >= parts.size())
+    {
+      return ShardedSink::hash(0, 0);
+    }
+    zmq::message_t& key = parts[key_idx_].msg();
+    return ShardedSink::hash(key.data(), key.size());
+  }
+
+  bool
+  Conflater::same_key(Entry& lhs, Entry& rhs) const
+  {
+    if (lhs.hash != rhs.hash)
+    {
+      return false;
+    }
+    if (extractor_)
+    {
+      return true;
+    }
+    const bool lhs_has = key_idx_ < lhs.parts.size();
+    const bool rhs_has = key_idx_ < rhs.parts.size();
+    if (!lhs_has || !rhs_has)
+    {
+      return lhs_has == rhs_has;
+    }
+    zmq::message_t& l = lhs.parts[key_idx_].msg();
+    zmq::message_t& r = rhs.parts[key_idx_].msg();
+    return l.size() == r.size() && !::memcmp(l.data(), r.data(), l.size());
+  }
+
+  size_t
+  Conflater::drain(Handler& handler, size_t max_messages)
+    throw(ZmqErrorType)
+  {
+    ++stats_.drains;
+    const size_t mask = slots_.size() - 1;
+    for (size_t n = 0; (!max_messages || n < max_messages) &&
+      used_ < entries_.size() && receive(); ++n)
+    {
+      ++stats_.received;
+      scratch_.hash = hash(scratch_.parts);
+      size_t slot = scratch_.hash & mask;
+      for (; slots_[slot] != NO_ENTRY; slot = (slot + 1) & mask)
+      {
+        Entry& entry = entries_[slots_[slot]];
+        if (same_key(entry, scratch_))
+        {
+          //older message gives its parts for the next one
+          entry.parts.swap(scratch_.parts);
+          ++entry.received;
+          ++stats_.collapsed;
+          break;
+        }
+      }
+      if (slots_[slot] == NO_ENTRY)
+      {
+        Entry& entry = entries_[used_];
+        entry.parts.swap(scratch_.parts);
+        entry.hash = scratch_.hash;
+        entry.received = 1;
+        entry.slot = slot;
+        slots_[slot] = used_++;
+      }
+    }
+
+    //slots are cleared before handlers are called,
+    //entries are handed out as is (so drain is not re-entrant)
+    const size_t delivered = used_;
+    used_ = 0;
+    for (size_t i = 0; i < delivered; ++i)
+    {
+      slots_[entries_[i].slot] = NO_ENTRY;
+    }
+    stats_.delivered += delivered;
+    for (size_t i = 0; i < delivered; ++i)
+    {
+      handler.on_message(entries_[i].parts, entries_[i].received);
+    }
+    return delivered;
+  }
+}
+
+#endif /* ZMQMESSAGE_CONFLATERFULLIMPL_HPP_ */
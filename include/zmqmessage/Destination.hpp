@@ -0,0 +1,119 @@
+/**
+ * @file Destination.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_DESTINATION_HPP_
+#define ZMQMESSAGE_DESTINATION_HPP_
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/Part.hpp>
+#include <zmqmessage/OutOptions.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * Counters of messages sent to destination socket
+   * by FanOut or ShardedSink
+   */
+  struct ZMQMESSAGE_DLL_PUBLIC DestinationStats
+  {
+    uint64_t sent; //!< messages sent (or resent from queue)
+    uint64_t bytes; //!< bytes of message parts sent (without routing)
+    uint64_t queued; //!< messages queued (would block)
+    uint64_t dropped; //!< messages dropped (would block)
+
+    DestinationStats();
+  };
+
+  namespace Private
+  {
+    /**
+     * Destination socket with its own options, routing parts
+     * and queue of messages not sent because socket would block.
+     * Message parts are shared (zmq_msg_copy) with given multipart.
+     * With OutOptions::DROP_ON_BLOCK messages are dropped
+     * if socket would block, with OutOptions::CACHE_ON_BLOCK they are queued
+     * (in Sink outgoing queue) and resent in order by flush(),
+     * up to @c max_queued messages, then dropped.
+     */
+    class ZMQMESSAGE_DLL_PUBLIC Destination : private NonCopyable
+    {
+    public:
+      Destination(zmq::socket_t& sock, unsigned options, size_t max_queued);
+
+      /**
+       * Deletes queued messages
+       */
+      ~Destination();
+
+      void
+      add_routing(const void* data, size_t sz) throw(ZmqErrorType);
+
+      /**
+       * Send parts from @c idx_from to @c idx_to - 1 (after routing),
+       * queued messages are resent first.
+       * @return false if message is queued or dropped
+       */
+      bool
+      send(Multipart& multipart, size_t idx_from, size_t idx_to)
+        throw(ZmqErrorType, NoSuchPartError);
+
+      /**
+       * Queue message (e.g. detached from Sink) to be sent by flush()
+       * @param queued taken ownership of
+       * @return false if queue is full and message is dropped
+       */
+      bool
+      enqueue(Multipart* queued);
+
+      /**
+       * Try to resend queued messages.
+       * @return false if queue is still not empty
+       */
+      bool
+      flush() throw(ZmqErrorType);
+
+      inline
+      size_t
+      queued() const
+      {
+        return queue_.size();
+      }
+
+      inline
+      const DestinationStats&
+      stats() const
+      {
+        return stats_;
+      }
+
+      inline
+      zmq::socket_t&
+      sock()
+      {
+        return sock_;
+      }
+
+    private:
+      zmq::socket_t& sock_;
+      unsigned options_;
+      const size_t max_queued_;
+      std::vector<Part> routing_;
+      std::deque<Multipart*> queue_; //!< owned
+      DestinationStats stats_;
+    };
+  }
+}
+
+#endif /* ZMQMESSAGE_DESTINATION_HPP_ */
@@ -0,0 +1,154 @@
+/**
+ * @file DestinationFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of Destination methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_DESTINATIONFULLIMPL_HPP_
+#define ZMQMESSAGE_DESTINATIONFULLIMPL_HPP_
+
+#include <cstring>
+#include <memory>
+
+namespace ZmqMessage
+{
+  DestinationStats::DestinationStats() :
+    sent(0), bytes(0), queued(0), dropped(0)
+  {}
+
+  namespace Private
+  {
+    Destination::Destination(
+      zmq::socket_t& sock, unsigned options, size_t max_queued) :
+      sock_(sock), options_(options), max_queued_(max_queued)
+    {
+      if (options & (OutOptions::DROP_ON_BLOCK | OutOptions::CACHE_ON_BLOCK))
+      {
+        options_ |= OutOptions::NONBLOCK;
+      }
+    }
+
+    Destination::~Destination()
+    {
+      for (size_t i = 0; i < queue_.size(); ++i)
+      {
+        delete queue_[i];
+      }
+    }
+
+    void
+    Destination::add_routing(const void* data, size_t sz)
+      throw(ZmqErrorType)
+    {
+      Part part(sz);
+      if (sz)
+      {
+        ::memcpy(part.msg().data(), data, sz);
+      }
+      routing_.push_back(part);
+    }
+
+    bool
+    Destination::enqueue(Multipart* queued)
+    {
+      std::auto_ptr<Multipart> ptr(queued);
+      if (queue_.size() >= max_queued_)
+      {
+        ++stats_.dropped;
+        return false;
+      }
+      queue_.push_back(ptr.get());
+      ptr.release();
+      ++stats_.queued;
+      return true;
+    }
+
+    bool
+    Destination::flush() throw(ZmqErrorType)
+    {
+      while (!queue_.empty())
+      {
+        Multipart* queued = queue_.front();
+        size_t bytes = 0;
+        for (size_t i = routing_.size(); i < queued->size(); ++i)
+        {
+          bytes += (*queued)[i].msg().size();
+        }
+
+        Outgoing<SimpleRouting> out(sock_,
+          OutOptions::NONBLOCK | OutOptions::CACHE_ON_BLOCK);
+        out.send_incoming_messages(*queued, false);
+        out.flush();
+        delete queued;
+        if (out.is_queued())
+        {
+          //parts are moved to the new queue
+          queue_.front() = out.detach();
+          return false;
+        }
+        queue_.pop_front();
+        ++stats_.sent;
+        stats_.bytes += bytes;
+      }
+      return true;
+    }
+
+    bool
+    Destination::send(Multipart& multipart, size_t idx_from, size_t idx_to)
+      throw(ZmqErrorType, NoSuchPartError)
+    {
+      unsigned options = options_;
+      if (!flush())
+      {
+        if (!(options & OutOptions::CACHE_ON_BLOCK) ||
+          queue_.size() >= max_queued_)
+        {
+          ++stats_.dropped;
+          return false;
+        }
+        //keep order: queue after previous ones
+        options |= OutOptions::EMULATE_BLOCK_SENDS;
+      }
+
+      Outgoing<SimpleRouting> out(sock_, options);
+      for (size_t i = 0; i < routing_.size(); ++i)
+      {
+        Part part;
+        part.copy(routing_[i]);
+        out << part;
+      }
+      size_t bytes = 0;
+      const size_t to = std::min(idx_to, multipart.size());
+      for (size_t i = idx_from; i < to; ++i)
+      {
+        //not decoded by codec of multipart, forwarded as received
+        Part part;
+        part.copy(multipart.parts()[i]);
+        bytes += part.msg().size();
+        out << part;
+      }
+      out.flush();
+
+      if (out.is_queued())
+      {
+        queue_.push_back(out.detach());
+        ++stats_.queued;
+        return false;
+      }
+      if (out.is_dropping())
+      {
+        ++stats_.dropped;
+        return false;
+      }
+      ++stats_.sent;
+      stats_.bytes += bytes;
+      return true;
+    }
+  }
+}
+
+#endif /* ZMQMESSAGE_DESTINATIONFULLIMPL_HPP_ */
@@ -0,0 +1,143 @@
+/**
+ * @file FanOut.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_FANOUT_HPP_
+#define ZMQMESSAGE_FANOUT_HPP_
+
+#include <climits>
+#include <vector>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/OutOptions.hpp>
+#include <zmqmessage/Destination.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Sends one multipart message to many destination sockets.
+   *
+   * Message parts are not copied: every destination gets
+   * zmq_msg_copy of them, which shares reference-counted content
+   * (very small parts are copied inside zmq message, that's cheaper).
+   * Given message stays intact.
+   *
+   * Every destination has its own options and routing parts
+   * (sent before message parts, e.g. peer identity and empty delimiter
+   * for XREP destination). Destination which would block
+   * does not stall the others:
+   * - with OutOptions::DROP_ON_BLOCK (default) message is dropped
+   *  for this destination;
+   * - with OutOptions::CACHE_ON_BLOCK message is queued and resent
+   *  (in order) on next send() or flush_queued(),
+   *  up to @c max_queued messages per destination, then dropped.
+   *
+   * @code
+   * ZmqMessage::FanOut fan;
+   * fan.add(sock1);
+   * fan.add(sock2, ZmqMessage::OutOptions::CACHE_ON_BLOCK);
+   * ...
+   * incoming.receive_all();
+   * fan.send(incoming);
+   * @endcode
+   */
+  class ZMQMESSAGE_DLL_PUBLIC FanOut : private Private::NonCopyable
+  {
+  public:
+    /**
+     * Per destination counters
+     */
+    typedef DestinationStats Stats;
+
+    static const size_t DEFAULT_MAX_QUEUED = 1000;
+
+    /**
+     * @param max_queued max number of messages queued per destination
+     */
+    explicit
+    FanOut(size_t max_queued = DEFAULT_MAX_QUEUED);
+
+    /**
+     * Deletes queued messages
+     */
+    ~FanOut();
+
+    /**
+     * Add destination socket.
+     * @param options OutOptions flags. With DROP_ON_BLOCK or CACHE_ON_BLOCK
+     * destination is written in non-blocking mode,
+     * otherwise sending to it blocks (and stalls other destinations).
+     * @return index of destination
+     */
+    size_t
+    add(zmq::socket_t& sock,
+      unsigned options = OutOptions::DROP_ON_BLOCK);
+
+    /**
+     * Append routing part sent to destination before message parts.
+     * Pass (0, 0) for empty delimiter.
+     */
+    void
+    add_routing(size_t target, const void* data, size_t sz)
+      throw(ZmqErrorType);
+
+    /**
+     * @return number of destinations
+     */
+    inline
+    size_t
+    size() const
+    {
+      return targets_.size();
+    }
+
+    /**
+     * Send parts of multipart from @c idx_from to @c idx_to - 1
+     * to all destinations. Queued messages are resent first.
+     * @return number of destinations message is sent to
+     *  (not queued or dropped)
+     */
+    size_t
+    send(Multipart& multipart,
+      size_t idx_from = 0, size_t idx_to = UINT_MAX)
+      throw(ZmqErrorType, NoSuchPartError);
+
+    /**
+     * Try to resend queued messages.
+     * @return number of messages still queued
+     */
+    size_t
+    flush_queued() throw(ZmqErrorType);
+
+    /**
+     * @return number of messages queued for destination
+     */
+    inline
+    size_t
+    queued(size_t target) const
+    {
+      return targets_[target]->queued();
+    }
+
+    inline
+    const Stats&
+    stats(size_t target) const
+    {
+      return targets_[target]->stats();
+    }
+
+  private:
+    std::vector<Private::Destination*> targets_; //!< owned
+
+    const size_t max_queued_;
+  };
+}
+
+#endif /* ZMQMESSAGE_FANOUT_HPP_ */
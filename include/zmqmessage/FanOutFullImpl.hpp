@@ -0,0 +1,75 @@
+/**
+ * @file FanOutFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of FanOut methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_FANOUTFULLIMPL_HPP_
+#define ZMQMESSAGE_FANOUTFULLIMPL_HPP_
+
+#include <memory>
+
+namespace ZmqMessage
+{
+  FanOut::FanOut(size_t max_queued) :
+    max_queued_(max_queued)
+  {}
+
+  FanOut::~FanOut()
+  {
+    for (size_t i = 0; i < targets_.size(); ++i)
+    {
+      delete targets_[i];
+    }
+  }
+
+  size_t
+  FanOut::add(zmq::socket_t& sock, unsigned options)
+  {
+    std::auto_ptr<Private::Destination> target(
+      new Private::Destination(sock, options, max_queued_));
+    targets_.push_back(target.get());
+    target.release();
+    return targets_.size() - 1;
+  }
+
+  void
+  FanOut::add_routing(size_t target, const void* data, size_t sz)
+    throw(ZmqErrorType)
+  {
+    targets_[target]->add_routing(data, sz);
+  }
+
+  size_t
+  FanOut::send(Multipart& multipart, size_t idx_from, size_t idx_to)
+    throw(ZmqErrorType, NoSuchPartError)
+  {
+    size_t sent = 0;
+    for (size_t i = 0; i < targets_.size(); ++i)
+    {
+      if (targets_[i]->send(multipart, idx_from, idx_to))
+      {
+        ++sent;
+      }
+    }
+    return sent;
+  }
+
+  size_t
+  FanOut::flush_queued() throw(ZmqErrorType)
+  {
+    size_t queued = 0;
+    for (size_t i = 0; i < targets_.size(); ++i)
+    {
+      targets_[i]->flush();
+      queued += targets_[i]->queued();
+    }
+    return queued;
+  }
+}
+
+#endif /* ZMQMESSAGE_FANOUTFULLIMPL_HPP_ */
@@ -0,0 +1,110 @@
+/**
+ * @file Handoff.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_HANDOFF_HPP_
+#define ZMQMESSAGE_HANDOFF_HPP_
+
+#include <memory>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+
+namespace ZmqMessage
+{
+  namespace Private
+  {
+    /**
+     * Address of @c tag identifies type T (in process)
+     */
+    template <typename T>
+    struct HandoffTag
+    {
+      static const char tag;
+    };
+
+    template <typename T>
+    const char HandoffTag<T>::tag = 0;
+
+    template <typename T>
+    void
+    handoff_delete(void* obj)
+    {
+      delete static_cast<T*>(obj);
+    }
+
+    /**
+     * Make message part owning object, object is deleted
+     * with @c destroy when part is released without being claimed.
+     */
+    ZMQMESSAGE_DLL_PUBLIC
+    void
+    handoff_init(zmq::message_t& msg, void* obj, const void* tag,
+      void (*destroy)(void*)) throw(ZmqErrorType);
+
+    /**
+     * Take object from message part made by handoff_init().
+     * Part must be the same memory (passed within process, not copied)
+     * and have the same tag.
+     */
+    ZMQMESSAGE_DLL_PUBLIC
+    void*
+    handoff_claim(zmq::message_t& msg, const void* tag)
+      throw(MessageFormatError);
+  }
+
+  /**
+   * @brief Ownership of heap object passed in message part
+   * between threads of one process.
+   *
+   * Part holds pointer to object tagged with its type,
+   * so nothing is serialized:
+   * @code
+   * std::auto_ptr<Request> req(new Request(...));
+   * ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(inproc_sock, 0)
+   *   << "request" << ZmqMessage::handoff(req) << ZmqMessage::Flush;
+   * //req is 0 now
+   * ...
+   * std::auto_ptr<Request> got;
+   * incoming >> ZmqMessage::Skip >> ZmqMessage::handoff(got);
+   * @endcode
+   * If message is dropped (never received or not extracted)
+   * object is deleted when the part is released.
+   * Part received from another process or over transport
+   * which copies parts (tcp://, ipc:// even to itself) is refused
+   * with MessageFormatError: only inproc:// sockets
+   * and in-process transports (see Transport) pass it.
+   * Part is claimed once: extracting from zmq_msg_copy'ed part
+   * after original is claimed fails.
+   * Sink sends the part bypassing its codec and refuses it
+   * in packed mode (both would copy the part).
+   */
+  template <typename T>
+  struct Handoff
+  {
+    std::auto_ptr<T>* obj;
+
+    explicit
+    Handoff(std::auto_ptr<T>& obj_p) : obj(&obj_p)
+    {}
+  };
+
+  /**
+   * Insert to Sink: object (not null) is released to the part,
+   * extract from Incoming: object is taken from the part.
+   */
+  template <typename T>
+  inline
+  Handoff<T>
+  handoff(std::auto_ptr<T>& obj)
+  {
+    return Handoff<T>(obj);
+  }
+}
+
+#endif /* ZMQMESSAGE_HANDOFF_HPP_ */
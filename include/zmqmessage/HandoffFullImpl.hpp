@@ -0,0 +1,99 @@
+/**
+ * @file HandoffFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of Handoff functions.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_HANDOFFFULLIMPL_HPP_
+#define ZMQMESSAGE_HANDOFFFULLIMPL_HPP_
+
+#include <stdint.h>
+#include <unistd.h>
+#include <memory>
+
+namespace ZmqMessage
+{
+  namespace Private
+  {
+    namespace
+    {
+      const uint32_t HANDOFF_MAGIC = 0x5a4d4f48; //"HOMZ"
+
+      /**
+       * Content of handoff part
+       */
+      struct HandoffData
+      {
+        uint32_t magic;
+        pid_t pid;
+        const void* self; //!< address of this data: part is not copied
+        const void* tag;
+        void* volatile obj; //!< 0 when claimed
+        void (*destroy)(void*);
+      };
+
+      void
+      handoff_free(void* data, void* hint)
+      {
+        HandoffData* h = static_cast<HandoffData*>(data);
+        void* obj = __sync_lock_test_and_set(&h->obj, static_cast<void*>(0));
+        if (obj)
+        {
+          h->destroy(obj);
+        }
+        delete h;
+      }
+    }
+
+    void
+    handoff_init(zmq::message_t& msg, void* obj, const void* tag,
+      void (*destroy)(void*)) throw(ZmqErrorType)
+    {
+      std::auto_ptr<HandoffData> h(new HandoffData);
+      h->magic = HANDOFF_MAGIC;
+      h->pid = ::getpid();
+      h->self = h.get();
+      h->tag = tag;
+      h->obj = obj;
+      h->destroy = destroy;
+      try
+      {
+        msg.rebuild(h.get(), sizeof(HandoffData), handoff_free, 0);
+      }
+      catch (const zmq::error_t& e)
+      {
+        throw_zmq_exception(e);
+      }
+      h.release();
+    }
+
+    void*
+    handoff_claim(zmq::message_t& msg, const void* tag)
+      throw(MessageFormatError)
+    {
+      HandoffData* h = static_cast<HandoffData*>(msg.data());
+      if (msg.size() != sizeof(HandoffData) ||
+        h->magic != HANDOFF_MAGIC || h->pid != ::getpid() || h->self != h)
+      {
+        throw MessageFormatError(
+          "Extracting handoff: part is not a handoff passed in process");
+      }
+      if (h->tag != tag)
+      {
+        throw MessageFormatError("Extracting handoff: type mismatch");
+      }
+      void* obj = __sync_lock_test_and_set(&h->obj, static_cast<void*>(0));
+      if (!obj)
+      {
+        throw MessageFormatError("Extracting handoff: already claimed");
+      }
+      return obj;
+    }
+  }
+}
+
+#endif /* ZMQMESSAGE_HANDOFFFULLIMPL_HPP_ */
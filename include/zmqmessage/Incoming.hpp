@@ -7,6 +7,7 @@
 #ifndef ZMQMESSAGE_INCOMING_HPP_
 #define ZMQMESSAGE_INCOMING_HPP_
 
+#include <stdint.h>
 #include <vector>
 #include <tr1/array>
 
@@ -14,6 +15,8 @@
 
 #include <zmqmessage/MultipartContainer.hpp>
 #include <zmqmessage/Routing.hpp>
+#include <zmqmessage/Transport.hpp>
+#include <zmqmessage/Handoff.hpp>
 #include <zmqmessage/Manip.hpp> //Skip is friend
 
 namespace ZmqMessage
@@ -37,20 +40,25 @@ namespace ZmqMessage
   private:
     typedef Private::MultipartContainer<PartsStorage> ContainerType;
 
-    zmq::socket_t& src_; //!< source socket to receive parts from
+    zmq::socket_t* src_; //!< source socket to receive parts from
+    Transport* transport_; //!< used instead of socket if not null
     bool is_terminal_; //!< no more parts at end
     size_t cur_extract_idx_;
     bool binary_mode_; //!< stream flag to handle conversion
+    bool packed_; //!< unpack packed frames
 
     ReceiveObserver* receive_observer_;
 
+    SpinWait* spin_wait_;
+
     ZMQMESSAGE_DLL_LOCAL
     void
     append_message_data(
       zmq::message_t& message, std::vector<char>& area) const;
 
     /**
-     * Fetches one message from src_, appends message to parts_.
+     * Fetches one message from src_, appends message to parts_
+     * (or all logical parts if message is a packed frame).
      * @return if we have more messages on socket
      */
     ZMQMESSAGE_DLL_LOCAL
@@ -61,9 +69,32 @@ namespace ZmqMessage
     bool
     do_receive_msg(Part& part) throw(ZmqErrorType);
 
+    /**
+     * Receive part from socket or transport
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    bool
+    try_recv_part(zmq::message_t& msg, int flags) throw(ZmqErrorType);
+
+    ZMQMESSAGE_DLL_LOCAL
+    bool
+    src_has_more();
+
+    ZMQMESSAGE_DLL_LOCAL
+    bool
+    src_readable(long timeout) throw(ZmqErrorType);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    unpack_received(size_t count) throw(ZmqErrorType, MessageFormatError);
+
     template <class OutRoutingPolicy>
     friend class Outgoing;
 
+    friend class Sink;
+
+    friend class RouteHandle;
+
     using RoutingPolicy::get_routing;
     using RoutingPolicy::get_routing_num;
 
@@ -82,9 +113,22 @@ namespace ZmqMessage
     Incoming(zmq::socket_t& sock,
       StorageArg arg = PartsStorage::default_storage_arg) :
       ContainerType(arg),
-      src_(sock), is_terminal_(false),
-      cur_extract_idx_(0), binary_mode_(false),
-      receive_observer_(0)
+      src_(&sock), transport_(0), is_terminal_(false),
+      cur_extract_idx_(0), binary_mode_(false), packed_(false),
+      receive_observer_(0), spin_wait_(0)
+    {
+    }
+
+    /**
+     * @param transport to receive from instead of zmq socket
+     * @param arg Storage-dependent argument, such as initial storage capacity
+     */
+    Incoming(Transport& transport,
+      StorageArg arg = PartsStorage::default_storage_arg) :
+      ContainerType(arg),
+      src_(transport.socket()), transport_(&transport), is_terminal_(false),
+      cur_extract_idx_(0), binary_mode_(false), packed_(false),
+      receive_observer_(0), spin_wait_(0)
     {
     }
 
@@ -110,14 +154,52 @@ namespace ZmqMessage
       return receive_observer_;
     }
 
+    /**
+     * Receive first part of message with SpinWait:
+     * spin before blocking on idle socket
+     * (not used if receiving from transport).
+     * Note, that the Incoming does not take ownership on the given object.
+     * @param spin_wait 0 to receive with blocking recv
+     */
+    inline
+    void
+    set_spin_wait(SpinWait* spin_wait)
+    {
+      spin_wait_ = spin_wait;
+    }
+
+    /**
+     * @return SpinWait previously set with set_spin_wait
+     * or 0 if it's not set.
+     */
+    inline
+    SpinWait*
+    spin_wait()
+    {
+      return spin_wait_;
+    }
+
     /**
      * @return zmq socket to receive message parts from
+     *  (transport must have it if Incoming is created with one)
      */
     inline
     zmq::socket_t&
     src()
     {
-      return src_;
+      assert(src_);
+      return *src_;
+    }
+
+    /**
+     * @return transport to receive message parts from,
+     *  0 if zmq socket is used directly
+     */
+    inline
+    Transport*
+    transport()
+    {
+      return transport_;
     }
 
     /**
@@ -271,6 +353,37 @@ namespace ZmqMessage
     receive_up_to(size_t min_parts, const char* part_names[],
       size_t max_parts) throw (MessageFormatError, ZmqErrorType);
 
+    /**
+     * Wait for message up to @c timeout, then receive it as receive().
+     * Message is never left half-read on socket: if it has wrong
+     * number of parts, the rest of it is dropped
+     * before MessageFormatError is thrown.
+     * @param timeout microseconds as in zmq_poll, -1 means infinite,
+     * see Deadline::remaining()
+     * @return false if no message came in time (nothing is received)
+     */
+    bool
+    try_receive(long timeout, size_t parts, bool check_terminal)
+      throw (MessageFormatError, ZmqErrorType);
+
+    /**
+     * Wait for message up to @c timeout, then receive it as receive_all().
+     * @return false if no message came in time (nothing is received)
+     */
+    bool
+    try_receive_all(long timeout, size_t min_parts = 0)
+      throw (MessageFormatError, ZmqErrorType);
+
+    /**
+     * Wait for message up to @c timeout,
+     * then receive it as receive_up_to().
+     * @return false if no message came in time (nothing is received)
+     */
+    bool
+    try_receive_up_to(long timeout, size_t min_parts,
+      const char* part_names[], size_t max_parts)
+      throw (MessageFormatError, ZmqErrorType);
+
     /**
      * Fetch all messages starting from tail message
      * until there will be no more parts on socket.
@@ -292,6 +405,18 @@ namespace ZmqMessage
     int
     drop_tail() throw(ZmqErrorType);
 
+    /**
+     * Write parts received (starting from @c idx_from)
+     * to file descriptor with writev(2), then receive and write
+     * parts not received yet, in batches: they are not stored,
+     * so message of any size passes through memory once.
+     * Parts are written as received (not decoded by codec).
+     * Incoming becomes terminal.
+     * @return number of bytes written
+     */
+    uint64_t
+    write_to(int fd, size_t idx_from = 0) throw(ZmqErrorType);
+
     /**
      * After we have received message parts, we can extract
      * message parts content into variables, one by one.
@@ -309,6 +434,16 @@ namespace ZmqMessage
     SelfType&
     operator>> (zmq::message_t& msg) throw(NoSuchPartError);
 
+    /**
+     * Extract object passed with @c Handoff
+     * @throw MessageFormatError if part is not a handoff of T
+     *  passed in this process
+     */
+    template <typename T>
+    SelfType&
+    operator>> (const Handoff<T>& h)
+      throw(NoSuchPartError, MessageFormatError);
+
     /**
      * Handle a manipulator
      */
@@ -340,6 +475,29 @@ namespace ZmqMessage
     {
       binary_mode_ = false;
     }
+
+    /**
+     * Set packed mode: if message body (after routing) consists of
+     * one packed frame (sent by Sink with OutOptions::PACKED),
+     * it's unpacked into logical parts, accessible just like
+     * normal message parts. Other messages are received as usual.
+     * Must be set before receiving.
+     * See \ref zm_packed "packed mode"
+     */
+    void
+    set_packed(bool packed)
+    {
+      packed_ = packed;
+    }
+
+    /**
+     * @return if packed mode is set
+     */
+    bool
+    is_packed() const
+    {
+      return packed_;
+    }
   };
 
 }
@@ -0,0 +1,240 @@
+/**
+ * @file LocalChannel.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_LOCALCHANNEL_HPP_
+#define ZMQMESSAGE_LOCALCHANNEL_HPP_
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/Part.hpp>
+#include <zmqmessage/PartsStorage.hpp>
+#include <zmqmessage/MultipartContainer.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief In-process channel passing detached multipart messages
+   * without zmq.
+   *
+   * Messages are heap-allocated Multipart objects
+   * (LocalChannel::Message, detached Incoming or Sink queue),
+   * channel is a bounded lock-free ring of pointers to them,
+   * so sending is a pointer move: parts are not copied or re-initialized.
+   * Any number of threads may send, one thread receives.
+   *
+   * Receiver is woken up with eventfd(2) descriptor fd(),
+   * which is readable while channel may have messages.
+   * It can be polled along with zmq sockets:
+   * @code
+   * zmq::pollitem_t items[] = {
+   *   {sock, 0, ZMQ_POLLIN, 0},
+   *   {0, channel.fd(), ZMQ_POLLIN, 0}
+   * };
+   * zmq::poll(items, 2, -1);
+   * while (ZmqMessage::Multipart* mp = channel.receive())
+   * {
+   *   std::auto_ptr<ZmqMessage::Multipart> msg(mp);
+   *   ...
+   * }
+   * @endcode
+   * Descriptor is signaled only when receiver has found channel empty
+   * (receive() returned 0), so busy receiver causes no system calls.
+   * Likewise senders may sleep in wait_writable() while channel is full,
+   * receiver signals them (with another eventfd) only if they do.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC LocalChannel : private Private::NonCopyable
+  {
+  public:
+    /**
+     * Multipart message built for sending to channel
+     */
+    class ZMQMESSAGE_DLL_PUBLIC Message :
+      public Private::MultipartContainer<DynamicPartsStorage<> >
+    {
+    public:
+      explicit
+      Message(size_t capacity = DynamicPartsStorage<>::default_capacity);
+
+      /**
+       * @return new empty part appended
+       */
+      Part&
+      add();
+
+      /**
+       * Append part, its message is moved
+       */
+      void
+      add(Part& part);
+
+      /**
+       * Append part with copy of data
+       */
+      void
+      add(const void* data, size_t sz) throw(ZmqErrorType);
+    };
+
+    struct Stats
+    {
+      uint64_t received; //!< messages received
+      uint64_t rejected; //!< messages not sent because channel was full
+      uint64_t wakeups; //!< descriptor signals
+
+      Stats();
+    };
+
+    static const size_t DEFAULT_CAPACITY = 1024;
+
+    /**
+     * @param capacity max messages in channel (rounded up to power of 2)
+     */
+    explicit
+    LocalChannel(size_t capacity = DEFAULT_CAPACITY) throw(ZmqErrorType);
+
+    /**
+     * Deletes messages not received
+     */
+    ~LocalChannel();
+
+    /**
+     * Send message. May be called from many threads.
+     * @param multipart released if sent
+     * @return false if channel is full (message is left with caller)
+     */
+    bool
+    send(std::auto_ptr<Multipart>& multipart) throw(ZmqErrorType);
+
+    /**
+     * Receive message. Must be called from one thread.
+     * @return message (owned by caller) or 0 if channel is empty,
+     *  then fd() is signaled when message is sent
+     */
+    Multipart*
+    receive() throw(ZmqErrorType);
+
+    /**
+     * Wait up to @c timeout (microseconds as in zmq_poll,
+     * -1 means infinite) for channel to have messages.
+     * @return false on timeout
+     */
+    bool
+    wait(long timeout) throw(ZmqErrorType);
+
+    /**
+     * Wait up to @c timeout (as in wait()) for channel to have room
+     * for a message. May be called from many threads.
+     * @return false on timeout
+     */
+    bool
+    wait_writable(long timeout) throw(ZmqErrorType);
+
+    /**
+     * @return eventfd descriptor, readable when channel may have messages
+     */
+    inline
+    int
+    fd() const
+    {
+      return fd_;
+    }
+
+    /**
+     * @return number of messages in channel (approximate while sending)
+     */
+    size_t
+    size() const;
+
+    inline
+    size_t
+    capacity() const
+    {
+      return cells_.size();
+    }
+
+    /**
+     * Counters, @c received is updated by receiving thread only
+     */
+    inline
+    const Stats&
+    stats() const
+    {
+      return stats_;
+    }
+
+  private:
+    /**
+     * Cell of ring: @c seq equal to position means cell is free
+     * for sending at it, position + 1 means message is published
+     */
+    struct Cell
+    {
+      volatile size_t seq;
+      Multipart* msg;
+    };
+
+    std::vector<Cell> cells_;
+
+    const size_t mask_;
+
+    volatile size_t send_pos_;
+
+    volatile size_t receive_pos_;
+
+    volatile int waiting_; //!< receiver found channel empty
+
+    volatile int senders_waiting_; //!< senders found channel full
+
+    int fd_;
+
+    int space_fd_; //!< semaphore eventfd, signaled for waiting senders
+
+    Stats stats_;
+
+    ZMQMESSAGE_DLL_LOCAL
+    static
+    size_t
+    round_capacity(size_t capacity);
+
+    /**
+     * @return true if message at receive position is published
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    bool
+    ready() const;
+
+    ZMQMESSAGE_DLL_LOCAL
+    Multipart*
+    pop();
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    signal() throw(ZmqErrorType);
+
+    /**
+     * Wake up one sender waiting for room
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    signal_space();
+
+    /**
+     * Reset descriptor and ask senders to signal it
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    arm();
+  };
+}
+
+#endif /* ZMQMESSAGE_LOCALCHANNEL_HPP_ */
@@ -0,0 +1,290 @@
+/**
+ * @file LocalChannelFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of LocalChannel methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_LOCALCHANNELFULLIMPL_HPP_
+#define ZMQMESSAGE_LOCALCHANNELFULLIMPL_HPP_
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace ZmqMessage
+{
+  LocalChannel::Message::Message(size_t capacity) :
+    Private::MultipartContainer<DynamicPartsStorage<> >(capacity)
+  {}
+
+  Part&
+  LocalChannel::Message::add()
+  {
+    return *next();
+  }
+
+  void
+  LocalChannel::Message::add(Part& part)
+  {
+    next()->move(part);
+  }
+
+  void
+  LocalChannel::Message::add(const void* data, size_t sz)
+    throw(ZmqErrorType)
+  {
+    Part part(sz);
+    if (sz)
+    {
+      ::memcpy(part.msg().data(), data, sz);
+    }
+    add(part);
+  }
+
+  LocalChannel::Stats::Stats() :
+    received(0), rejected(0), wakeups(0)
+  {}
+
+  size_t
+  LocalChannel::round_capacity(size_t capacity)
+  {
+    size_t rounded = 2;
+    while (rounded < capacity)
+    {
+      rounded *= 2;
+    }
+    return rounded;
+  }
+
+  LocalChannel::LocalChannel(size_t capacity) throw(ZmqErrorType) :
+    cells_(round_capacity(capacity)), mask_(cells_.size() - 1),
+    send_pos_(0), receive_pos_(0), waiting_(0), senders_waiting_(0),
+    fd_(::eventfd(0, EFD_NONBLOCK)),
+    space_fd_(::eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE))
+  {
+    if (fd_ < 0 || space_fd_ < 0)
+    {
+      const zmq::error_t e;
+      if (fd_ >= 0)
+      {
+        ::close(fd_);
+      }
+      throw_zmq_exception(e);
+    }
+    for (size_t i = 0; i < cells_.size(); ++i)
+    {
+      cells_[i].seq = i;
+      cells_[i].msg = 0;
+    }
+  }
+
+  LocalChannel::~LocalChannel()
+  {
+    while (Multipart* msg = pop())
+    {
+      delete msg;
+    }
+    ::close(fd_);
+    ::close(space_fd_);
+  }
+
+  bool
+  LocalChannel::send(std::auto_ptr<Multipart>& multipart)
+    throw(ZmqErrorType)
+  {
+    size_t pos = send_pos_;
+    Cell* cell;
+    for (;;)
+    {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->seq;
+      __sync_synchronize();
+      const intptr_t diff =
+        static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (!diff)
+      {
+        if (__sync_bool_compare_and_swap(&send_pos_, pos, pos + 1))
+        {
+          break;
+        }
+        pos = send_pos_;
+      }
+      else if (diff < 0)
+      {
+        __sync_fetch_and_add(&stats_.rejected, 1);
+        return false;
+      }
+      else
+      {
+        pos = send_pos_;
+      }
+    }
+
+    cell->msg = multipart.release();
+    __sync_synchronize();
+    cell->seq = pos + 1;
+
+    //receiver checks the ring after setting the flag,
+    //so either it finds the message or we see the flag
+    __sync_synchronize();
+    if (waiting_ && __sync_bool_compare_and_swap(&waiting_, 1, 0))
+    {
+      signal();
+    }
+    return true;
+  }
+
+  bool
+  LocalChannel::ready() const
+  {
+    const size_t pos = receive_pos_;
+    return cells_[pos & mask_].seq == pos + 1;
+  }
+
+  Multipart*
+  LocalChannel::pop()
+  {
+    const size_t pos = receive_pos_;
+    Cell& cell = cells_[pos & mask_];
+    const size_t seq = cell.seq;
+    __sync_synchronize();
+    if (seq != pos + 1)
+    {
+      return 0;
+    }
+    Multipart* msg = cell.msg;
+    cell.msg = 0;
+    receive_pos_ = pos + 1;
+    __sync_synchronize();
+    cell.seq = pos + cells_.size();
+
+    //sender checks the ring after counting itself,
+    //so either it finds room or we see it waiting
+    __sync_synchronize();
+    if (senders_waiting_)
+    {
+      signal_space();
+    }
+    return msg;
+  }
+
+  Multipart*
+  LocalChannel::receive() throw(ZmqErrorType)
+  {
+    Multipart* msg = pop();
+    if (!msg)
+    {
+      arm();
+      msg = pop();
+    }
+    if (msg)
+    {
+      ++stats_.received;
+    }
+    return msg;
+  }
+
+  void
+  LocalChannel::signal() throw(ZmqErrorType)
+  {
+    __sync_fetch_and_add(&stats_.wakeups, 1);
+    const uint64_t one = 1;
+    if (::write(fd_, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+      throw_zmq_exception(zmq::error_t());
+    }
+  }
+
+  void
+  LocalChannel::signal_space()
+  {
+    const uint64_t one = 1;
+    //counter overflow (EAGAIN) is impossible: one token per message
+    const ssize_t rc = ::write(space_fd_, &one, sizeof(one));
+    (void)rc;
+  }
+
+  void
+  LocalChannel::arm()
+  {
+    uint64_t count;
+    //nothing to read (EAGAIN) is fine: descriptor is not signaled
+    const ssize_t rc = ::read(fd_, &count, sizeof(count));
+    (void)rc;
+    waiting_ = 1;
+    __sync_synchronize();
+  }
+
+  bool
+  LocalChannel::wait(long timeout) throw(ZmqErrorType)
+  {
+    if (ready())
+    {
+      return true;
+    }
+    arm();
+    if (ready())
+    {
+      return true;
+    }
+    zmq::pollitem_t item = {0, fd_, ZMQ_POLLIN, 0};
+    try
+    {
+      return zmq::poll(&item, 1, timeout) > 0;
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+    return false;
+  }
+
+  bool
+  LocalChannel::wait_writable(long timeout) throw(ZmqErrorType)
+  {
+    if (size() < capacity())
+    {
+      return true;
+    }
+    __sync_fetch_and_add(&senders_waiting_, 1);
+    __sync_synchronize();
+    bool writable = size() < capacity();
+    if (!writable)
+    {
+      zmq::pollitem_t item = {0, space_fd_, ZMQ_POLLIN, 0};
+      try
+      {
+        writable = zmq::poll(&item, 1, timeout) > 0;
+      }
+      catch (const zmq::error_t& e)
+      {
+        __sync_fetch_and_sub(&senders_waiting_, 1);
+        throw_zmq_exception(e);
+      }
+      if (writable)
+      {
+        uint64_t token;
+        //token may be taken by another sender (EAGAIN): retry anyway
+        const ssize_t rc = ::read(space_fd_, &token, sizeof(token));
+        (void)rc;
+      }
+    }
+    __sync_fetch_and_sub(&senders_waiting_, 1);
+    return writable;
+  }
+
+  size_t
+  LocalChannel::size() const
+  {
+    const size_t received = receive_pos_;
+    const size_t sent = send_pos_;
+    return sent - received;
+  }
+}
+
+#endif /* ZMQMESSAGE_LOCALCHANNELFULLIMPL_HPP_ */
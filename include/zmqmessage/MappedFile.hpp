@@ -0,0 +1,126 @@
+/**
+ * @file MappedFile.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_MAPPEDFILE_HPP_
+#define ZMQMESSAGE_MAPPEDFILE_HPP_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/RawMessage.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief File region mapped to memory to be sent without copying.
+   *
+   * Parts made by part() or append_to() point into the mapping,
+   * which is unmapped when the last of them (and this object)
+   * is released, so MappedFile may be destroyed right after sending:
+   * @code
+   * ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(sock, 0);
+   * out << "snapshot";
+   * ZmqMessage::MappedFile("/var/lib/model.bin").append_to(out);
+   * out << ZmqMessage::Flush;
+   * @endcode
+   * File must not be truncated while parts are alive
+   * (access to pages beyond the end raises SIGBUS).
+   */
+  class ZMQMESSAGE_DLL_PUBLIC MappedFile : private Private::NonCopyable
+  {
+  public:
+    static const size_t DEFAULT_CHUNK_SIZE = 16 * 1024 * 1024;
+
+    /**
+     * Map the whole file
+     */
+    explicit
+    MappedFile(const char* path) throw(ZmqErrorType);
+
+    /**
+     * Map region of open file (descriptor may be closed afterwards)
+     */
+    MappedFile(int fd, off_t offset, size_t size) throw(ZmqErrorType);
+
+    ~MappedFile();
+
+    inline
+    const char*
+    data() const
+    {
+      return data_;
+    }
+
+    inline
+    size_t
+    size() const
+    {
+      return size_;
+    }
+
+    /**
+     * @return number of parts of @c chunk_size (the last may be shorter)
+     *  the region is split to, 0 for empty region
+     */
+    size_t
+    chunks(size_t chunk_size = DEFAULT_CHUNK_SIZE) const;
+
+    /**
+     * Zero-copy part of region, keeps mapping alive.
+     * It must be inserted to Sink (else mapping is never released).
+     */
+    RawMessage
+    part(size_t offset, size_t size);
+
+    /**
+     * Insert region into sink as chunks() parts
+     * @return number of parts inserted
+     */
+    size_t
+    append_to(Sink& out, size_t chunk_size = DEFAULT_CHUNK_SIZE)
+      throw(ZmqErrorType);
+
+  private:
+    struct Region
+    {
+      void* base;
+      size_t len;
+      volatile int refs;
+    };
+
+    Region* region_; //!< 0 for empty region
+
+    const char* data_;
+
+    size_t size_;
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    map(int fd, off_t offset, size_t size) throw(ZmqErrorType);
+
+    ZMQMESSAGE_DLL_LOCAL
+    static
+    void
+    release(void* data, void* hint);
+  };
+
+  /**
+   * Write content of parts to file descriptor with writev(2)
+   * (repeated on partial writes and EINTR).
+   * @return number of bytes written
+   */
+  ZMQMESSAGE_DLL_PUBLIC
+  uint64_t
+  write_parts(int fd, Part* parts, size_t num) throw(ZmqErrorType);
+}
+
+#endif /* ZMQMESSAGE_MAPPEDFILE_HPP_ */
@@ -0,0 +1,182 @@
+/**
+ * @file MappedFileFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of MappedFile methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_MAPPEDFILEFULLIMPL_HPP_
+#define ZMQMESSAGE_MAPPEDFILEFULLIMPL_HPP_
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <algorithm>
+
+namespace ZmqMessage
+{
+  MappedFile::MappedFile(const char* path) throw(ZmqErrorType) :
+    region_(0), data_(0), size_(0)
+  {
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+    {
+      throw_zmq_exception(zmq::error_t());
+    }
+    struct stat st;
+    if (::fstat(fd, &st) < 0)
+    {
+      const zmq::error_t e;
+      ::close(fd);
+      throw_zmq_exception(e);
+    }
+    try
+    {
+      map(fd, 0, st.st_size);
+    }
+    catch (...)
+    {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+  }
+
+  MappedFile::MappedFile(int fd, off_t offset, size_t size)
+    throw(ZmqErrorType) :
+    region_(0), data_(0), size_(0)
+  {
+    map(fd, offset, size);
+  }
+
+  MappedFile::~MappedFile()
+  {
+    if (region_)
+    {
+      release(0, region_);
+    }
+  }
+
+  void
+  MappedFile::map(int fd, off_t offset, size_t size) throw(ZmqErrorType)
+  {
+    if (!size)
+    {
+      return;
+    }
+    //mapping starts at page boundary
+    const off_t page = ::sysconf(_SC_PAGESIZE);
+    const off_t delta = offset % page;
+    const size_t len = size + delta;
+    void* base = ::mmap(0, len, PROT_READ, MAP_SHARED, fd, offset - delta);
+    if (base == MAP_FAILED)
+    {
+      throw_zmq_exception(zmq::error_t());
+    }
+    ::madvise(base, len, MADV_SEQUENTIAL);
+
+    region_ = new Region;
+    region_->base = base;
+    region_->len = len;
+    region_->refs = 1;
+    data_ = static_cast<const char*>(base) + delta;
+    size_ = size;
+  }
+
+  void
+  MappedFile::release(void* data, void* hint)
+  {
+    Region* region = static_cast<Region*>(hint);
+    if (__sync_sub_and_fetch(&region->refs, 1) == 0)
+    {
+      ::munmap(region->base, region->len);
+      delete region;
+    }
+  }
+
+  size_t
+  MappedFile::chunks(size_t chunk_size) const
+  {
+    chunk_size = std::max(chunk_size, static_cast<size_t>(1));
+    return (size_ + chunk_size - 1) / chunk_size;
+  }
+
+  RawMessage
+  MappedFile::part(size_t offset, size_t size)
+  {
+    assert(offset + size <= size_);
+    if (!region_ || !size)
+    {
+      return RawMessage(static_cast<const void*>(data_), 0);
+    }
+    __sync_add_and_fetch(&region_->refs, 1);
+    return RawMessage(const_cast<char*>(data_) + offset, size,
+      &MappedFile::release, region_);
+  }
+
+  size_t
+  MappedFile::append_to(Sink& out, size_t chunk_size) throw(ZmqErrorType)
+  {
+    chunk_size = std::max(chunk_size, static_cast<size_t>(1));
+    const size_t num = chunks(chunk_size);
+    for (size_t i = 0; i < num; ++i)
+    {
+      const size_t offset = i * chunk_size;
+      out << part(offset, std::min(chunk_size, size_ - offset));
+    }
+    return num;
+  }
+
+  uint64_t
+  write_parts(int fd, Part* parts, size_t num) throw(ZmqErrorType)
+  {
+    static const size_t BATCH = 64;
+    iovec iov[BATCH];
+    uint64_t written = 0;
+    for (size_t from = 0; from < num; )
+    {
+      size_t n = 0;
+      for (; n < BATCH && from + n < num; ++n)
+      {
+        zmq::message_t& msg = parts[from + n].msg();
+        iov[n].iov_base = msg.data();
+        iov[n].iov_len = msg.size();
+      }
+      from += n;
+
+      for (iovec* cur = iov; n; )
+      {
+        const ssize_t rc = ::writev(fd, cur, n);
+        if (rc < 0)
+        {
+          if (errno == EINTR)
+          {
+            continue;
+          }
+          throw_zmq_exception(zmq::error_t());
+        }
+        written += rc;
+        //skip parts written, then the written head of partial one
+        size_t left = rc;
+        for (; n && left >= cur->iov_len; ++cur, --n)
+        {
+          left -= cur->iov_len;
+        }
+        if (n)
+        {
+          cur->iov_base = static_cast<char*>(cur->iov_base) + left;
+          cur->iov_len -= left;
+        }
+      }
+    }
+    return written;
+  }
+}
+
+#endif /* ZMQMESSAGE_MAPPEDFILEFULLIMPL_HPP_ */
@@ -0,0 +1,115 @@
+/**
+ * @file MessageBuilder.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_MESSAGEBUILDER_HPP_
+#define ZMQMESSAGE_MESSAGEBUILDER_HPP_
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/PartAllocator.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Composes all parts of outgoing message in one memory arena.
+   *
+   * Part buffers are consecutive slices of reference-counted arena,
+   * every slice holds a reference which is released by zmq deleter
+   * (from any thread), the last one frees the arena.
+   * So payloads of K parts take one arena allocation instead of K.
+   * Moreover, when all slices of current arena are released
+   * (previous message is already sent and consumed),
+   * the arena is rewound and reused without allocating payloads at all.
+   * Note, that zmq still allocates small content descriptor
+   * for every part (see BufferPool), only payload allocations are saved.
+   *
+   * Builder is to be used by one thread at a time.
+   * Set it to Sink as PartAllocator, so all inserted values
+   * are serialized into arena:
+   * @code
+   * ZmqMessage::MessageBuilder builder;
+   * for (;;)
+   * {
+   *   ZmqMessage::Outgoing<ZmqMessage::XRouting> out(
+   *     ZmqMessage::OutOptions(sock, 0, 0, &builder));
+   *   out << id << payload << ZmqMessage::Binary << num << ZmqMessage::Flush;
+   * }
+   * @endcode
+   * Parts larger than arena are placed in dedicated arena of their own.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC MessageBuilder :
+    public PartAllocator, private Private::NonCopyable
+  {
+  public:
+    static const size_t DEFAULT_ARENA_SIZE = 4096;
+
+    /**
+     * @param arena_size capacity of arena
+     */
+    explicit
+    MessageBuilder(size_t arena_size = DEFAULT_ARENA_SIZE);
+
+    /**
+     * Releases builder's reference on current arena
+     * (slices of it remain valid until released by zmq).
+     */
+    virtual
+    ~MessageBuilder();
+
+    /**
+     * Finish current arena: next part will be placed in a new
+     * (or rewound) arena. Not needed normally, but may be used
+     * to unpin memory held by long-living parts.
+     */
+    void
+    reset();
+
+    /**
+     * @return number of arenas allocated so far
+     */
+    inline
+    size_t
+    arenas_allocated() const
+    {
+      return arenas_allocated_;
+    }
+
+  protected:
+    virtual
+    void*
+    do_init(zmq::message_t& msg, size_t sz) throw(ZmqErrorType);
+
+  private:
+    /**
+     * Arena header, data follows it.
+     */
+    struct Arena
+    {
+      volatile size_t refs;
+      size_t capacity;
+      size_t used;
+    };
+
+    const size_t arena_size_;
+
+    Arena* arena_;
+
+    size_t arenas_allocated_;
+
+    ZMQMESSAGE_DLL_LOCAL
+    Arena*
+    new_arena(size_t capacity);
+
+    ZMQMESSAGE_DLL_LOCAL
+    static
+    void
+    release(void* data, void* hint);
+  };
+}
+
+#endif /* ZMQMESSAGE_MESSAGEBUILDER_HPP_ */
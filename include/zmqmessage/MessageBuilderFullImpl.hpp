@@ -0,0 +1,100 @@
+/**
+ * @file MessageBuilderFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of MessageBuilder methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_MESSAGEBUILDERFULLIMPL_HPP_
+#define ZMQMESSAGE_MESSAGEBUILDERFULLIMPL_HPP_
+
+#include <cstdlib>
+#include <new>
+
+namespace ZmqMessage
+{
+  MessageBuilder::MessageBuilder(size_t arena_size) :
+    arena_size_(arena_size), arena_(0), arenas_allocated_(0)
+  {}
+
+  MessageBuilder::~MessageBuilder()
+  {
+    reset();
+  }
+
+  void
+  MessageBuilder::reset()
+  {
+    if (arena_)
+    {
+      release(0, arena_);
+      arena_ = 0;
+    }
+  }
+
+  MessageBuilder::Arena*
+  MessageBuilder::new_arena(size_t capacity)
+  {
+    Arena* arena = static_cast<Arena*>(::malloc(sizeof(Arena) + capacity));
+    if (!arena)
+    {
+      throw std::bad_alloc();
+    }
+    arena->refs = 1;
+    arena->capacity = capacity;
+    arena->used = 0;
+    ++arenas_allocated_;
+    return arena;
+  }
+
+  void
+  MessageBuilder::release(void* data, void* hint)
+  {
+    Arena* arena = static_cast<Arena*>(hint);
+    if (__sync_sub_and_fetch(&arena->refs, 1) == 0)
+    {
+      ::free(arena);
+    }
+  }
+
+  void*
+  MessageBuilder::do_init(zmq::message_t& msg, size_t sz) throw(ZmqErrorType)
+  {
+    //keep slices aligned
+    const size_t slice = (sz + 7) & ~size_t(7);
+
+    if (arena_ && arena_->used &&
+      __sync_add_and_fetch(&arena_->refs, 0) == 1)
+    {
+      //all slices are released, only we hold it
+      arena_->used = 0;
+    }
+    if (arena_ && arena_->used + slice > arena_->capacity)
+    {
+      reset();
+    }
+    if (!arena_)
+    {
+      arena_ = new_arena(std::max(arena_size_, slice));
+    }
+
+    char* data = reinterpret_cast<char*>(arena_ + 1) + arena_->used;
+    __sync_add_and_fetch(&arena_->refs, 1);
+    try
+    {
+      msg.rebuild(data, sz, &MessageBuilder::release, arena_);
+    }
+    catch (const zmq::error_t& e)
+    {
+      release(0, arena_);
+      throw_zmq_exception(e);
+    }
+    arena_->used += slice;
+    return data;
+  }
+}
+
+#endif /* ZMQMESSAGE_MESSAGEBUILDERFULLIMPL_HPP_ */
@@ -11,10 +11,16 @@
 
 #include <zmqmessage/NonCopyable.hpp>
 #include <zmqmessage/Part.hpp>
+#include <zmqmessage/AllocStats.hpp>
 #include <memory>
 
 namespace ZmqMessage
 {
+  namespace Private
+  {
+    class Destination;
+  }
+
   /**
    * @brief Basic interface to message parts.
    *
@@ -26,13 +32,20 @@ namespace ZmqMessage
   private:
     Part** parts_ptr_; //!< non-null
     size_t* size_ptr_; //!< non-null
+    PartCodec* codec_; //!< decodes parts on access if not null
 
   protected:
     void
     check_has_part(size_t n) const throw(NoSuchPartError);
 
+    /**
+     * Decode part (once) if codec is set
+     */
+    void
+    decode_part(Part& part) const;
+
     Multipart(Part** parts_ptr, size_t* size_ptr) :
-      parts_ptr_(parts_ptr), size_ptr_(size_ptr)
+      parts_ptr_(parts_ptr), size_ptr_(size_ptr), codec_(0)
     {
       assert(parts_ptr_);
       assert(size_ptr_);
@@ -49,6 +62,8 @@ namespace ZmqMessage
 
     friend class Sink;
 
+    friend class Private::Destination; //forwards parts as received
+
     friend void
     send(zmq::socket_t&, Multipart&, bool, SendObserver*)
     throw(ZmqErrorType);
@@ -64,6 +79,28 @@ namespace ZmqMessage
       return *size_ptr_;
     }
 
+    /**
+     * Set codec to decompress parts encoded by sender's codec.
+     * Part is decoded in place on first access by index,
+     * extraction or iteration, parts never accessed are not decoded
+     * (released parts are returned as is).
+     * Codec is not owned by Multipart. Pass 0 to disable decoding.
+     * See \ref zm_codec "compression"
+     */
+    inline
+    void
+    set_codec(PartCodec* codec)
+    {
+      codec_ = codec;
+    }
+
+    inline
+    PartCodec*
+    codec() const
+    {
+      return codec_;
+    }
+
     /**
      * Get reference to Part by index
      */
@@ -275,6 +312,7 @@ namespace ZmqMessage
     release_ptr(size_t i)
     {
       Part part = release(i);
+      ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_PARTS_STORAGE);
       std::auto_ptr<zmq::message_t> ptr(new zmq::message_t());
       ptr->move(&(part.msg()));
       return ptr;
@@ -286,6 +324,7 @@ namespace ZmqMessage
     release_uptr(size_t i)
     {
       Part part = release(i);
+      ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_PARTS_STORAGE);
       std::unique_ptr<zmq::message_t> ptr(new zmq::message_t());
       ptr->move(&(part.msg()));
       return std::move(ptr);
@@ -50,6 +50,13 @@ namespace ZmqMessage
      */
     static const unsigned BINARY_MODE = 0x20;
 
+    /**
+     * Pack all message parts (except routing) into one zmq frame,
+     * sent on flush. Receiver must be Incoming with packed mode set.
+     * See \ref zm_packed "packed mode"
+     */
+    static const unsigned PACKED = 0x40;
+
     zmq::socket_t& sock;
     unsigned options;
 
@@ -57,14 +64,22 @@ namespace ZmqMessage
 
     SendObserverPtr send_observer;
 
+    /**
+     * Allocator of payload buffers for inserted parts
+     * (see Sink::set_part_allocator).
+     */
+    PartAllocator* part_allocator;
+
     /**
      * Create OutOptions.
-     * Note, that OutOptions doesn't take ownership on SendObserver.
+     * Note, that OutOptions doesn't take ownership
+     * on SendObserver and PartAllocator.
      */
     inline
     OutOptions(
-      zmq::socket_t& sock_p, unsigned options_p, SendObserverPtr so = 0) :
-      sock(sock_p), options(options_p), send_observer(so)
+      zmq::socket_t& sock_p, unsigned options_p, SendObserverPtr so = 0,
+      PartAllocator* pa = 0) :
+      sock(sock_p), options(options_p), send_observer(so), part_allocator(pa)
     {}
   };
 }
@@ -13,6 +13,27 @@
 
 namespace ZmqMessage
 {
+  namespace Private
+  {
+    /**
+     * Route Outgoing may be created with (see RouteHandle):
+     * routing is kept for X sockets only, so Outgoing<SimpleRouting>
+     * created with route does not compile.
+     */
+    template <class RoutingPolicy>
+    struct RouteOf
+    {
+      struct None;
+      typedef None type;
+    };
+
+    template <>
+    struct RouteOf<XRouting>
+    {
+      typedef RouteHandle type;
+    };
+  }
+
   /**
    * @brief Represents outgoing message to be sent.
    *
@@ -37,6 +58,10 @@ namespace ZmqMessage
     void
     send_routing(Part* routing, size_t num) throw(ZmqErrorType);
 
+    void
+    send_route(const typename Private::RouteOf<RoutingPolicy>::type& route)
+      throw(ZmqErrorType);
+
   public:
 
     using Sink::iterator;
@@ -52,9 +77,19 @@ namespace ZmqMessage
       send_routing(0, 0);
     }
 
+    /**
+     * Message is sent to transport instead of zmq socket
+     */
+    Outgoing(Transport& dst, unsigned options) :
+      Sink(dst, options)
+    {
+      send_routing(0, 0);
+    }
+
     explicit
     Outgoing(OutOptions out_opts) :
-      Sink(out_opts.sock, out_opts.options, out_opts.send_observer)
+      Sink(out_opts.sock, out_opts.options, out_opts.send_observer, 0,
+        out_opts.part_allocator)
     {
       send_routing(0, 0);
     }
@@ -72,6 +107,19 @@ namespace ZmqMessage
       send_routing(incoming.get_routing(), incoming.get_routing_num());
     }
 
+    /**
+     * Outgoing message (sent to transport) is a response
+     * to the given Incoming message, so we resend Incoming's routing first.
+     */
+    template <typename InRoutingPolicy, typename InPartsStorage>
+    Outgoing(Transport& dst,
+      Incoming<InRoutingPolicy, InPartsStorage>& incoming,
+      unsigned options) throw(ZmqErrorType) :
+      Sink(dst, options, 0, &incoming)
+    {
+      send_routing(incoming.get_routing(), incoming.get_routing_num());
+    }
+
     /**
      * Outgoing message is a response to the given Incoming message,
      * so we resend Incoming's routing first.
@@ -80,11 +128,26 @@ namespace ZmqMessage
     Outgoing(OutOptions out_opts,
       Incoming<InRoutingPolicy, InPartsStorage>& incoming)
       throw(ZmqErrorType) :
-      Sink(out_opts.sock, out_opts.options, out_opts.send_observer, &incoming)
+      Sink(out_opts.sock, out_opts.options, out_opts.send_observer,
+        &incoming, out_opts.part_allocator)
     {
       send_routing(incoming.get_routing(), incoming.get_routing_num());
     }
 
+    /**
+     * Outgoing message is a response to the message
+     * whose routing is kept in the handle (see RouteHandle),
+     * so it may be sent after that Incoming is destroyed.
+     * Routing is copied, the handle stays valid.
+     */
+    Outgoing(zmq::socket_t& dst,
+      const typename Private::RouteOf<RoutingPolicy>::type& route,
+      unsigned options) throw(ZmqErrorType) :
+      Sink(dst, options)
+    {
+      send_route(route);
+    }
+
     /**
      * Outgoing message is NOT a response to the given Incoming message,
      * so we send normal routing.
@@ -101,11 +164,41 @@ namespace ZmqMessage
      * so we send normal routing.
      */
     Outgoing(OutOptions out_opts, Multipart& incoming) throw(ZmqErrorType) :
-      Sink(out_opts.sock, out_opts.options, out_opts.send_observer, &incoming)
+      Sink(out_opts.sock, out_opts.options, out_opts.send_observer,
+        &incoming, out_opts.part_allocator)
     {
       send_routing(0, 0);
     }
   };
+
+  /**
+   * Content-based routing: receive @c header_parts parts into
+   * @c incoming, let @c router choose destination by them,
+   * then send the whole message (routing of incoming, header parts
+   * and the tail not received yet) to it with Outgoing<OutRoutingPolicy>.
+   * Parts are not copied and the tail is not stored
+   * (see Sink::splice_from).
+   * If router returns 0, the message is dropped.
+   * @code
+   * zmq::socket_t* choose(ZmqMessage::Incoming<ZmqMessage::XRouting>& in)
+   * {
+   *   return ZmqMessage::get_string<std::string>(in[0]) == "int" ? &ints : &strings;
+   * }
+   * ...
+   * ZmqMessage::Incoming<ZmqMessage::XRouting> incoming(front);
+   * ZmqMessage::route<ZmqMessage::XRouting>(incoming, 1, choose);
+   * @endcode
+   * @tparam Router functor or function: zmq::socket_t* (Incoming&),
+   *  parts may be extracted from incoming with operator>>
+   * @param options options of Outgoing
+   * @return destination chosen, 0 if message is dropped
+   */
+  template <class OutRoutingPolicy, class RoutingPolicy,
+    class PartsStorage, class Router>
+  zmq::socket_t*
+  route(Incoming<RoutingPolicy, PartsStorage>& incoming,
+    size_t header_parts, Router router, unsigned options = 0)
+    throw (ZmqErrorType, MessageFormatError);
 }
 
 #endif /* ZMQMESSAGE_OUTGOING_HPP_ */
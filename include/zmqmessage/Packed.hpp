@@ -0,0 +1,71 @@
+/**
+ * @file Packed.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Packed encoding: many logical message parts in one zmq frame.
+ * See \ref zm_packed "packed mode".
+ */
+
+#ifndef ZMQMESSAGE_PACKED_HPP_
+#define ZMQMESSAGE_PACKED_HPP_
+
+#include <vector>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/Part.hpp>
+
+namespace ZmqMessage
+{
+  namespace Private
+  {
+    /**
+     * Packed frame starts with this marker.
+     * First byte is never met in UTF-8 text.
+     */
+    const char PACKED_MAGIC[] = {'\xf5', 'Z', 'M', 'P'};
+    const size_t PACKED_MAGIC_LEN = sizeof(PACKED_MAGIC);
+    const char PACKED_VERSION = 1;
+
+    /**
+     * Append logical part (length-prefixed) to packed area.
+     */
+    ZMQMESSAGE_DLL_PUBLIC
+    void
+    pack_append(std::vector<char>& area, const void* data, size_t sz);
+
+    /**
+     * Compose packed frame from area filled by pack_append.
+     * @param count number of logical parts in area (> 0)
+     * @param alloc if not null, frame buffer is taken from it
+     */
+    ZMQMESSAGE_DLL_PUBLIC
+    void
+    pack_frame(const std::vector<char>& area, size_t count,
+      zmq::message_t& frame, PartAllocator* alloc) throw(ZmqErrorType);
+
+    /**
+     * @return number of logical parts in frame,
+     *  0 if frame is not a (well-formed) packed frame
+     */
+    ZMQMESSAGE_DLL_PUBLIC
+    size_t
+    packed_count(zmq::message_t& frame);
+
+    /**
+     * Unpack logical parts of frame into @c parts.
+     * Frame content is taken from @c frame (it becomes invalid),
+     * and shared by parts without copying:
+     * frame is released when the last of them is closed.
+     * Parts not larger than \ref ZMQMESSAGE_POOL_MIN_PART_SIZE
+     * are copied into zmq message itself, that's cheaper than sharing.
+     * @param count as returned by packed_count
+     */
+    ZMQMESSAGE_DLL_PUBLIC
+    void
+    unpack(Part& frame, Part* parts, size_t count) throw(ZmqErrorType);
+  }
+}
+
+#endif /* ZMQMESSAGE_PACKED_HPP_ */
@@ -0,0 +1,261 @@
+/**
+ * @file PackedFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of packed encoding functions.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ *
+ * Frame layout:
+ * @code
+ * magic(4) version(1) count(varint) { length(varint) bytes }...
+ * @endcode
+ * varint is 7 bits per byte, least significant first,
+ * high bit set on all bytes but the last.
+ */
+
+#ifndef ZMQMESSAGE_PACKEDFULLIMPL_HPP_
+#define ZMQMESSAGE_PACKEDFULLIMPL_HPP_
+
+#include <cstring>
+
+namespace ZmqMessage
+{
+  namespace Private
+  {
+    namespace
+    {
+      const size_t MAX_VARINT_LEN = 10;
+
+      size_t
+      put_varint(char* dst, size_t val)
+      {
+        size_t n = 0;
+        while (val >= 0x80)
+        {
+          dst[n++] = static_cast<char>((val & 0x7f) | 0x80);
+          val >>= 7;
+        }
+        dst[n++] = static_cast<char>(val);
+        return n;
+      }
+
+      /**
+       * @return false if input is exhausted or value is malformed
+       */
+      bool
+      get_varint(const unsigned char*& cur, const unsigned char* end,
+        size_t& val)
+      {
+        val = 0;
+        for (unsigned shift = 0; cur != end && shift < 64; shift += 7)
+        {
+          const unsigned char b = *cur++;
+          val |= static_cast<size_t>(b & 0x7f) << shift;
+          if (!(b & 0x80))
+          {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      /**
+       * Reads logical parts of packed frame one by one.
+       */
+      class PackedReader
+      {
+      private:
+        const unsigned char* cur_;
+        const unsigned char* end_;
+        size_t count_;
+
+      public:
+        explicit
+        PackedReader(zmq::message_t& frame) :
+          cur_(static_cast<const unsigned char*>(frame.data())),
+          end_(cur_ + frame.size()), count_(0)
+        {
+          if (frame.size() < PACKED_MAGIC_LEN + 2 ||
+            ::memcmp(cur_, PACKED_MAGIC, PACKED_MAGIC_LEN) ||
+            cur_[PACKED_MAGIC_LEN] != PACKED_VERSION)
+          {
+            cur_ = end_;
+            return;
+          }
+          cur_ += PACKED_MAGIC_LEN + 1;
+          if (!get_varint(cur_, end_, count_))
+          {
+            count_ = 0;
+          }
+        }
+
+        inline
+        size_t
+        count() const
+        {
+          return count_;
+        }
+
+        bool
+        next(const char*& data, size_t& sz)
+        {
+          if (!get_varint(cur_, end_, sz) ||
+            sz > static_cast<size_t>(end_ - cur_))
+          {
+            return false;
+          }
+          data = reinterpret_cast<const char*>(cur_);
+          cur_ += sz;
+          return true;
+        }
+
+        inline
+        bool
+        at_end() const
+        {
+          return cur_ == end_;
+        }
+      };
+
+      /**
+       * Frame shared by unpacked parts.
+       */
+      struct PackedHolder
+      {
+        volatile size_t refs;
+        Part frame;
+      };
+
+      void
+      release_packed(void* data, void* hint)
+      {
+        PackedHolder* holder = static_cast<PackedHolder*>(hint);
+        if (__sync_sub_and_fetch(&holder->refs, 1) == 0)
+        {
+          delete holder;
+        }
+      }
+    }
+
+    void
+    pack_append(std::vector<char>& area, const void* data, size_t sz)
+    {
+      const size_t pos = area.size();
+      area.resize(pos + MAX_VARINT_LEN + sz);
+      const size_t n = put_varint(&area[pos], sz);
+      if (sz)
+      {
+        ::memcpy(&area[pos + n], data, sz);
+      }
+      area.resize(pos + n + sz);
+    }
+
+    void
+    pack_frame(const std::vector<char>& area, size_t count,
+      zmq::message_t& frame, PartAllocator* alloc) throw(ZmqErrorType)
+    {
+      char header[PACKED_MAGIC_LEN + 1 + MAX_VARINT_LEN];
+      ::memcpy(header, PACKED_MAGIC, PACKED_MAGIC_LEN);
+      header[PACKED_MAGIC_LEN] = PACKED_VERSION;
+      const size_t header_len =
+        PACKED_MAGIC_LEN + 1 + put_varint(header + PACKED_MAGIC_LEN + 1, count);
+
+      const size_t sz = header_len + area.size();
+      char* dst = 0;
+      if (alloc)
+      {
+        dst = static_cast<char*>(alloc->init(frame, sz));
+      }
+      else
+      {
+        try
+        {
+          frame.rebuild(sz);
+        }
+        catch (const zmq::error_t& e)
+        {
+          throw_zmq_exception(e);
+        }
+        dst = static_cast<char*>(frame.data());
+      }
+      ::memcpy(dst, header, header_len);
+      if (!area.empty())
+      {
+        ::memcpy(dst + header_len, &area[0], area.size());
+      }
+    }
+
+    size_t
+    packed_count(zmq::message_t& frame)
+    {
+      PackedReader reader(frame);
+      const size_t count = reader.count();
+      const char* data;
+      size_t sz;
+      for (size_t i = 0; i < count; ++i)
+      {
+        if (!reader.next(data, sz))
+        {
+          return 0;
+        }
+      }
+      return reader.at_end() ? count : 0;
+    }
+
+    void
+    unpack(Part& frame, Part* parts, size_t count) throw(ZmqErrorType)
+    {
+      //frame is usually one of parts, take it out first
+      Part wire;
+      wire.move(frame);
+
+      PackedReader reader(wire.msg());
+      assert(reader.count() == count);
+
+      PackedHolder* holder = 0;
+      for (size_t i = 0; i < count; ++i)
+      {
+        const char* data = 0;
+        size_t sz = 0;
+        reader.next(data, sz);
+
+        if (sz <= ZMQMESSAGE_POOL_MIN_PART_SIZE)
+        {
+          Part part(sz);
+          ::memcpy(part.msg().data(), data, sz);
+          parts[i].move(part);
+          continue;
+        }
+
+        if (!holder)
+        {
+          //frame is not a very small message, so content stays in place
+          holder = new PackedHolder;
+          holder->refs = 1;
+          holder->frame.move(wire);
+        }
+        __sync_add_and_fetch(&holder->refs, 1);
+        try
+        {
+          Part part(const_cast<char*>(data), sz, &release_packed, holder);
+          parts[i].move(part);
+        }
+        catch (...)
+        {
+          release_packed(0, holder); //slice reference
+          release_packed(0, holder); //ours
+          throw;
+        }
+      }
+
+      if (holder)
+      {
+        release_packed(0, holder);
+      }
+    }
+  }
+}
+
+#endif /* ZMQMESSAGE_PACKEDFULLIMPL_HPP_ */
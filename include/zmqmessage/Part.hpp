@@ -8,6 +8,7 @@
 #define ZMQMESSAGE_PART_HPP_
 
 #include <zmqmessage/Config.hpp>
+#include <zmqmessage/PartAllocator.hpp>
 
 namespace ZmqMessage
 {
@@ -22,6 +23,7 @@ namespace ZmqMessage
   private:
     zmq_msg_t msg_;
     bool valid_; //has meaningful content
+    bool received_; //content is as received, not decoded by PartCodec
 
     ZMQMESSAGE_DLL_LOCAL
     inline
@@ -36,23 +38,34 @@ namespace ZmqMessage
   public:
     inline
     explicit
-    Part(bool valid = true) : valid_(valid)
+    Part(bool valid = true) : valid_(valid), received_(false)
     {
       init_empty();
     }
 
     inline
     explicit
-    Part(size_t size_) : valid_(true)
+    Part(size_t size_) : valid_(true), received_(false)
     {
       int rc = zmq_msg_init_size (&msg_, size_);
       if (rc != 0)
         throw error_t ();
     }
 
+    /**
+     * Create message with (uninitialized) buffer of given size
+     * taken from allocator. Fill it through msg().data().
+     */
+    inline
+    Part(size_t size_, PartAllocator& alloc) : valid_(true), received_(false)
+    {
+      init_empty();
+      alloc.init(msg(), size_);
+    }
+
     inline
     Part(void *data_, size_t size_, zmq::free_fn *ffn_,
-      void *hint_ = NULL) : valid_(true)
+      void *hint_ = NULL) : valid_(true), received_(false)
     {
       int rc = zmq_msg_init_data (&msg_, data_, size_, ffn_, hint_);
       if (rc != 0)
@@ -66,6 +79,24 @@ namespace ZmqMessage
       return valid_;
     }
 
+    /**
+     * @return if content is as received from socket
+     * and may be encoded by PartCodec (not decoded yet)
+     */
+    inline
+    bool
+    received() const
+    {
+      return received_;
+    }
+
+    inline
+    void
+    set_received(bool received)
+    {
+      received_ = received;
+    }
+
     inline
     void
     mark_invalid()
@@ -82,7 +113,7 @@ namespace ZmqMessage
 
     inline
     Part(const Part& part) :
-      valid_(part.valid_)
+      valid_(part.valid_), received_(false)
     {
       init_empty();
       Part& src = const_cast<Part&>(part);
@@ -115,6 +146,7 @@ namespace ZmqMessage
       {
         zmq_msg_copy(&msg_, &src.msg_);
         valid_ = true;
+        received_ = src.received_;
       }
     }
 
@@ -126,6 +158,7 @@ namespace ZmqMessage
       {
         zmq_msg_move(&msg_, &src.msg_);
         valid_ = true;
+        received_ = src.received_;
         src.valid_ = false;
       }
       else
@@ -140,6 +173,7 @@ namespace ZmqMessage
     {
       zmq_msg_move(&msg_, static_cast<zmq_msg_t*>(static_cast<void*>(&src)));
       valid_ = true;
+      received_ = false;
     }
 
     inline
@@ -0,0 +1,71 @@
+/**
+ * @file PartAllocator.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_PARTALLOCATOR_HPP_
+#define ZMQMESSAGE_PARTALLOCATOR_HPP_
+
+#include <zmqmessage/Config.hpp>
+#include <ZmqTools.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Source of payload buffers for outgoing message parts.
+   *
+   * Allocator initializes zmq message with buffer of requested size
+   * and attaches deleter (ZMQ free function) returning the buffer
+   * to allocator when zmq is done with message.
+   * Deleter may be called from any thread (including libzmq I/O threads).
+   *
+   * Parts not larger than \ref ZMQMESSAGE_POOL_MIN_PART_SIZE
+   * are stored inline in zmq message, so they never reach allocator.
+   *
+   * Allocator may be set to Sink (see Sink::set_part_allocator, OutOptions)
+   * or used directly to construct Part.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC PartAllocator
+  {
+  public:
+    /**
+     * Initialize message with (uninitialized) buffer of sz bytes.
+     * @return pointer to message data to fill
+     */
+    inline
+    void*
+    init(zmq::message_t& msg, size_t sz) throw(ZmqErrorType)
+    {
+      if (sz <= ZMQMESSAGE_POOL_MIN_PART_SIZE)
+      {
+        try
+        {
+          msg.rebuild(sz);
+        }
+        catch (const zmq::error_t& e)
+        {
+          throw_zmq_exception(e);
+        }
+        return msg.data();
+      }
+      return do_init(msg, sz);
+    }
+
+  protected:
+    /**
+     * Initialize message with buffer of sz bytes
+     * (sz is larger than \ref ZMQMESSAGE_POOL_MIN_PART_SIZE).
+     */
+    virtual
+    void*
+    do_init(zmq::message_t& msg, size_t sz) throw(ZmqErrorType) = 0;
+
+    virtual
+    ~PartAllocator() {}
+  };
+}
+
+#endif /* ZMQMESSAGE_PARTALLOCATOR_HPP_ */
@@ -0,0 +1,222 @@
+/**
+ * @file PartCodec.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Transparent compression of message parts.
+ * See \ref zm_codec "compression".
+ */
+
+#ifndef ZMQMESSAGE_PARTCODEC_HPP_
+#define ZMQMESSAGE_PARTCODEC_HPP_
+
+#include <stdint.h>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/Part.hpp>
+
+namespace ZmqMessage
+{
+  namespace Private
+  {
+    /**
+     * Encoded part starts with this marker.
+     * First byte is never met in UTF-8 text.
+     */
+    const char CODEC_MAGIC[] = {'\xf5', 'Z', 'M', 'C'};
+    const size_t CODEC_MAGIC_LEN = sizeof(CODEC_MAGIC);
+
+    /**
+     * magic, codec id (1 byte), original size (4 bytes, little endian)
+     */
+    const size_t CODEC_HEADER_LEN = CODEC_MAGIC_LEN + 1 + 4;
+
+    /**
+     * Codec id of parts stored as is (only to escape content
+     * which starts with CODEC_MAGIC itself)
+     */
+    const char CODEC_STORED = 0;
+  }
+
+  /**
+   * @brief Compresses message parts above size threshold.
+   *
+   * Set codec to Sink to compress outgoing message parts,
+   * and to Incoming (Multipart) to decompress them.
+   * Decompression is lazy: part is decoded in place on first access
+   * (by index, extraction or iteration), parts never read are not decoded.
+   * Routing parts are never compressed.
+   *
+   * Encoded part is prefixed with header (see Private::CODEC_MAGIC)
+   * carrying codec id and original size. Part is sent as is
+   * if it's smaller than threshold or compression does not pay off.
+   *
+   * Derived classes implement the compression algorithm itself,
+   * see LzCodec. Codec is not thread-safe (it holds counters
+   * and maybe working memory): use one codec object per thread.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC PartCodec : private Private::NonCopyable
+  {
+  public:
+    /**
+     * Counters of encoded/decoded parts.
+     */
+    struct Stats
+    {
+      size_t encoded; //!< parts compressed
+      size_t skipped; //!< parts sent as is (small or incompressible)
+      size_t decoded; //!< parts decompressed
+      size_t errors; //!< malformed parts left undecoded
+      uint64_t raw_bytes; //!< size of compressed parts before compression
+      uint64_t encoded_bytes; //!< size of compressed parts (with header)
+      uint64_t encode_usec; //!< time spent in compression
+      uint64_t decode_usec; //!< time spent in decompression
+
+      Stats();
+
+      /**
+       * @return encoded_bytes / raw_bytes (1 if nothing is encoded)
+       */
+      double
+      ratio() const;
+    };
+
+    static const size_t DEFAULT_THRESHOLD = 1024;
+
+    /**
+     * @param threshold parts smaller than this are not compressed
+     */
+    explicit
+    PartCodec(size_t threshold = DEFAULT_THRESHOLD);
+
+    virtual
+    ~PartCodec();
+
+    inline
+    size_t
+    threshold() const
+    {
+      return threshold_;
+    }
+
+    inline
+    const Stats&
+    stats() const
+    {
+      return stats_;
+    }
+
+    inline
+    void
+    reset_stats()
+    {
+      stats_ = Stats();
+    }
+
+    /**
+     * Replace part content with its encoded form if it's worth it.
+     * Parts already encoded (received and not decoded) are left as is.
+     */
+    virtual
+    void
+    encode(Part& part) throw(ZmqErrorType);
+
+    /**
+     * Replace part content with its decoded form
+     * if it's encoded and not decoded yet.
+     * Malformed or unknown encoded part is left as is
+     * (and counted in Stats::errors).
+     */
+    virtual
+    void
+    decode(Part& part) throw(ZmqErrorType);
+
+    /**
+     * @return true if parts are to be decoded as soon as received
+     *  (not on first access), e.g. to release resources they hold
+     */
+    virtual
+    bool
+    decode_on_receive() const;
+
+    /**
+     * @return if message content starts with encoded part header
+     */
+    static
+    bool
+    is_encoded(zmq::message_t& msg);
+
+  protected:
+    /**
+     * @return codec id written in header, not CODEC_STORED
+     */
+    virtual
+    char
+    id() const = 0;
+
+    /**
+     * @return compressed size, 0 if it does not fit into @c cap
+     * (@c cap is less than @c sz, so incompressible input
+     * is rejected without wasting time on it)
+     */
+    virtual
+    size_t
+    compress(const char* src, size_t sz, char* dst, size_t cap) = 0;
+
+    /**
+     * @return false if source is malformed
+     *  or does not decompress into exactly @c orig bytes
+     */
+    virtual
+    bool
+    decompress(const char* src, size_t sz, char* dst, size_t orig) = 0;
+
+    /**
+     * Escape part starting with CODEC_MAGIC (sent as is otherwise)
+     */
+    void
+    store(Part& part) throw(ZmqErrorType);
+
+    Stats stats_;
+
+  private:
+    const size_t threshold_;
+  };
+
+  /**
+   * @brief Fast LZ77-family codec with no external dependencies.
+   *
+   * Byte-oriented format (close to LZ4 block): sequences of
+   * literal run and back reference (up to 64K) with 4-bit lengths
+   * in one token byte extended by 255-runs.
+   * Favors speed over ratio: single hash probe per position.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC LzCodec : public PartCodec
+  {
+  public:
+    explicit
+    LzCodec(size_t threshold = DEFAULT_THRESHOLD);
+
+  protected:
+    virtual
+    char
+    id() const;
+
+    virtual
+    size_t
+    compress(const char* src, size_t sz, char* dst, size_t cap);
+
+    virtual
+    bool
+    decompress(const char* src, size_t sz, char* dst, size_t orig);
+
+  private:
+    static const unsigned HASH_BITS = 12;
+
+    uint32_t table_[1 << HASH_BITS]; //!< last position of 4-byte sequence
+  };
+}
+
+#endif /* ZMQMESSAGE_PARTCODEC_HPP_ */
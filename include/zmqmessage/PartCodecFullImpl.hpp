@@ -0,0 +1,462 @@
+/**
+ * @file PartCodecFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of PartCodec and LzCodec methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ *
+ * LzCodec stream is a sequence of:
+ * @code
+ * token(1) [literal length ext] literals [offset(2) [match length ext]]
+ * @endcode
+ * Token holds literal length (high 4 bits) and match length - 4
+ * (low 4 bits), value 15 is continued by bytes added to it
+ * while they are 255. The last sequence has literals only.
+ */
+
+#ifndef ZMQMESSAGE_PARTCODECFULLIMPL_HPP_
+#define ZMQMESSAGE_PARTCODECFULLIMPL_HPP_
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace ZmqMessage
+{
+  namespace
+  {
+    void
+    free_encoded(void* data, void* hint)
+    {
+      ::free(data);
+    }
+
+    void
+    put_codec_header(char* dst, char id, size_t orig)
+    {
+      ::memcpy(dst, Private::CODEC_MAGIC, Private::CODEC_MAGIC_LEN);
+      dst[Private::CODEC_MAGIC_LEN] = id;
+      for (size_t i = 0; i < 4; ++i)
+      {
+        dst[Private::CODEC_MAGIC_LEN + 1 + i] =
+          static_cast<char>((orig >> (8 * i)) & 0xff);
+      }
+    }
+
+    const size_t LZ_MIN_MATCH = 4;
+    const size_t LZ_LAST_LITERALS = 5;
+    const size_t LZ_MF_LIMIT = 12; //!< no match starts closer to the end
+    const size_t LZ_MAX_OFFSET = 65535;
+
+    inline
+    uint32_t
+    lz_read32(const unsigned char* p)
+    {
+      uint32_t v;
+      ::memcpy(&v, p, sizeof(v));
+      return v;
+    }
+
+    /**
+     * Write length extension bytes.
+     * @return false if dst overflows
+     */
+    inline
+    bool
+    lz_put_length(unsigned char*& op, const unsigned char* oend, size_t len)
+    {
+      for (; len >= 255; len -= 255)
+      {
+        if (op == oend)
+        {
+          return false;
+        }
+        *op++ = 255;
+      }
+      if (op == oend)
+      {
+        return false;
+      }
+      *op++ = static_cast<unsigned char>(len);
+      return true;
+    }
+
+    inline
+    bool
+    lz_get_length(const unsigned char*& ip, const unsigned char* iend,
+      size_t& len)
+    {
+      for (;;)
+      {
+        if (ip == iend)
+        {
+          return false;
+        }
+        const unsigned char b = *ip++;
+        len += b;
+        if (b != 255)
+        {
+          return true;
+        }
+      }
+    }
+
+    /**
+     * Write sequence of literals and match (if @c mlen is not 0).
+     * @return false if dst overflows
+     */
+    bool
+    lz_put_sequence(unsigned char*& op, const unsigned char* oend,
+      const unsigned char* lit, size_t litlen, size_t offset, size_t mlen)
+    {
+      const size_t ml = mlen ? mlen - LZ_MIN_MATCH : 0;
+      if (op == oend)
+      {
+        return false;
+      }
+      unsigned char* const token = op++;
+      *token = static_cast<unsigned char>(
+        (std::min(litlen, size_t(15)) << 4) | std::min(ml, size_t(15)));
+      if (litlen >= 15 && !lz_put_length(op, oend, litlen - 15))
+      {
+        return false;
+      }
+      if (static_cast<size_t>(oend - op) < litlen)
+      {
+        return false;
+      }
+      ::memcpy(op, lit, litlen);
+      op += litlen;
+      if (!mlen)
+      {
+        return true;
+      }
+      if (oend - op < 2)
+      {
+        return false;
+      }
+      *op++ = static_cast<unsigned char>(offset & 0xff);
+      *op++ = static_cast<unsigned char>(offset >> 8);
+      return ml < 15 || lz_put_length(op, oend, ml - 15);
+    }
+  }
+
+  PartCodec::Stats::Stats() :
+    encoded(0), skipped(0), decoded(0), errors(0),
+    raw_bytes(0), encoded_bytes(0), encode_usec(0), decode_usec(0)
+  {}
+
+  double
+  PartCodec::Stats::ratio() const
+  {
+    return raw_bytes ?
+      static_cast<double>(encoded_bytes) / static_cast<double>(raw_bytes) :
+      1.0;
+  }
+
+  PartCodec::PartCodec(size_t threshold) :
+    threshold_(std::max(threshold, Private::CODEC_HEADER_LEN + 2))
+  {}
+
+  PartCodec::~PartCodec()
+  {}
+
+  bool
+  PartCodec::decode_on_receive() const
+  {
+    return false;
+  }
+
+  bool
+  PartCodec::is_encoded(zmq::message_t& msg)
+  {
+    return msg.size() >= Private::CODEC_HEADER_LEN &&
+      !::memcmp(msg.data(), Private::CODEC_MAGIC, Private::CODEC_MAGIC_LEN);
+  }
+
+  void
+  PartCodec::store(Part& part) throw(ZmqErrorType)
+  {
+    const size_t sz = part.msg().size();
+    Part stored(Private::CODEC_HEADER_LEN + sz);
+    char* dst = static_cast<char*>(stored.msg().data());
+    put_codec_header(dst, Private::CODEC_STORED, sz);
+    ::memcpy(dst + Private::CODEC_HEADER_LEN, part.msg().data(), sz);
+    part.move(stored);
+    ++stats_.skipped;
+  }
+
+  void
+  PartCodec::encode(Part& part) throw(ZmqErrorType)
+  {
+    const bool magic = is_encoded(part.msg());
+    if (magic && part.received())
+    {
+      return; //received encoded, forwarded as is
+    }
+
+    const size_t sz = part.msg().size();
+    if (sz < threshold_ || sz > 0xffffffffu)
+    {
+      if (magic)
+      {
+        store(part);
+      }
+      else
+      {
+        ++stats_.skipped;
+      }
+      return;
+    }
+
+    const uint64_t start = monotonic_usec();
+    //compressed part must be smaller than original
+    char* buf = static_cast<char*>(::malloc(sz));
+    if (!buf)
+    {
+      throw std::bad_alloc();
+    }
+    const size_t csz = compress(
+      static_cast<const char*>(part.msg().data()), sz,
+      buf + Private::CODEC_HEADER_LEN, sz - Private::CODEC_HEADER_LEN - 1);
+    if (!csz)
+    {
+      ::free(buf);
+      stats_.encode_usec += monotonic_usec() - start;
+      if (magic)
+      {
+        store(part);
+      }
+      else
+      {
+        ++stats_.skipped;
+      }
+      return;
+    }
+
+    put_codec_header(buf, id(), sz);
+    const size_t esz = Private::CODEC_HEADER_LEN + csz;
+    //shrinking is done in place by malloc, just returns the tail
+    if (char* shrunk = static_cast<char*>(::realloc(buf, esz)))
+    {
+      buf = shrunk;
+    }
+    try
+    {
+      Part encoded(buf, esz, &free_encoded);
+      part.move(encoded);
+    }
+    catch (...)
+    {
+      ::free(buf);
+      throw;
+    }
+
+    ++stats_.encoded;
+    stats_.raw_bytes += sz;
+    stats_.encoded_bytes += esz;
+    stats_.encode_usec += monotonic_usec() - start;
+  }
+
+  void
+  PartCodec::decode(Part& part) throw(ZmqErrorType)
+  {
+    if (!part.received())
+    {
+      return;
+    }
+    if (!is_encoded(part.msg()))
+    {
+      part.set_received(false);
+      return;
+    }
+
+    const uint64_t start = monotonic_usec();
+    const unsigned char* const header =
+      static_cast<const unsigned char*>(part.msg().data());
+    const char codec_id = static_cast<char>(header[Private::CODEC_MAGIC_LEN]);
+    size_t orig = 0;
+    for (size_t i = 0; i < 4; ++i)
+    {
+      orig |= static_cast<size_t>(header[Private::CODEC_MAGIC_LEN + 1 + i])
+        << (8 * i);
+    }
+    const char* const src =
+      reinterpret_cast<const char*>(header + Private::CODEC_HEADER_LEN);
+    const size_t sz = part.msg().size() - Private::CODEC_HEADER_LEN;
+
+    bool ok = false;
+    if (codec_id == Private::CODEC_STORED)
+    {
+      if (sz == orig)
+      {
+        Part plain(orig);
+        ::memcpy(plain.msg().data(), src, orig);
+        part.move(plain);
+        ok = true;
+      }
+    }
+    //every compressed byte expands to 255 at most
+    else if (codec_id == id() && orig / 255 <= sz)
+    {
+      Part plain(orig);
+      ok = decompress(src, sz, static_cast<char*>(plain.msg().data()), orig);
+      if (ok)
+      {
+        part.move(plain);
+      }
+    }
+
+    part.set_received(false);
+    if (!ok)
+    {
+      ++stats_.errors;
+      ZMQMESSAGE_LOG_STREAM << "Cannot decode part of " << sz
+        << " bytes, codec " << static_cast<int>(codec_id)
+        << ": leaving it as is" << ZMQMESSAGE_LOG_TERM;
+      return;
+    }
+    ++stats_.decoded;
+    stats_.decode_usec += monotonic_usec() - start;
+  }
+
+  LzCodec::LzCodec(size_t threshold) :
+    PartCodec(threshold)
+  {}
+
+  char
+  LzCodec::id() const
+  {
+    return 1;
+  }
+
+  size_t
+  LzCodec::compress(const char* src, size_t sz, char* dst, size_t cap)
+  {
+    const unsigned char* const base =
+      reinterpret_cast<const unsigned char*>(src);
+    const unsigned char* const iend = base + sz;
+    const unsigned char* ip = base;
+    const unsigned char* anchor = base;
+    unsigned char* op = reinterpret_cast<unsigned char*>(dst);
+    unsigned char* const oend = op + cap;
+
+    if (sz >= LZ_MF_LIMIT)
+    {
+      ::memset(table_, 0, sizeof(table_));
+      const unsigned char* const mflimit = iend - LZ_MF_LIMIT;
+      const unsigned char* const matchlimit = iend - LZ_LAST_LITERALS;
+
+      while (ip < mflimit)
+      {
+        const uint32_t seq = lz_read32(ip);
+        const uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+        const unsigned char* const ref = base + table_[h];
+        table_[h] = static_cast<uint32_t>(ip - base);
+
+        if (ref >= ip || static_cast<size_t>(ip - ref) > LZ_MAX_OFFSET ||
+          lz_read32(ref) != seq)
+        {
+          //step faster through data without matches
+          ip += 1 + ((ip - anchor) >> 6);
+          continue;
+        }
+
+        const unsigned char* mp = ip + LZ_MIN_MATCH;
+        const unsigned char* rp = ref + LZ_MIN_MATCH;
+        while (mp < matchlimit && *mp == *rp)
+        {
+          ++mp;
+          ++rp;
+        }
+        if (!lz_put_sequence(op, oend, anchor, ip - anchor, ip - ref, mp - ip))
+        {
+          return 0;
+        }
+        ip = anchor = mp;
+      }
+    }
+
+    if (!lz_put_sequence(op, oend, anchor, iend - anchor, 0, 0))
+    {
+      return 0;
+    }
+    return op - reinterpret_cast<unsigned char*>(dst);
+  }
+
+  bool
+  LzCodec::decompress(const char* src, size_t sz, char* dst, size_t orig)
+  {
+    const unsigned char* ip = reinterpret_cast<const unsigned char*>(src);
+    const unsigned char* const iend = ip + sz;
+    unsigned char* const obegin = reinterpret_cast<unsigned char*>(dst);
+    unsigned char* op = obegin;
+    unsigned char* const oend = op + orig;
+
+    for (;;)
+    {
+      if (ip == iend)
+      {
+        return false;
+      }
+      const unsigned token = *ip++;
+
+      size_t litlen = token >> 4;
+      if (litlen == 15 && !lz_get_length(ip, iend, litlen))
+      {
+        return false;
+      }
+      if (static_cast<size_t>(iend - ip) < litlen ||
+        static_cast<size_t>(oend - op) < litlen)
+      {
+        return false;
+      }
+      ::memcpy(op, ip, litlen);
+      ip += litlen;
+      op += litlen;
+      if (ip == iend)
+      {
+        return op == oend; //last sequence
+      }
+
+      if (iend - ip < 2)
+      {
+        return false;
+      }
+      const size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+      ip += 2;
+      if (!offset || offset > static_cast<size_t>(op - obegin))
+      {
+        return false;
+      }
+      size_t mlen = token & 15;
+      if (mlen == 15 && !lz_get_length(ip, iend, mlen))
+      {
+        return false;
+      }
+      mlen += LZ_MIN_MATCH;
+      if (static_cast<size_t>(oend - op) < mlen)
+      {
+        return false;
+      }
+      const unsigned char* ref = op - offset;
+      if (offset >= mlen)
+      {
+        ::memcpy(op, ref, mlen);
+        op += mlen;
+      }
+      else
+      {
+        //overlapping match repeats the last offset bytes
+        for (size_t i = 0; i < mlen; ++i)
+        {
+          *op++ = *ref++;
+        }
+      }
+    }
+  }
+}
+
+#endif /* ZMQMESSAGE_PARTCODECFULLIMPL_HPP_ */
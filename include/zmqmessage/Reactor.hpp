@@ -0,0 +1,283 @@
+/**
+ * @file Reactor.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_REACTOR_HPP_
+#define ZMQMESSAGE_REACTOR_HPP_
+
+#include <stdint.h>
+#include <vector>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/TimerWheel.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Poll loop dispatching messages of many sockets to handlers.
+   *
+   * Sockets are registered with handler, priority and budget.
+   * On every iteration the reactor polls all sockets, fires expired timers,
+   * then visits ready sockets in order of priority (higher first,
+   * then in order of registration) and calls handler
+   * for up to @c budget messages of each, so a busy socket
+   * does not starve the others.
+   * Handlers may watch writability of their socket
+   * (e.g. to drain messages queued with OutOptions::CACHE_ON_BLOCK).
+   *
+   * Timers are kept in hierarchical timer wheel with @c tick resolution,
+   * so thousands of timeouts are cheap.
+   *
+   * @code
+   * class Worker : public ZmqMessage::Reactor::IncomingHandler<
+   *   ZmqMessage::XRouting>
+   * {
+   *   void
+   *   handle(ZmqMessage::Incoming<ZmqMessage::XRouting>& incoming)
+   *   {
+   *     incoming.receive_all();
+   *     ...
+   *   }
+   * };
+   * ...
+   * ZmqMessage::Reactor reactor;
+   * reactor.add(sock, worker);
+   * reactor.add_timer(1000000, heartbeat, 1000000);
+   * reactor.run(); //until stop() is called
+   * @endcode
+   * Reactor is to be used by one thread (but stop()).
+   * Handlers may add and remove sockets and timers,
+   * changes of sockets take effect on next iteration.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC Reactor : private Private::NonCopyable
+  {
+  public:
+    /**
+     * Callbacks of socket
+     */
+    class ZMQMESSAGE_DLL_PUBLIC Handler
+    {
+    public:
+      virtual
+      ~Handler();
+
+      /**
+       * Socket has message to receive. It should be received
+       * completely, else it's called for the rest of it.
+       */
+      virtual
+      void
+      on_readable(zmq::socket_t& sock) = 0;
+
+      /**
+       * Socket is writable, called while writability is watched.
+       * @return true to keep watching
+       */
+      virtual
+      bool
+      on_writable(zmq::socket_t& sock);
+    };
+
+    /**
+     * Handler receiving ready message with Incoming.
+     * Parts not received by handle() are dropped.
+     */
+    template <class RoutingPolicy,
+      class PartsStorage = DynamicPartsStorage<> >
+    class IncomingHandler : public Handler
+    {
+    public:
+      void
+      on_readable(zmq::socket_t& sock);
+
+    protected:
+      virtual
+      void
+      handle(Incoming<RoutingPolicy, PartsStorage>& incoming) = 0;
+    };
+
+    /**
+     * Loop counters
+     */
+    struct Stats
+    {
+      enum
+      {
+        HISTOGRAM_SIZE = 24
+      };
+
+      uint64_t iterations; //!< polls returned
+      uint64_t messages; //!< on_readable() calls
+      uint64_t writables; //!< on_writable() calls
+      uint64_t timers; //!< timers fired
+      uint64_t busy_usec; //!< time spent in dispatching
+      uint64_t max_busy_usec; //!< longest dispatching of one iteration
+      /**
+       * Iterations by dispatching time: histogram[i] counts
+       * iterations which took less than 2^i usec (the last - the rest)
+       */
+      uint64_t histogram[HISTOGRAM_SIZE];
+
+      Stats();
+    };
+
+    static const size_t DEFAULT_BUDGET = 64;
+
+    static const long DEFAULT_TICK = 1000; //1 ms
+
+    static const long DEFAULT_CHECK_INTERVAL = 100000; //100 ms
+
+    /**
+     * @param tick resolution of timers, microseconds
+     */
+    explicit
+    Reactor(long tick = DEFAULT_TICK);
+
+    /**
+     * Register socket.
+     * @param priority sockets with higher priority are visited first
+     * @param budget max messages dispatched per iteration
+     */
+    void
+    add(zmq::socket_t& sock, Handler& handler,
+      int priority = 0, size_t budget = DEFAULT_BUDGET);
+
+    /**
+     * Unregister socket.
+     * @return false if socket is not registered
+     */
+    bool
+    remove(zmq::socket_t& sock);
+
+    /**
+     * Start (or stop) calling Handler::on_writable() for socket
+     */
+    void
+    watch_writable(zmq::socket_t& sock, bool watch = true);
+
+    /**
+     * Call @c handler after @c delay microseconds
+     * and then every @c interval microseconds (if not 0).
+     * @return id of timer, never 0
+     */
+    TimerId
+    add_timer(long delay, TimerHandler& handler, long interval = 0);
+
+    /**
+     * @return false if there is no such timer (e.g. fired one-shot)
+     */
+    bool
+    cancel_timer(TimerId id);
+
+    /**
+     * @return number of pending timers
+     */
+    inline
+    size_t
+    timers() const
+    {
+      return wheel_.size();
+    }
+
+    /**
+     * Wait for events up to @c timeout (microseconds as in zmq_poll,
+     * -1 means infinite; shortened to expiration of next timer),
+     * then dispatch them.
+     * @return number of handler calls (including timers)
+     */
+    size_t
+    poll(long timeout) throw(ZmqErrorType);
+
+    /**
+     * Dispatch events until stop() is called.
+     * @param check_interval how often (microseconds) stop flag is checked
+     */
+    void
+    run(long check_interval = DEFAULT_CHECK_INTERVAL) throw(ZmqErrorType);
+
+    /**
+     * Make run() return (now or as soon as it's called).
+     * May be called from other thread.
+     */
+    inline
+    void
+    stop()
+    {
+      stopped_ = true;
+    }
+
+    inline
+    const Stats&
+    stats() const
+    {
+      return stats_;
+    }
+
+    inline
+    void
+    reset_stats()
+    {
+      stats_ = Stats();
+    }
+
+  private:
+    struct Registration
+    {
+      zmq::socket_t* sock;
+      Handler* handler; //!< 0 if removed
+      int priority;
+      size_t budget;
+      bool writable; //!< writability is watched
+    };
+
+    std::vector<Registration> regs_;
+
+    std::vector<zmq::pollitem_t> items_; //!< by regs_ order
+
+    bool changed_; //!< regs_ are to be compacted, items_ rebuilt
+
+    const long tick_;
+
+    const uint64_t origin_;
+
+    Private::TimerWheel wheel_;
+
+    Stats stats_;
+
+    volatile bool stopped_;
+
+    ZMQMESSAGE_DLL_LOCAL
+    uint64_t
+    now_tick() const;
+
+    ZMQMESSAGE_DLL_LOCAL
+    static
+    bool
+    higher_priority(const Registration& a, const Registration& b);
+
+    ZMQMESSAGE_DLL_LOCAL
+    Registration*
+    find(zmq::socket_t& sock);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    rebuild();
+
+    ZMQMESSAGE_DLL_LOCAL
+    size_t
+    dispatch(size_t idx, short revents) throw(ZmqErrorType);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    account(uint64_t busy);
+  };
+}
+
+#endif /* ZMQMESSAGE_REACTOR_HPP_ */
@@ -0,0 +1,269 @@
+/**
+ * @file ReactorFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of Reactor methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_REACTORFULLIMPL_HPP_
+#define ZMQMESSAGE_REACTORFULLIMPL_HPP_
+
+#include <algorithm>
+
+namespace ZmqMessage
+{
+  Reactor::Handler::~Handler()
+  {}
+
+  bool
+  Reactor::Handler::on_writable(zmq::socket_t&)
+  {
+    return false;
+  }
+
+  Reactor::Stats::Stats() :
+    iterations(0), messages(0), writables(0), timers(0),
+    busy_usec(0), max_busy_usec(0)
+  {
+    std::fill(histogram, histogram + HISTOGRAM_SIZE, 0);
+  }
+
+  Reactor::Reactor(long tick) :
+    changed_(false), tick_(tick > 0 ? tick : DEFAULT_TICK),
+    origin_(monotonic_usec()), stopped_(false)
+  {}
+
+  uint64_t
+  Reactor::now_tick() const
+  {
+    return (monotonic_usec() - origin_) / tick_;
+  }
+
+  bool
+  Reactor::higher_priority(const Registration& a, const Registration& b)
+  {
+    return a.priority > b.priority;
+  }
+
+  Reactor::Registration*
+  Reactor::find(zmq::socket_t& sock)
+  {
+    for (size_t i = 0; i < regs_.size(); ++i)
+    {
+      if (regs_[i].sock == &sock && regs_[i].handler)
+      {
+        return &regs_[i];
+      }
+    }
+    return 0;
+  }
+
+  void
+  Reactor::add(zmq::socket_t& sock, Handler& handler,
+    int priority, size_t budget)
+  {
+    Registration* reg = find(sock);
+    if (!reg)
+    {
+      Registration r = {&sock, &handler, priority, 0, false};
+      regs_.push_back(r);
+      reg = &regs_.back();
+    }
+    reg->handler = &handler;
+    reg->priority = priority;
+    reg->budget = budget ? budget : 1;
+    changed_ = true;
+  }
+
+  bool
+  Reactor::remove(zmq::socket_t& sock)
+  {
+    Registration* reg = find(sock);
+    if (!reg)
+    {
+      return false;
+    }
+    reg->handler = 0;
+    changed_ = true;
+    return true;
+  }
+
+  void
+  Reactor::watch_writable(zmq::socket_t& sock, bool watch)
+  {
+    Registration* reg = find(sock);
+    if (reg)
+    {
+      reg->writable = watch;
+    }
+  }
+
+  TimerId
+  Reactor::add_timer(long delay, TimerHandler& handler, long interval)
+  {
+    //not earlier than delay: at the beginning of next tick
+    const uint64_t expires =
+      (monotonic_usec() - origin_ + std::max(delay, 0L)) / tick_ + 1;
+    const uint64_t period = interval > 0 ?
+      std::max((interval + tick_ - 1) / tick_, 1L) : 0;
+    return wheel_.add(expires, period, handler);
+  }
+
+  bool
+  Reactor::cancel_timer(TimerId id)
+  {
+    return wheel_.cancel(id);
+  }
+
+  void
+  Reactor::rebuild()
+  {
+    std::vector<Registration> regs;
+    regs.reserve(regs_.size());
+    for (size_t i = 0; i < regs_.size(); ++i)
+    {
+      if (regs_[i].handler)
+      {
+        regs.push_back(regs_[i]);
+      }
+    }
+    std::stable_sort(regs.begin(), regs.end(), higher_priority);
+    regs_.swap(regs);
+
+    items_.resize(regs_.size());
+    for (size_t i = 0; i < regs_.size(); ++i)
+    {
+      items_[i].socket = *regs_[i].sock;
+      items_[i].fd = 0;
+    }
+    changed_ = false;
+  }
+
+  size_t
+  Reactor::dispatch(size_t idx, short revents) throw(ZmqErrorType)
+  {
+    size_t calls = 0;
+    if (revents & ZMQ_POLLIN)
+    {
+      //registrations may be added (and vector reallocated) by handler
+      for (size_t n = 0; n < regs_[idx].budget && regs_[idx].handler; )
+      {
+        zmq::socket_t& sock = *regs_[idx].sock;
+        regs_[idx].handler->on_readable(sock);
+        ++calls;
+        ++stats_.messages;
+        if (++n == regs_[idx].budget)
+        {
+          break;
+        }
+        uint32_t events = 0;
+        size_t sz = sizeof(events);
+        try
+        {
+          sock.getsockopt(ZMQ_EVENTS, &events, &sz);
+        }
+        catch (const zmq::error_t& e)
+        {
+          throw_zmq_exception(e);
+        }
+        if (!(events & ZMQ_POLLIN))
+        {
+          break;
+        }
+      }
+    }
+    if ((revents & ZMQ_POLLOUT) &&
+      regs_[idx].handler && regs_[idx].writable)
+    {
+      ++calls;
+      ++stats_.writables;
+      if (!regs_[idx].handler->on_writable(*regs_[idx].sock))
+      {
+        regs_[idx].writable = false;
+      }
+    }
+    return calls;
+  }
+
+  void
+  Reactor::account(uint64_t busy)
+  {
+    stats_.busy_usec += busy;
+    stats_.max_busy_usec = std::max(stats_.max_busy_usec, busy);
+    size_t bucket = 0;
+    while (bucket < Stats::HISTOGRAM_SIZE - 1 && (1ULL << bucket) <= busy)
+    {
+      ++bucket;
+    }
+    ++stats_.histogram[bucket];
+  }
+
+  size_t
+  Reactor::poll(long timeout) throw(ZmqErrorType)
+  {
+    if (changed_)
+    {
+      rebuild();
+    }
+    for (size_t i = 0; i < items_.size(); ++i)
+    {
+      items_[i].events = ZMQ_POLLIN;
+      if (regs_[i].writable)
+      {
+        items_[i].events |= ZMQ_POLLOUT;
+      }
+      items_[i].revents = 0;
+    }
+
+    const uint64_t next = wheel_.next_expiry();
+    if (next != Private::TimerWheel::NEVER)
+    {
+      const uint64_t due = origin_ + next * tick_;
+      const uint64_t now = monotonic_usec();
+      const long wait = due > now ? static_cast<long>(due - now) : 0;
+      if (timeout < 0 || wait < timeout)
+      {
+        timeout = wait;
+      }
+    }
+
+    int rc = 0;
+    try
+    {
+      rc = zmq::poll(items_.empty() ? 0 : &items_[0], items_.size(), timeout);
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+
+    const uint64_t start = monotonic_usec();
+    const size_t fired = wheel_.advance((start - origin_) / tick_);
+    stats_.timers += fired;
+    size_t calls = fired;
+    for (size_t i = 0; rc > 0 && i < items_.size(); ++i)
+    {
+      if (items_[i].revents)
+      {
+        calls += dispatch(i, items_[i].revents);
+      }
+    }
+    ++stats_.iterations;
+    account(monotonic_usec() - start);
+    return calls;
+  }
+
+  void
+  Reactor::run(long check_interval) throw(ZmqErrorType)
+  {
+    while (!stopped_)
+    {
+      poll(check_interval);
+    }
+  }
+}
+
+#endif /* ZMQMESSAGE_REACTORFULLIMPL_HPP_ */
@@ -0,0 +1,156 @@
+/**
+ * @file Relay.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_RELAY_HPP_
+#define ZMQMESSAGE_RELAY_HPP_
+
+#include <stdint.h>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/Part.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Poll-driven relay of messages between two sockets.
+   *
+   * Moves message parts from source to destination socket
+   * without copying, in one or both directions.
+   * On every wakeup up to @c budget messages are relayed
+   * in each direction, so busy direction does not starve the other one.
+   * Message started is always relayed up to the end.
+   *
+   * Destination is written in non-blocking mode. If it would block
+   * (e.g. high water mark is reached), the part is kept and reading
+   * from source is paused until destination becomes writable:
+   * pressure is passed to source peers instead of queueing unboundedly.
+   *
+   * Typical broker thread:
+   * @code
+   * zmq::socket_t front(ctx, ZMQ_XREP);
+   * zmq::socket_t back(ctx, ZMQ_XREQ);
+   * ...
+   * ZmqMessage::Relay relay(front, back);
+   * relay.run(); //until stop() is called
+   * @endcode
+   * Relay is to be used by one thread (but stop()).
+   */
+  class ZMQMESSAGE_DLL_PUBLIC Relay : private Private::NonCopyable
+  {
+  public:
+    enum Direction
+    {
+      FORWARD = 0x1, //!< from front to back socket
+      BACKWARD = 0x2, //!< from back to front socket
+      BOTH = FORWARD | BACKWARD
+    };
+
+    /**
+     * Per direction counters
+     */
+    struct Stats
+    {
+      uint64_t messages; //!< messages relayed
+      uint64_t parts; //!< message parts relayed
+      uint64_t bytes; //!< payload bytes relayed
+      uint64_t stalls; //!< times destination would block
+
+      Stats();
+    };
+
+    static const size_t DEFAULT_BUDGET = 64;
+
+    static const long DEFAULT_CHECK_INTERVAL = 100000; //100 ms
+
+    /**
+     * @param directions bitmask of Direction
+     * @param budget max messages relayed in one direction per wakeup
+     */
+    Relay(zmq::socket_t& front, zmq::socket_t& back,
+      unsigned directions = BOTH, size_t budget = DEFAULT_BUDGET);
+
+    /**
+     * Wait for messages (or writability of stalled destination)
+     * up to @c timeout (microseconds as in zmq_poll, -1 means infinite),
+     * then relay available messages.
+     * @return number of messages relayed in both directions
+     */
+    size_t
+    poll(long timeout) throw(ZmqErrorType);
+
+    /**
+     * Relay messages until stop() is called.
+     * @param check_interval how often (microseconds) stop flag is checked
+     */
+    void
+    run(long check_interval = DEFAULT_CHECK_INTERVAL) throw(ZmqErrorType);
+
+    /**
+     * Make run() return (now or as soon as it's called).
+     * May be called from other thread.
+     */
+    inline
+    void
+    stop()
+    {
+      stopped_ = true;
+    }
+
+    /**
+     * @param direction FORWARD or BACKWARD
+     */
+    inline
+    const Stats&
+    stats(Direction direction) const
+    {
+      return pipes_[direction == BACKWARD].stats;
+    }
+
+    /**
+     * @return if part in @c direction is waiting for destination
+     */
+    inline
+    bool
+    is_stalled(Direction direction) const
+    {
+      return pipes_[direction == BACKWARD].pending;
+    }
+
+  private:
+    /**
+     * One direction of relay
+     */
+    struct Pipe
+    {
+      zmq::socket_t* src;
+      zmq::socket_t* dst;
+      bool enabled;
+      Part part; //!< part received and not sent yet
+      bool pending; //!< part is waiting for destination
+      int flags; //!< flags to send part with
+      Stats stats;
+    };
+
+    Pipe pipes_[2];
+
+    const size_t budget_;
+
+    volatile bool stopped_;
+
+    ZMQMESSAGE_DLL_LOCAL
+    size_t
+    pump(Pipe& pipe) throw(ZmqErrorType);
+
+    ZMQMESSAGE_DLL_LOCAL
+    bool
+    try_send(Pipe& pipe) throw(ZmqErrorType);
+  };
+}
+
+#endif /* ZMQMESSAGE_RELAY_HPP_ */
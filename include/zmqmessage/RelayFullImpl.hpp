@@ -0,0 +1,161 @@
+/**
+ * @file RelayFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of Relay methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_RELAYFULLIMPL_HPP_
+#define ZMQMESSAGE_RELAYFULLIMPL_HPP_
+
+namespace ZmqMessage
+{
+  Relay::Stats::Stats() :
+    messages(0), parts(0), bytes(0), stalls(0)
+  {}
+
+  Relay::Relay(zmq::socket_t& front, zmq::socket_t& back,
+    unsigned directions, size_t budget) :
+    budget_(budget ? budget : 1), stopped_(false)
+  {
+    pipes_[0].src = &front;
+    pipes_[0].dst = &back;
+    pipes_[0].enabled = directions & FORWARD;
+    pipes_[1].src = &back;
+    pipes_[1].dst = &front;
+    pipes_[1].enabled = directions & BACKWARD;
+    for (size_t i = 0; i < 2; ++i)
+    {
+      pipes_[i].pending = false;
+      pipes_[i].flags = 0;
+    }
+  }
+
+  bool
+  Relay::try_send(Pipe& pipe) throw(ZmqErrorType)
+  {
+    const size_t sz = pipe.part.msg().size();
+    bool sent = false;
+    try
+    {
+      sent = pipe.dst->send(pipe.part.msg(), pipe.flags | ZMQ_NOBLOCK);
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+    if (!sent)
+    {
+      if (!pipe.pending)
+      {
+        ++pipe.stats.stalls;
+        pipe.pending = true;
+      }
+      return false;
+    }
+
+    pipe.pending = false;
+    ++pipe.stats.parts;
+    pipe.stats.bytes += sz;
+    if (!(pipe.flags & ZMQ_SNDMORE))
+    {
+      ++pipe.stats.messages;
+    }
+    return true;
+  }
+
+  size_t
+  Relay::pump(Pipe& pipe) throw(ZmqErrorType)
+  {
+    const uint64_t start = pipe.stats.messages;
+    if (pipe.pending && !try_send(pipe))
+    {
+      return 0;
+    }
+
+    //message started is finished regardless of budget
+    while (pipe.stats.messages - start < budget_ ||
+      (pipe.flags & ZMQ_SNDMORE))
+    {
+      if (!try_recv_msg(*pipe.src, pipe.part.msg()))
+      {
+        break;
+      }
+      pipe.flags = has_more(*pipe.src) ? ZMQ_SNDMORE : 0;
+      if (!try_send(pipe))
+      {
+        break; //reading is paused until destination is writable
+      }
+    }
+    return pipe.stats.messages - start;
+  }
+
+  size_t
+  Relay::poll(long timeout) throw(ZmqErrorType)
+  {
+    zmq::pollitem_t items[2];
+    for (size_t i = 0; i < 2; ++i)
+    {
+      items[i].socket = *pipes_[i].src;
+      items[i].fd = 0;
+      items[i].events = 0;
+      items[i].revents = 0;
+    }
+    for (size_t i = 0; i < 2; ++i)
+    {
+      if (!pipes_[i].enabled)
+      {
+        continue;
+      }
+      if (pipes_[i].pending)
+      {
+        items[1 - i].events |= ZMQ_POLLOUT; //our dst is other's src
+      }
+      else
+      {
+        items[i].events |= ZMQ_POLLIN;
+      }
+    }
+
+    int rc = 0;
+    try
+    {
+      rc = zmq::poll(items, 2, timeout);
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+    if (rc <= 0)
+    {
+      return 0;
+    }
+
+    size_t relayed = 0;
+    for (size_t i = 0; i < 2; ++i)
+    {
+      const short ready = pipes_[i].pending ?
+        (items[1 - i].revents & ZMQ_POLLOUT) :
+        (items[i].revents & ZMQ_POLLIN);
+      if (pipes_[i].enabled && ready)
+      {
+        relayed += pump(pipes_[i]);
+      }
+    }
+    return relayed;
+  }
+
+  void
+  Relay::run(long check_interval) throw(ZmqErrorType)
+  {
+    while (!stopped_)
+    {
+      poll(check_interval);
+    }
+  }
+}
+
+#endif /* ZMQMESSAGE_RELAYFULLIMPL_HPP_ */
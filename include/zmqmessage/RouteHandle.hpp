@@ -0,0 +1,240 @@
+/**
+ * @file RouteHandle.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_ROUTEHANDLE_HPP_
+#define ZMQMESSAGE_ROUTEHANDLE_HPP_
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Routing envelope of received message, detached from Incoming.
+   *
+   * Replying with Outgoing<XRouting> built from Incoming
+   * requires the request to be alive until reply is sent.
+   * RouteHandle keeps a copy of routing parts (peer identities
+   * and empty delimiter) instead, so reply may be sent later:
+   * @code
+   * ZmqMessage::Incoming<ZmqMessage::XRouting> req(xrep_sock);
+   * req.receive_all();
+   * ZmqMessage::RouteHandle route(req);
+   * ... //req is destroyed, work is done asynchronously
+   * ZmqMessage::Outgoing<ZmqMessage::XRouting> rep(xrep_sock, route, 0);
+   * rep << ... << ZmqMessage::Flush;
+   * @endcode
+   * Envelope is immutable and reference counted (atomically),
+   * so handle is cheap to copy and may be passed to other threads.
+   * Handles are compared by envelope content: parts are stored
+   * contiguously with their sizes and compared with single memcmp,
+   * hash is computed once. So RouteHandle may be a key of
+   * std::map or std::tr1::unordered_map (with RouteHandle::Hash),
+   * e.g. to keep per-client state.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC RouteHandle
+  {
+  public:
+    /**
+     * Hash functor for unordered containers
+     */
+    struct Hash
+    {
+      inline
+      size_t
+      operator()(const RouteHandle& route) const
+      {
+        return static_cast<size_t>(route.hash());
+      }
+    };
+
+    /**
+     * Empty handle: Outgoing<XRouting> sends empty delimiter only
+     */
+    RouteHandle();
+
+    /**
+     * Copy routing of received message
+     */
+    template <class PartsStorage>
+    explicit
+    RouteHandle(Incoming<XRouting, PartsStorage>& incoming);
+
+    RouteHandle(const RouteHandle& other);
+
+    RouteHandle&
+    operator=(const RouteHandle& other);
+
+    ~RouteHandle();
+
+    inline
+    bool
+    empty() const
+    {
+      return !env_;
+    }
+
+    /**
+     * @return number of routing parts (including delimiter)
+     */
+    inline
+    size_t
+    size() const
+    {
+      return env_ ? env_->parts : 0;
+    }
+
+    /**
+     * @return hash of routing parts (FNV-1a, see ShardedSink::hash)
+     */
+    inline
+    uint64_t
+    hash() const
+    {
+      return env_ ? env_->hash : 0;
+    }
+
+    /**
+     * @return size of part @c n (must be less than size())
+     * and its data in @c data
+     */
+    size_t
+    part(size_t n, const char*& data) const;
+
+    friend
+    bool
+    operator==(const RouteHandle& lhs, const RouteHandle& rhs);
+
+    friend
+    bool
+    operator<(const RouteHandle& lhs, const RouteHandle& rhs);
+
+  private:
+    /**
+     * Shared routing parts: each one is size (uint32_t) and data
+     */
+    struct Envelope
+    {
+      long refs;
+      size_t parts;
+      uint64_t hash;
+      std::vector<char> data;
+    };
+
+    Envelope* env_;
+
+    void
+    init(Part* routing, size_t num);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    release();
+  };
+
+  ZMQMESSAGE_DLL_PUBLIC
+  bool
+  operator==(const RouteHandle& lhs, const RouteHandle& rhs);
+
+  /**
+   * Order of envelope content (empty handle is the least)
+   */
+  ZMQMESSAGE_DLL_PUBLIC
+  bool
+  operator<(const RouteHandle& lhs, const RouteHandle& rhs);
+
+  inline
+  bool
+  operator!=(const RouteHandle& lhs, const RouteHandle& rhs)
+  {
+    return !(lhs == rhs);
+  }
+
+  /**
+   * @brief Requests of ROUTER (XREP) server waiting for reply.
+   *
+   * Server remembers routing of request and gets ticket,
+   * which is passed along with the work (to other thread etc).
+   * When the work is done, route is taken by ticket and reply is sent,
+   * in any order:
+   * @code
+   * ZmqMessage::ReplyTable pending;
+   * ...
+   * ZmqMessage::ReplyTable::Ticket ticket =
+   *   pending.add(ZmqMessage::RouteHandle(req));
+   * ...
+   * ZmqMessage::RouteHandle route;
+   * if (pending.take(ticket, route))
+   * {
+   *   ZmqMessage::Outgoing<ZmqMessage::XRouting> rep(xrep_sock, route, 0);
+   *   ...
+   * }
+   * @endcode
+   */
+  class ZMQMESSAGE_DLL_PUBLIC ReplyTable : private Private::NonCopyable
+  {
+  public:
+    /**
+     * Request number, 0 is never used
+     */
+    typedef uint64_t Ticket;
+
+    ReplyTable();
+
+    /**
+     * Remember request waiting for reply
+     */
+    Ticket
+    add(const RouteHandle& route);
+
+    /**
+     * @return route of pending request, 0 if there is no such request
+     */
+    const RouteHandle*
+    find(Ticket ticket) const;
+
+    /**
+     * Forget request (e.g. to reply to it)
+     * @param route set to route of request
+     * @return false if there is no such request
+     */
+    bool
+    take(Ticket ticket, RouteHandle& route);
+
+    /**
+     * Forget all requests of peer (e.g. it's gone)
+     * @return number of requests removed
+     */
+    size_t
+    erase(const RouteHandle& route);
+
+    /**
+     * @return number of requests waiting for reply
+     */
+    inline
+    size_t
+    size() const
+    {
+      return pending_.size();
+    }
+
+  private:
+    typedef std::map<Ticket, RouteHandle> Pending;
+
+    Pending pending_;
+
+    Ticket last_ticket_;
+  };
+}
+
+#endif /* ZMQMESSAGE_ROUTEHANDLE_HPP_ */
@@ -0,0 +1,202 @@
+/**
+ * @file RouteHandleFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of RouteHandle and ReplyTable methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_ROUTEHANDLEFULLIMPL_HPP_
+#define ZMQMESSAGE_ROUTEHANDLEFULLIMPL_HPP_
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <memory>
+
+namespace ZmqMessage
+{
+  RouteHandle::RouteHandle() :
+    env_(0)
+  {}
+
+  RouteHandle::RouteHandle(const RouteHandle& other) :
+    env_(other.env_)
+  {
+    if (env_)
+    {
+      __sync_add_and_fetch(&env_->refs, 1);
+    }
+  }
+
+  RouteHandle&
+  RouteHandle::operator=(const RouteHandle& other)
+  {
+    if (env_ != other.env_)
+    {
+      if (other.env_)
+      {
+        __sync_add_and_fetch(&other.env_->refs, 1);
+      }
+      release();
+      env_ = other.env_;
+    }
+    return *this;
+  }
+
+  RouteHandle::~RouteHandle()
+  {
+    release();
+  }
+
+  void
+  RouteHandle::release()
+  {
+    if (env_ && !__sync_sub_and_fetch(&env_->refs, 1))
+    {
+      delete env_;
+    }
+    env_ = 0;
+  }
+
+  void
+  RouteHandle::init(Part* routing, size_t num)
+  {
+    if (!num)
+    {
+      return;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < num; ++i)
+    {
+      total += sizeof(uint32_t) + routing[i].msg().size();
+    }
+
+    std::auto_ptr<Envelope> env(new Envelope);
+    env->refs = 1;
+    env->parts = num;
+    env->data.resize(total);
+    char* p = &env->data[0];
+    for (size_t i = 0; i < num; ++i)
+    {
+      const uint32_t sz = static_cast<uint32_t>(routing[i].msg().size());
+      ::memcpy(p, &sz, sizeof(sz));
+      p += sizeof(sz);
+      if (sz)
+      {
+        ::memcpy(p, routing[i].msg().data(), sz);
+        p += sz;
+      }
+    }
+    env->hash = ShardedSink::hash(&env->data[0], total);
+    env_ = env.release();
+  }
+
+  size_t
+  RouteHandle::part(size_t n, const char*& data) const
+  {
+    assert(n < size());
+    const char* p = &env_->data[0];
+    uint32_t sz = 0;
+    for (size_t i = 0; ; ++i)
+    {
+      ::memcpy(&sz, p, sizeof(sz));
+      p += sizeof(sz);
+      if (i == n)
+      {
+        break;
+      }
+      p += sz;
+    }
+    data = p;
+    return sz;
+  }
+
+  bool
+  operator==(const RouteHandle& lhs, const RouteHandle& rhs)
+  {
+    if (lhs.env_ == rhs.env_)
+    {
+      return true;
+    }
+    if (!lhs.env_ || !rhs.env_ || lhs.env_->hash != rhs.env_->hash)
+    {
+      return false;
+    }
+    const std::vector<char>& l = lhs.env_->data;
+    const std::vector<char>& r = rhs.env_->data;
+    return l.size() == r.size() && !::memcmp(&l[0], &r[0], l.size());
+  }
+
+  bool
+  operator<(const RouteHandle& lhs, const RouteHandle& rhs)
+  {
+    if (!lhs.env_ || !rhs.env_)
+    {
+      return !lhs.env_ && rhs.env_;
+    }
+    const std::vector<char>& l = lhs.env_->data;
+    const std::vector<char>& r = rhs.env_->data;
+    const int res = ::memcmp(&l[0], &r[0], std::min(l.size(), r.size()));
+    return res < 0 || (!res && l.size() < r.size());
+  }
+
+  ReplyTable::ReplyTable() :
+    last_ticket_(0)
+  {}
+
+  ReplyTable::Ticket
+  ReplyTable::add(const RouteHandle& route)
+  {
+    Ticket ticket = ++last_ticket_;
+    if (!ticket)
+    {
+      ticket = ++last_ticket_;
+    }
+    pending_.insert(std::make_pair(ticket, route));
+    return ticket;
+  }
+
+  const RouteHandle*
+  ReplyTable::find(Ticket ticket) const
+  {
+    Pending::const_iterator it = pending_.find(ticket);
+    return it == pending_.end() ? 0 : &it->second;
+  }
+
+  bool
+  ReplyTable::take(Ticket ticket, RouteHandle& route)
+  {
+    Pending::iterator it = pending_.find(ticket);
+    if (it == pending_.end())
+    {
+      return false;
+    }
+    route = it->second;
+    pending_.erase(it);
+    return true;
+  }
+
+  size_t
+  ReplyTable::erase(const RouteHandle& route)
+  {
+    size_t erased = 0;
+    for (Pending::iterator it = pending_.begin(); it != pending_.end(); )
+    {
+      if (it->second == route)
+      {
+        pending_.erase(it++);
+        ++erased;
+      }
+      else
+      {
+        ++it;
+      }
+    }
+    return erased;
+  }
+}
+
+#endif /* ZMQMESSAGE_ROUTEHANDLEFULLIMPL_HPP_ */
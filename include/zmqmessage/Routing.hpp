@@ -26,6 +26,9 @@ namespace ZmqMessage
     inline void
     receive_routing(zmq::socket_t& sock) {}
 
+    inline void
+    receive_routing(Transport& transport) {}
+
     inline
     Part*
     get_routing() const
@@ -62,6 +65,10 @@ namespace ZmqMessage
     receive_routing(zmq::socket_t& sock)
     throw (MessageFormatError, ZmqErrorType);
 
+    void
+    receive_routing(Transport& transport)
+    throw (MessageFormatError, ZmqErrorType);
+
     inline
     Part*
     get_routing()
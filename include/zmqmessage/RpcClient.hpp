@@ -0,0 +1,302 @@
+/**
+ * @file RpcClient.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_RPCCLIENT_HPP_
+#define ZMQMESSAGE_RPCCLIENT_HPP_
+
+#include <stdint.h>
+#include <climits>
+#include <vector>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/Part.hpp>
+#include <zmqmessage/Incoming.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Pipelined request/response client over XREQ (DEALER) socket.
+   *
+   * REQ socket allows one outstanding request. RpcClient sends
+   * up to @c window requests without waiting for responses,
+   * each one with envelope: correlation id part and empty delimiter.
+   * XREP server receives it as routing (Incoming<XRouting>)
+   * and Outgoing<XRouting> built from that Incoming sends it back,
+   * so existing servers need no changes:
+   * @code
+   * //server
+   * ZmqMessage::Incoming<ZmqMessage::XRouting> req(xrep_sock);
+   * req.receive_all();
+   * ZmqMessage::Outgoing<ZmqMessage::XRouting> rep(xrep_sock, req, 0);
+   * rep << ... << ZmqMessage::Flush;
+   *
+   * //client
+   * ZmqMessage::RpcClient client(xreq_sock, 100);
+   * ZmqMessage::RpcClient::Future result;
+   * client.call(request, result, 500000); //timeout 500 ms
+   * ...
+   * if (client.wait(result, -1) && !result.timed_out())
+   * {
+   *   ... result.parts() ...
+   * }
+   * @endcode
+   * Responses are matched to requests in any order, by id
+   * in open-addressed hash table sized for the window.
+   * Responses to unknown (timed out, cancelled) requests are dropped.
+   *
+   * Handlers are called from poll() (and wait()).
+   * RpcClient is to be used by one thread. It does not own socket
+   * and handlers, handlers must outlive requests pending.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC RpcClient : private Private::NonCopyable
+  {
+  public:
+    /**
+     * Correlation id of request, 0 is never used
+     */
+    typedef uint64_t RequestId;
+
+    /**
+     * Callback called once for each request: with response or on timeout
+     */
+    class ZMQMESSAGE_DLL_PUBLIC ResponseHandler
+    {
+    public:
+      virtual
+      ~ResponseHandler();
+
+      /**
+       * @param reply received completely, envelope parts are skipped
+       *  (response body starts at BODY_IDX, extraction starts there).
+       */
+      virtual
+      void
+      on_response(RequestId id, Incoming<SimpleRouting>& reply) = 0;
+
+      virtual
+      void
+      on_timeout(RequestId id) = 0;
+    };
+
+    /**
+     * Handler keeping response body parts to be used
+     * after poll() or wait() returns.
+     */
+    class ZMQMESSAGE_DLL_PUBLIC Future : public ResponseHandler
+    {
+    public:
+      Future();
+
+      /**
+       * @return if response is received or timed out
+       */
+      inline
+      bool
+      ready() const
+      {
+        return state_ != PENDING;
+      }
+
+      inline
+      bool
+      timed_out() const
+      {
+        return state_ == TIMED_OUT;
+      }
+
+      /**
+       * @return response body parts
+       */
+      inline
+      std::vector<Part>&
+      parts()
+      {
+        return parts_;
+      }
+
+      void
+      on_response(RequestId id, Incoming<SimpleRouting>& reply);
+
+      void
+      on_timeout(RequestId id);
+
+    private:
+      enum State
+      {
+        PENDING, RECEIVED, TIMED_OUT
+      };
+
+      State state_;
+      std::vector<Part> parts_;
+    };
+
+    struct Stats
+    {
+      uint64_t requests; //!< requests sent
+      uint64_t responses; //!< responses matched
+      uint64_t timeouts; //!< requests timed out
+      uint64_t unmatched; //!< responses dropped (late or malformed)
+      uint64_t rejected; //!< calls rejected because window is full
+
+      Stats();
+    };
+
+    static const size_t DEFAULT_WINDOW = 64;
+
+    /**
+     * Index of first body part in response (after envelope)
+     */
+    static const size_t BODY_IDX = 2;
+
+    /**
+     * @param window max number of requests waiting for response
+     */
+    explicit
+    RpcClient(zmq::socket_t& sock, size_t window = DEFAULT_WINDOW);
+
+    /**
+     * Send request with parts of multipart from @c idx_from
+     * to @c idx_to - 1 (shared with zmq_msg_copy).
+     * Sending blocks if socket would block.
+     * @param timeout microseconds to wait for response, -1 means infinite
+     * @return id of request or 0 if window is full
+     *  (request is not sent, poll() for responses first)
+     */
+    RequestId
+    call(Multipart& request, ResponseHandler& handler, long timeout = -1,
+      size_t idx_from = 0, size_t idx_to = UINT_MAX)
+      throw(ZmqErrorType, NoSuchPartError);
+
+    /**
+     * Send request with given parts (shared with zmq_msg_copy),
+     * e.g. kept to be sent again.
+     * @return id of request or 0 if window is full
+     */
+    RequestId
+    call(std::vector<Part>& request, ResponseHandler& handler,
+      long timeout = -1) throw(ZmqErrorType);
+
+    /**
+     * Forget request: handler is not called, response is dropped
+     * @return false if request is not pending
+     */
+    bool
+    cancel(RequestId id);
+
+    /**
+     * @return number of requests waiting for response
+     */
+    inline
+    size_t
+    in_flight() const
+    {
+      return size_;
+    }
+
+    /**
+     * Wait for responses up to @c timeout (microseconds as in zmq_poll,
+     * -1 means infinite) or first request timeout,
+     * then call handlers of responses received and requests timed out.
+     * @return number of handlers called
+     */
+    size_t
+    poll(long timeout) throw(ZmqErrorType);
+
+    /**
+     * Poll until future is ready or @c timeout expires
+     * @return future.ready()
+     */
+    bool
+    wait(Future& future, long timeout) throw(ZmqErrorType);
+
+    inline
+    const Stats&
+    stats() const
+    {
+      return stats_;
+    }
+
+    inline
+    zmq::socket_t&
+    socket()
+    {
+      return sock_;
+    }
+
+  private:
+    struct Slot
+    {
+      RequestId id; //!< 0 if slot is free
+      ResponseHandler* handler;
+      uint64_t expires; //!< microseconds, NEVER for no timeout
+    };
+
+    static const uint64_t NEVER = ~static_cast<uint64_t>(0);
+
+    zmq::socket_t& sock_;
+
+    const size_t window_;
+
+    std::vector<Slot> slots_; //!< power of 2 >= 2 * window
+
+    size_t size_;
+
+    RequestId last_id_;
+
+    uint64_t next_expiry_; //!< no request expires before
+
+    Stats stats_;
+
+    template <class Parts>
+    ZMQMESSAGE_DLL_LOCAL
+    RequestId
+    do_call(Parts& request, size_t idx_from, size_t idx_to,
+      ResponseHandler& handler, long timeout);
+
+    ZMQMESSAGE_DLL_LOCAL
+    static
+    bool
+    sent_before(const Slot& lhs, const Slot& rhs);
+
+    ZMQMESSAGE_DLL_LOCAL
+    Slot*
+    find(RequestId id);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    insert(const Slot& slot);
+
+    /**
+     * Free slot, shifting back slots of its probe sequence
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    erase(Slot* slot);
+
+    /**
+     * Receive one response and call its handler
+     * @return if handler is called
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    bool
+    receive_response() throw(ZmqErrorType);
+
+    /**
+     * Call handlers of requests timed out
+     * @return number of handlers called
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    size_t
+    expire() throw(ZmqErrorType);
+  };
+}
+
+#endif /* ZMQMESSAGE_RPCCLIENT_HPP_ */
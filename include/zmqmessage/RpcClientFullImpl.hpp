@@ -0,0 +1,301 @@
+/**
+ * @file RpcClientFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of RpcClient methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_RPCCLIENTFULLIMPL_HPP_
+#define ZMQMESSAGE_RPCCLIENTFULLIMPL_HPP_
+
+#include <cstring>
+#include <algorithm>
+
+namespace ZmqMessage
+{
+  RpcClient::ResponseHandler::~ResponseHandler()
+  {}
+
+  RpcClient::Future::Future() :
+    state_(PENDING)
+  {}
+
+  void
+  RpcClient::Future::on_response(RequestId, Incoming<SimpleRouting>& reply)
+  {
+    for (size_t i = BODY_IDX; i < reply.size(); ++i)
+    {
+      parts_.push_back(Part());
+      parts_.back().move(reply[i]);
+    }
+    state_ = RECEIVED;
+  }
+
+  void
+  RpcClient::Future::on_timeout(RequestId)
+  {
+    state_ = TIMED_OUT;
+  }
+
+  RpcClient::Stats::Stats() :
+    requests(0), responses(0), timeouts(0), unmatched(0), rejected(0)
+  {}
+
+  RpcClient::RpcClient(zmq::socket_t& sock, size_t window) :
+    sock_(sock), window_(std::max(window, static_cast<size_t>(1))),
+    size_(0), last_id_(0), next_expiry_(NEVER)
+  {
+    size_t capacity = 2;
+    while (capacity < 2 * window_)
+    {
+      capacity *= 2;
+    }
+    const Slot free_slot = {0, 0, NEVER};
+    slots_.resize(capacity, free_slot);
+  }
+
+  bool
+  RpcClient::sent_before(const Slot& lhs, const Slot& rhs)
+  {
+    return lhs.id < rhs.id;
+  }
+
+  RpcClient::Slot*
+  RpcClient::find(RequestId id)
+  {
+    const size_t mask = slots_.size() - 1;
+    //ids are sequential, so low bits spread them well
+    for (size_t i = id & mask; slots_[i].id; i = (i + 1) & mask)
+    {
+      if (slots_[i].id == id)
+      {
+        return &slots_[i];
+      }
+    }
+    return 0;
+  }
+
+  void
+  RpcClient::insert(const Slot& slot)
+  {
+    const size_t mask = slots_.size() - 1;
+    size_t i = slot.id & mask;
+    while (slots_[i].id)
+    {
+      i = (i + 1) & mask;
+    }
+    slots_[i] = slot;
+    ++size_;
+    if (slot.expires < next_expiry_)
+    {
+      next_expiry_ = slot.expires;
+    }
+  }
+
+  void
+  RpcClient::erase(Slot* slot)
+  {
+    const size_t mask = slots_.size() - 1;
+    size_t i = slot - &slots_[0];
+    for (size_t j = i; ; )
+    {
+      slots_[i].id = 0;
+      for (;;)
+      {
+        j = (j + 1) & mask;
+        if (!slots_[j].id)
+        {
+          --size_;
+          return;
+        }
+        //slot j stays if its home is cyclically in (i, j]
+        const size_t home = slots_[j].id & mask;
+        if (!(i <= j ? (i < home && home <= j) : (i < home || home <= j)))
+        {
+          break;
+        }
+      }
+      slots_[i] = slots_[j];
+      i = j;
+    }
+  }
+
+  template <class Parts>
+  RpcClient::RequestId
+  RpcClient::do_call(Parts& request, size_t idx_from, size_t idx_to,
+    ResponseHandler& handler, long timeout)
+  {
+    if (size_ >= window_)
+    {
+      ++stats_.rejected;
+      return 0;
+    }
+    RequestId id = ++last_id_;
+    if (!id)
+    {
+      id = ++last_id_;
+    }
+
+    Outgoing<SimpleRouting> out(sock_, 0);
+    Part id_part(sizeof(id));
+    ::memcpy(id_part.msg().data(), &id, sizeof(id));
+    out << id_part;
+    Part delimiter;
+    out << delimiter;
+    const size_t to = std::min(idx_to, static_cast<size_t>(request.size()));
+    for (size_t i = idx_from; i < to; ++i)
+    {
+      Part part;
+      part.copy(request[i]);
+      out << part;
+    }
+    out.flush();
+
+    const Slot slot = {id, &handler,
+      timeout < 0 ? NEVER : monotonic_usec() + timeout};
+    insert(slot);
+    ++stats_.requests;
+    return id;
+  }
+
+  RpcClient::RequestId
+  RpcClient::call(Multipart& request, ResponseHandler& handler, long timeout,
+    size_t idx_from, size_t idx_to)
+    throw(ZmqErrorType, NoSuchPartError)
+  {
+    return do_call(request, idx_from, idx_to, handler, timeout);
+  }
+
+  RpcClient::RequestId
+  RpcClient::call(std::vector<Part>& request, ResponseHandler& handler,
+    long timeout) throw(ZmqErrorType)
+  {
+    return do_call(request, 0, request.size(), handler, timeout);
+  }
+
+  bool
+  RpcClient::cancel(RequestId id)
+  {
+    Slot* slot = find(id);
+    if (!slot)
+    {
+      return false;
+    }
+    erase(slot);
+    return true;
+  }
+
+  bool
+  RpcClient::receive_response() throw(ZmqErrorType)
+  {
+    Incoming<SimpleRouting> reply(sock_);
+    try
+    {
+      reply.receive_all(BODY_IDX);
+    }
+    catch (const MessageFormatError&)
+    {
+      ++stats_.unmatched;
+      return false;
+    }
+
+    RequestId id = 0;
+    Slot* slot = 0;
+    if (reply[0].msg().size() == sizeof(id) && !reply[1].msg().size())
+    {
+      ::memcpy(&id, reply[0].msg().data(), sizeof(id));
+      slot = find(id);
+    }
+    if (!slot)
+    {
+      ++stats_.unmatched;
+      return false;
+    }
+    ResponseHandler* handler = slot->handler;
+    erase(slot);
+    ++stats_.responses;
+
+    reply >> ZmqMessage::Skip >> ZmqMessage::Skip;
+    handler->on_response(id, reply);
+    return true;
+  }
+
+  size_t
+  RpcClient::expire() throw(ZmqErrorType)
+  {
+    const uint64_t now = monotonic_usec();
+    if (now < next_expiry_)
+    {
+      return 0;
+    }
+
+    std::vector<Slot> expired;
+    next_expiry_ = NEVER;
+    for (size_t i = 0; i < slots_.size(); )
+    {
+      Slot& slot = slots_[i];
+      if (slot.id && slot.expires <= now)
+      {
+        expired.push_back(slot);
+        erase(&slot); //next slot may be shifted here
+        continue;
+      }
+      if (slot.id && slot.expires < next_expiry_)
+      {
+        next_expiry_ = slot.expires;
+      }
+      ++i;
+    }
+
+    std::sort(expired.begin(), expired.end(), &RpcClient::sent_before);
+    for (size_t i = 0; i < expired.size(); ++i)
+    {
+      ++stats_.timeouts;
+      expired[i].handler->on_timeout(expired[i].id);
+    }
+    return expired.size();
+  }
+
+  size_t
+  RpcClient::poll(long timeout) throw(ZmqErrorType)
+  {
+    size_t calls = expire();
+    if (next_expiry_ != NEVER)
+    {
+      const uint64_t now = monotonic_usec();
+      const long left = next_expiry_ > now ?
+        static_cast<long>(next_expiry_ - now) : 0;
+      if (timeout < 0 || left < timeout)
+      {
+        timeout = left;
+      }
+    }
+    if (calls)
+    {
+      timeout = 0;
+    }
+
+    for (bool ready = wait_readable(sock_, timeout); ready;
+         ready = wait_readable(sock_, 0))
+    {
+      calls += receive_response();
+    }
+    return calls + expire();
+  }
+
+  bool
+  RpcClient::wait(Future& future, long timeout) throw(ZmqErrorType)
+  {
+    const Deadline deadline(timeout);
+    while (!future.ready() && !deadline.expired())
+    {
+      poll(deadline.remaining());
+    }
+    return future.ready();
+  }
+}
+
+#endif /* ZMQMESSAGE_RPCCLIENTFULLIMPL_HPP_ */
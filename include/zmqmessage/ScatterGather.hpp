@@ -0,0 +1,288 @@
+/**
+ * @file ScatterGather.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_SCATTERGATHER_HPP_
+#define ZMQMESSAGE_SCATTERGATHER_HPP_
+
+#include <stdint.h>
+#include <climits>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/Part.hpp>
+#include <zmqmessage/RpcClient.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Request sent to several backends, completed by first replies.
+   *
+   * Every backend is XREQ socket served by RpcClient
+   * (so servers are usual XREP ones, see RpcClient).
+   * Request is sent to @c fanout backends (round-robin)
+   * and completed when @c needed replies are received:
+   * fanout K and needed 1 takes the fastest of K replies,
+   * needed M gathers M replies (quorum).
+   * Parts of request are shared by all copies (zmq_msg_copy).
+   *
+   * Hedging (see set_hedging()) cuts tail latency cheaper:
+   * request is sent to one backend (fanout 1), and if reply does not come
+   * in time usual for most requests (percentile of recent reply latencies),
+   * duplicate is sent to the next backend. First reply wins.
+   *
+   * When request is completed (or timed out), copies still pending
+   * are cancelled: their replies are dropped by correlation id.
+   * @code
+   * ZmqMessage::ScatterGather sg;
+   * sg.add(backend1);
+   * sg.add(backend2);
+   * sg.set_hedging(95, 1000); //duplicate after p95 latency, >= 1 ms
+   * sg.send(request, handler, 1, 1, 100000);
+   * ...
+   * sg.poll(-1); //handler is called
+   * @endcode
+   * ScatterGather is to be used by one thread.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC ScatterGather : private Private::NonCopyable
+  {
+  public:
+    typedef uint64_t RequestId;
+
+    class ZMQMESSAGE_DLL_PUBLIC Handler
+    {
+    public:
+      virtual
+      ~Handler();
+
+      /**
+       * One of first @c needed replies
+       * @param backend index of backend replied
+       * @param reply received completely, extraction starts from body
+       *  (see RpcClient::ResponseHandler)
+       */
+      virtual
+      void
+      on_reply(RequestId id, size_t backend,
+        Incoming<SimpleRouting>& reply) = 0;
+
+      /**
+       * Request is completed: @c replies is @c needed,
+       * or less if request timed out
+       */
+      virtual
+      void
+      on_done(RequestId id, size_t replies) = 0;
+    };
+
+    struct Stats
+    {
+      uint64_t requests; //!< requests sent
+      uint64_t completed; //!< requests got all replies needed
+      uint64_t timeouts; //!< requests timed out
+      uint64_t hedges; //!< duplicates sent by hedging
+      uint64_t hedge_wins; //!< duplicates replied first
+
+      Stats();
+    };
+
+    static const size_t DEFAULT_WINDOW = 64;
+
+    /**
+     * @param window max requests in flight per backend
+     */
+    explicit
+    ScatterGather(size_t window = DEFAULT_WINDOW);
+
+    /**
+     * Pending requests are dropped, handlers are not called
+     */
+    ~ScatterGather();
+
+    /**
+     * Add backend XREQ socket
+     * @return index of backend
+     */
+    size_t
+    add(zmq::socket_t& sock);
+
+    /**
+     * @return number of backends
+     */
+    inline
+    size_t
+    size() const
+    {
+      return backends_.size();
+    }
+
+    /**
+     * Send duplicate of request not completed in time
+     * (to backend not used by request yet).
+     * @param percentile of recent reply latencies to wait for
+     *  (e.g. 95), 0 disables hedging
+     * @param min_delay microseconds to wait at least
+     */
+    void
+    set_hedging(unsigned percentile, long min_delay = 0);
+
+    /**
+     * @return current delay of hedging, microseconds (-1 if disabled)
+     */
+    long
+    hedge_delay() const;
+
+    /**
+     * Send parts of multipart from @c idx_from to @c idx_to - 1
+     * to @c fanout backends.
+     * @param needed number of replies to complete request,
+     *  no more than copies sent (fanout and hedge duplicate,
+     *  if backends have room in windows)
+     * @param timeout microseconds to wait for replies, -1 means infinite
+     * @return id of request or 0 if it could not be sent
+     *  (all backends have full windows)
+     */
+    RequestId
+    send(Multipart& request, Handler& handler,
+      size_t fanout = 1, size_t needed = 1, long timeout = -1,
+      size_t idx_from = 0, size_t idx_to = UINT_MAX)
+      throw(ZmqErrorType, NoSuchPartError);
+
+    /**
+     * @return number of requests not completed
+     */
+    inline
+    size_t
+    pending() const
+    {
+      return calls_.size();
+    }
+
+    /**
+     * Wait for replies up to @c timeout (microseconds as in zmq_poll,
+     * -1 means infinite) or next hedge or timeout, then call handlers.
+     * @return number of requests completed (or timed out)
+     */
+    size_t
+    poll(long timeout) throw(ZmqErrorType);
+
+    inline
+    const Stats&
+    stats() const
+    {
+      return stats_;
+    }
+
+  private:
+    struct Call;
+
+    /**
+     * Copy of request sent to one backend
+     */
+    struct Copy : public RpcClient::ResponseHandler
+    {
+      ScatterGather* owner;
+      Call* call;
+      size_t backend;
+      RpcClient::RequestId id;
+      uint64_t sent;
+      bool hedge;
+
+      void
+      on_response(RpcClient::RequestId id, Incoming<SimpleRouting>& reply);
+
+      void
+      on_timeout(RpcClient::RequestId id);
+    };
+
+    struct Call
+    {
+      RequestId id;
+      Handler* handler;
+      std::vector<Part> parts; //!< shared with copies sent
+      std::deque<Copy> copies; //!< stable addresses
+      size_t first; //!< first backend used
+      size_t tried; //!< backends tried
+      size_t needed;
+      size_t replies;
+      uint64_t hedge_at;
+      uint64_t expires;
+    };
+
+    typedef std::map<RequestId, Call*> Calls;
+
+    enum
+    {
+      SAMPLES = 128, //!< recent reply latencies kept
+      RECALC = 16 //!< hedge delay is recalculated every RECALC samples
+    };
+
+    static const uint64_t NEVER = ~static_cast<uint64_t>(0);
+
+    std::vector<RpcClient*> backends_; //!< owned
+
+    const size_t window_;
+
+    Calls calls_; //!< owned
+
+    std::vector<Call*> done_; //!< owned, deleted after handlers return
+
+    RequestId last_id_;
+
+    size_t next_backend_;
+
+    unsigned percentile_;
+
+    uint64_t min_delay_;
+
+    std::vector<uint64_t> samples_; //!< ring of reply latencies
+
+    uint64_t samples_count_;
+
+    uint64_t hedge_delay_;
+
+    Stats stats_;
+
+    /**
+     * Send copy of request to next backend not tried yet
+     * @return false if there is no backend to send to
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    bool
+    send_copy(Call& call, uint64_t now, bool hedge) throw(ZmqErrorType);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    received(Copy& copy, Incoming<SimpleRouting>& reply);
+
+    /**
+     * Cancel copies pending and call handler
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    finish(Call& call);
+
+    /**
+     * Send duplicates and finish requests timed out
+     * @return time of next check
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    uint64_t
+    check(uint64_t now) throw(ZmqErrorType);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    add_sample(uint64_t latency);
+  };
+}
+
+#endif /* ZMQMESSAGE_SCATTERGATHER_HPP_ */
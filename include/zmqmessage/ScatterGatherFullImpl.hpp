@@ -0,0 +1,316 @@
+/**
+ * @file ScatterGatherFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of ScatterGather methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_SCATTERGATHERFULLIMPL_HPP_
+#define ZMQMESSAGE_SCATTERGATHERFULLIMPL_HPP_
+
+#include <algorithm>
+#include <memory>
+
+namespace ZmqMessage
+{
+  ScatterGather::Handler::~Handler()
+  {}
+
+  ScatterGather::Stats::Stats() :
+    requests(0), completed(0), timeouts(0), hedges(0), hedge_wins(0)
+  {}
+
+  void
+  ScatterGather::Copy::on_response(
+    RpcClient::RequestId, Incoming<SimpleRouting>& reply)
+  {
+    owner->received(*this, reply);
+  }
+
+  void
+  ScatterGather::Copy::on_timeout(RpcClient::RequestId)
+  {
+    //copies are sent without timeout, request timeout is ours
+  }
+
+  ScatterGather::ScatterGather(size_t window) :
+    window_(window), last_id_(0), next_backend_(0),
+    percentile_(0), min_delay_(0), samples_(SAMPLES),
+    samples_count_(0), hedge_delay_(0)
+  {}
+
+  ScatterGather::~ScatterGather()
+  {
+    for (Calls::iterator it = calls_.begin(); it != calls_.end(); ++it)
+    {
+      delete it->second;
+    }
+    for (size_t i = 0; i < done_.size(); ++i)
+    {
+      delete done_[i];
+    }
+    for (size_t i = 0; i < backends_.size(); ++i)
+    {
+      delete backends_[i];
+    }
+  }
+
+  size_t
+  ScatterGather::add(zmq::socket_t& sock)
+  {
+    std::auto_ptr<RpcClient> backend(new RpcClient(sock, window_));
+    backends_.push_back(backend.get());
+    backend.release();
+    return backends_.size() - 1;
+  }
+
+  void
+  ScatterGather::set_hedging(unsigned percentile, long min_delay)
+  {
+    percentile_ = std::min(percentile, 100U);
+    min_delay_ = min_delay > 0 ? min_delay : 0;
+    hedge_delay_ = min_delay_;
+    samples_count_ = 0;
+  }
+
+  long
+  ScatterGather::hedge_delay() const
+  {
+    return percentile_ ? static_cast<long>(hedge_delay_) : -1;
+  }
+
+  void
+  ScatterGather::add_sample(uint64_t latency)
+  {
+    samples_[samples_count_++ % SAMPLES] = latency;
+    if (!percentile_ || samples_count_ % RECALC)
+    {
+      return;
+    }
+    std::vector<uint64_t> sorted(samples_.begin(),
+      samples_.begin() + std::min(samples_count_, static_cast<uint64_t>(SAMPLES)));
+    const size_t n = std::min(sorted.size() * percentile_ / 100,
+      sorted.size() - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + n, sorted.end());
+    hedge_delay_ = std::max(sorted[n], min_delay_);
+  }
+
+  bool
+  ScatterGather::send_copy(Call& call, uint64_t now, bool hedge)
+    throw(ZmqErrorType)
+  {
+    while (call.tried < backends_.size())
+    {
+      const size_t backend = (call.first + call.tried++) % backends_.size();
+      Copy copy;
+      copy.owner = this;
+      copy.call = &call;
+      copy.backend = backend;
+      copy.id = 0;
+      copy.sent = now;
+      copy.hedge = hedge;
+      call.copies.push_back(copy);
+      call.copies.back().id =
+        backends_[backend]->call(call.parts, call.copies.back());
+      if (call.copies.back().id)
+      {
+        return true;
+      }
+      call.copies.pop_back(); //window is full, try next one
+    }
+    return false;
+  }
+
+  ScatterGather::RequestId
+  ScatterGather::send(Multipart& request, Handler& handler,
+    size_t fanout, size_t needed, long timeout,
+    size_t idx_from, size_t idx_to)
+    throw(ZmqErrorType, NoSuchPartError)
+  {
+    if (backends_.empty())
+    {
+      return 0;
+    }
+    const uint64_t now = monotonic_usec();
+    std::auto_ptr<Call> call(new Call);
+    call->handler = &handler;
+    call->first = next_backend_++ % backends_.size();
+    call->tried = 0;
+    call->needed = std::max(needed, static_cast<size_t>(1));
+    call->replies = 0;
+    call->hedge_at = (percentile_ && fanout < backends_.size()) ?
+      now + hedge_delay_ : NEVER;
+    call->expires = timeout < 0 ? NEVER : now + timeout;
+
+    const size_t to = std::min(idx_to, request.size());
+    for (size_t i = idx_from; i < to; ++i)
+    {
+      call->parts.push_back(Part());
+      call->parts.back().copy(request[i]);
+    }
+
+    fanout = std::min(std::max(fanout, static_cast<size_t>(1)),
+      backends_.size());
+    while (call->copies.size() < fanout && send_copy(*call, now, false))
+    {}
+    if (call->copies.empty())
+    {
+      return 0;
+    }
+    //no more replies than copies sent and the hedge
+    const bool may_hedge = call->hedge_at != NEVER &&
+      call->tried < backends_.size();
+    call->needed = std::min(call->needed,
+      call->copies.size() + (may_hedge ? 1 : 0));
+
+    call->id = ++last_id_;
+    if (!call->id)
+    {
+      call->id = ++last_id_;
+    }
+    calls_.insert(std::make_pair(call->id, call.get()));
+    ++stats_.requests;
+    return call.release()->id;
+  }
+
+  void
+  ScatterGather::received(Copy& copy, Incoming<SimpleRouting>& reply)
+  {
+    add_sample(monotonic_usec() - copy.sent);
+    copy.id = 0;
+    Call& call = *copy.call;
+    if (call.replies >= call.needed)
+    {
+      return; //finished already
+    }
+    if (copy.hedge && !call.replies)
+    {
+      ++stats_.hedge_wins;
+    }
+    ++call.replies;
+    call.handler->on_reply(call.id, copy.backend, reply);
+    if (call.replies >= call.needed)
+    {
+      finish(call);
+    }
+  }
+
+  void
+  ScatterGather::finish(Call& call)
+  {
+    for (size_t i = 0; i < call.copies.size(); ++i)
+    {
+      Copy& copy = call.copies[i];
+      if (copy.id)
+      {
+        backends_[copy.backend]->cancel(copy.id);
+        copy.id = 0;
+      }
+    }
+    calls_.erase(call.id);
+    done_.push_back(&call);
+    if (call.replies >= call.needed)
+    {
+      ++stats_.completed;
+    }
+    else
+    {
+      ++stats_.timeouts;
+    }
+    call.handler->on_done(call.id, call.replies);
+  }
+
+  uint64_t
+  ScatterGather::check(uint64_t now) throw(ZmqErrorType)
+  {
+    uint64_t next = NEVER;
+    for (Calls::iterator it = calls_.begin(); it != calls_.end(); )
+    {
+      Call& call = *(it++)->second;
+      if (call.expires <= now)
+      {
+        finish(call);
+        continue;
+      }
+      if (call.hedge_at <= now)
+      {
+        call.hedge_at = NEVER;
+        if (send_copy(call, now, true))
+        {
+          ++stats_.hedges;
+        }
+        else if (call.replies >= call.copies.size())
+        {
+          //all copies replied, no more to wait for
+          call.needed = call.replies;
+          finish(call);
+          continue;
+        }
+        else
+        {
+          call.needed = std::min(call.needed, call.copies.size());
+        }
+      }
+      next = std::min(next, std::min(call.hedge_at, call.expires));
+    }
+    return next;
+  }
+
+  size_t
+  ScatterGather::poll(long timeout) throw(ZmqErrorType)
+  {
+    const uint64_t finished = stats_.completed + stats_.timeouts;
+    const uint64_t now = monotonic_usec();
+    const uint64_t next = check(now);
+    if (stats_.completed + stats_.timeouts != finished)
+    {
+      timeout = 0;
+    }
+    else if (next != NEVER)
+    {
+      const long left = static_cast<long>(next > now ? next - now : 0);
+      if (timeout < 0 || left < timeout)
+      {
+        timeout = left;
+      }
+    }
+
+    std::vector<zmq::pollitem_t> items(backends_.size());
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+      items[i].socket = backends_[i]->socket();
+      items[i].fd = 0;
+      items[i].events = ZMQ_POLLIN;
+      items[i].revents = 0;
+    }
+    int rc = 0;
+    try
+    {
+      rc = items.empty() ? 0 : zmq::poll(&items[0], items.size(), timeout);
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+    for (size_t i = 0; rc > 0 && i < items.size(); ++i)
+    {
+      if (items[i].revents & ZMQ_POLLIN)
+      {
+        backends_[i]->poll(0);
+      }
+    }
+    check(monotonic_usec());
+
+    for (size_t i = 0; i < done_.size(); ++i)
+    {
+      delete done_[i];
+    }
+    done_.clear();
+    return stats_.completed + stats_.timeouts - finished;
+  }
+}
+
+#endif /* ZMQMESSAGE_SCATTERGATHERFULLIMPL_HPP_ */
@@ -0,0 +1,169 @@
+/**
+ * @file ShardedSink.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_SHARDEDSINK_HPP_
+#define ZMQMESSAGE_SHARDEDSINK_HPP_
+
+#include <stdint.h>
+#include <climits>
+#include <vector>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/OutOptions.hpp>
+#include <zmqmessage/Destination.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Spreads messages across N destination sockets (shards) by key.
+   *
+   * Key is taken from message part (by index) or computed by callback.
+   * Shard is chosen with jump consistent hash of the key,
+   * so messages with the same key always go to the same shard,
+   * and adding shard N+1 moves only 1/(N+1) of keys to it.
+   *
+   * Every shard keeps its own would-block state, as in FanOut:
+   * with OutOptions::DROP_ON_BLOCK message is dropped,
+   * with OutOptions::CACHE_ON_BLOCK it's queued and resent in order
+   * on next send to the shard or flush_queued().
+   * Per shard counters (DestinationStats) show hot shards.
+   *
+   * @code
+   * ZmqMessage::ShardedSink shards(ZmqMessage::OutOptions::CACHE_ON_BLOCK);
+   * shards.add(push1);
+   * shards.add(push2);
+   * ...
+   * incoming.receive_all();
+   * shards.send(incoming, 0); //part 0 holds the key
+   * @endcode
+   * Message parts are shared with given multipart (zmq_msg_copy),
+   * which stays intact.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC ShardedSink : private Private::NonCopyable
+  {
+  public:
+    typedef DestinationStats Stats;
+
+    static const size_t DEFAULT_MAX_QUEUED = 1000;
+
+    /**
+     * @param options OutOptions flags of all shards
+     * @param max_queued max number of messages queued per shard
+     */
+    explicit
+    ShardedSink(unsigned options = OutOptions::CACHE_ON_BLOCK,
+      size_t max_queued = DEFAULT_MAX_QUEUED);
+
+    /**
+     * Deletes queued messages
+     */
+    ~ShardedSink();
+
+    /**
+     * Add shard socket. Shards must be added in the same order
+     * to keep key to shard mapping.
+     * @return index of shard
+     */
+    size_t
+    add(zmq::socket_t& sock);
+
+    /**
+     * @return number of shards
+     */
+    inline
+    size_t
+    size() const
+    {
+      return shards_.size();
+    }
+
+    /**
+     * @return 64-bit hash of key (FNV-1a)
+     */
+    static
+    uint64_t
+    hash(const void* data, size_t sz);
+
+    /**
+     * Jump consistent hash.
+     * @return shard index for key hash (0 if @c shards is 0)
+     */
+    static
+    size_t
+    shard_of(uint64_t key, size_t shards);
+
+    /**
+     * Send parts of multipart from @c idx_from to @c idx_to - 1
+     * to the shard chosen by content of part @c key_idx.
+     * @return shard index
+     */
+    size_t
+    send(Multipart& multipart, size_t key_idx,
+      size_t idx_from = 0, size_t idx_to = UINT_MAX)
+      throw(ZmqErrorType, NoSuchPartError);
+
+    /**
+     * Send parts of multipart to the shard chosen by key hash
+     * computed by @c key_fn.
+     * @tparam KeyFn functor: uint64_t (Multipart&), see hash()
+     * @return shard index
+     */
+    template <class KeyFn>
+    size_t
+    send_by(Multipart& multipart, KeyFn key_fn,
+      size_t idx_from = 0, size_t idx_to = UINT_MAX)
+      throw(ZmqErrorType, NoSuchPartError);
+
+    /**
+     * Send parts of multipart to given shard.
+     * All send methods throw (EINVAL) if shard does not exist
+     * (e.g. no shards are added).
+     * @return false if message is queued or dropped
+     */
+    bool
+    send_to(size_t shard, Multipart& multipart,
+      size_t idx_from = 0, size_t idx_to = UINT_MAX)
+      throw(ZmqErrorType, NoSuchPartError);
+
+    /**
+     * Try to resend queued messages.
+     * @return number of messages still queued
+     */
+    size_t
+    flush_queued() throw(ZmqErrorType);
+
+    /**
+     * @return number of messages queued for shard
+     */
+    inline
+    size_t
+    queued(size_t shard) const
+    {
+      return shards_[shard]->queued();
+    }
+
+    inline
+    const Stats&
+    stats(size_t shard) const
+    {
+      return shards_[shard]->stats();
+    }
+
+  private:
+    std::vector<Private::Destination*> shards_; //!< owned
+
+    const unsigned options_;
+
+    const size_t max_queued_;
+  };
+}
+
+#endif /* ZMQMESSAGE_SHARDEDSINK_HPP_ */
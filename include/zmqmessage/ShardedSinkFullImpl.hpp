@@ -0,0 +1,109 @@
+/**
+ * @file ShardedSinkFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of ShardedSink methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_SHARDEDSINKFULLIMPL_HPP_
+#define ZMQMESSAGE_SHARDEDSINKFULLIMPL_HPP_
+
+#include <cerrno>
+#include <memory>
+
+namespace ZmqMessage
+{
+  ShardedSink::ShardedSink(unsigned options, size_t max_queued) :
+    options_(options), max_queued_(max_queued)
+  {}
+
+  ShardedSink::~ShardedSink()
+  {
+    for (size_t i = 0; i < shards_.size(); ++i)
+    {
+      delete shards_[i];
+    }
+  }
+
+  size_t
+  ShardedSink::add(zmq::socket_t& sock)
+  {
+    std::auto_ptr<Private::Destination> shard(
+      new Private::Destination(sock, options_, max_queued_));
+    shards_.push_back(shard.get());
+    shard.release();
+    return shards_.size() - 1;
+  }
+
+  uint64_t
+  ShardedSink::hash(const void* data, size_t sz)
+  {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < sz; ++i)
+    {
+      h ^= p[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  size_t
+  ShardedSink::shard_of(uint64_t key, size_t shards)
+  {
+    //Lamping, Veach: "A Fast, Minimal Memory, Consistent Hash Algorithm"
+    int64_t b = -1;
+    int64_t j = 0;
+    while (j < static_cast<int64_t>(shards))
+    {
+      b = j;
+      key = key * 2862933555777941757ULL + 1;
+      j = static_cast<int64_t>((b + 1) *
+        (static_cast<double>(1LL << 31) /
+          static_cast<double>((key >> 33) + 1)));
+    }
+    return b < 0 ? 0 : static_cast<size_t>(b);
+  }
+
+  bool
+  ShardedSink::send_to(size_t shard, Multipart& multipart,
+    size_t idx_from, size_t idx_to)
+    throw(ZmqErrorType, NoSuchPartError)
+  {
+    if (shard >= shards_.size())
+    {
+      //no shards added or wrong index
+      errno = EINVAL;
+      throw_zmq_exception(zmq::error_t());
+    }
+    return shards_[shard]->send(multipart, idx_from, idx_to);
+  }
+
+  size_t
+  ShardedSink::send(Multipart& multipart, size_t key_idx,
+    size_t idx_from, size_t idx_to)
+    throw(ZmqErrorType, NoSuchPartError)
+  {
+    zmq::message_t& key = multipart[key_idx].msg();
+    const size_t shard = shard_of(hash(key.data(), key.size()), size());
+    send_to(shard, multipart, idx_from, idx_to);
+    return shard;
+  }
+
+  size_t
+  ShardedSink::flush_queued() throw(ZmqErrorType)
+  {
+    size_t queued = 0;
+    for (size_t i = 0; i < shards_.size(); ++i)
+    {
+      shards_[i]->flush();
+      queued += shards_[i]->queued();
+    }
+    return queued;
+  }
+}
+
+#endif /* ZMQMESSAGE_SHARDEDSINKFULLIMPL_HPP_ */
@@ -0,0 +1,191 @@
+/**
+ * @file ShmCodec.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Passing large parts between local processes through shared memory.
+ * See \ref zm_codec "compression".
+ */
+
+#ifndef ZMQMESSAGE_SHMCODEC_HPP_
+#define ZMQMESSAGE_SHMCODEC_HPP_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/PartCodec.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Side channel for large parts: payload is written
+   * to shared memory segment, only small descriptor is sent.
+   *
+   * Producer codec (set to Sink) creates POSIX shared memory segment
+   * @c name and copies parts above threshold into ring of blocks in it,
+   * replacing them with descriptor (PartCodec header, token of segment
+   * and offset of block). Consumer codec (set to Incoming) maps the same
+   * segment and turns descriptor into zero-copy part pointing into it.
+   * Block is given back to producer when that part is released
+   * (destroyed with Incoming, or after being sent further).
+   * Consumer decodes parts as soon as they are received
+   * (see decode_on_receive()), so blocks of parts never accessed
+   * are released too.
+   *
+   * Part is sent as is if it's smaller than threshold or the ring
+   * has no room for it (counted in Stats::skipped),
+   * so producer never blocks waiting for consumer.
+   * @code
+   * ZmqMessage::ShmCodec shm("/quotes", 64 * 1024 * 1024);
+   * ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(sock, 0);
+   * if (ZmqMessage::ShmCodec::is_local(endpoint))
+   * {
+   *   out.set_codec(&shm);
+   * }
+   * ...
+   * //other process
+   * ZmqMessage::ShmCodec shm("/quotes");
+   * ZmqMessage::Incoming<ZmqMessage::SimpleRouting> incoming(sock);
+   * incoming.set_codec(&shm);
+   * @endcode
+   * ZeroMQ 2.1 does not tell where the peer is, so producer codec is
+   * to be set only for sockets connected to other processes on this host
+   * (see is_local()), remote peers get plain parts from Sink
+   * without codec. Consumer codec decodes plain parts (and the ones
+   * of other codecs escaped by PartCodec) as base PartCodec does.
+   *
+   * Blocks are reused in any order as they are released, new block
+   * is placed into the next gap large enough for it. Block which
+   * never comes back (message dropped on block or queued when Sink
+   * is destroyed, consumer without codec or crashed) keeps its space
+   * until the segment is created anew (by new producer ShmCodec),
+   * but does not hold the others: ring capacity shrinks by its size,
+   * see in_use(). Codec is not thread-safe,
+   * decoded parts may be released in any thread.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC ShmCodec : public PartCodec
+  {
+  public:
+    static const size_t DEFAULT_SHM_THRESHOLD = 64 * 1024;
+
+    /**
+     * Create segment (producer side), replacing existing one
+     * with the same name.
+     * @param name shared memory object name ("/something")
+     * @param capacity size of blocks ring
+     * @param threshold parts smaller than this are sent as is
+     */
+    ShmCodec(const std::string& name, size_t capacity,
+      size_t threshold = DEFAULT_SHM_THRESHOLD) throw(ZmqErrorType);
+
+    /**
+     * Consumer side: segment is mapped on the first descriptor received
+     * (and mapped again if producer created it anew).
+     */
+    explicit
+    ShmCodec(const std::string& name);
+
+    virtual
+    ~ShmCodec();
+
+    /**
+     * @return true if endpoint is of transport never leaving the host
+     *  ("ipc://", "inproc://")
+     */
+    static
+    bool
+    is_local(const char* endpoint);
+
+    /**
+     * @return bytes of ring taken by blocks not released yet (producer),
+     *  including blocks lost by consumers
+     */
+    size_t
+    in_use();
+
+    virtual
+    void
+    encode(Part& part) throw(ZmqErrorType);
+
+    virtual
+    void
+    decode(Part& part) throw(ZmqErrorType);
+
+    virtual
+    bool
+    decode_on_receive() const;
+
+  protected:
+    virtual
+    char
+    id() const;
+
+    virtual
+    size_t
+    compress(const char* src, size_t sz, char* dst, size_t cap);
+
+    virtual
+    bool
+    decompress(const char* src, size_t sz, char* dst, size_t orig);
+
+  private:
+    /**
+     * Segment mapped by consumer, unmapped with the last part using it
+     */
+    struct Mapping
+    {
+      void* base;
+      size_t len;
+      volatile int refs;
+    };
+
+    const std::string name_;
+
+    Mapping* mapping_; //!< 0 until attached
+
+    uint64_t token_; //!< random id of segment
+
+    char* data_; //!< start of blocks ring
+
+    size_t capacity_;
+
+    /**
+     * Producer: offset -> length of blocks not released yet
+     */
+    typedef std::map<size_t, size_t> Blocks;
+
+    Blocks blocks_;
+
+    size_t head_; //!< producer: where to look for the next gap
+
+    size_t used_; //!< producer: bytes taken by blocks_
+
+    const bool producer_;
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    reclaim();
+
+    ZMQMESSAGE_DLL_LOCAL
+    char*
+    allocate(size_t len);
+
+    ZMQMESSAGE_DLL_LOCAL
+    bool
+    attach(uint64_t token);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    detach();
+
+    ZMQMESSAGE_DLL_LOCAL
+    static
+    void
+    release(void* data, void* hint);
+  };
+}
+
+#endif /* ZMQMESSAGE_SHMCODEC_HPP_ */
@@ -0,0 +1,428 @@
+/**
+ * @file ShmCodecFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of ShmCodec methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ *
+ * Segment layout: header (SHM_HEADER_LEN bytes) and ring of blocks.
+ * Block is header (state, length of the whole block) and payload,
+ * both aligned to SHM_ALIGN. Producer writes block USED and sends
+ * descriptor, consumer writes it FREE when decoded part is released.
+ * Producer keeps offsets of its USED blocks and forgets the ones
+ * found FREE, new block takes the first gap large enough
+ * starting from the end of the previous one (next fit).
+ */
+
+#ifndef ZMQMESSAGE_SHMCODECFULLIMPL_HPP_
+#define ZMQMESSAGE_SHMCODECFULLIMPL_HPP_
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+
+namespace ZmqMessage
+{
+  namespace
+  {
+    const char SHM_MAGIC[8] = {'Z', 'M', 'Q', 'M', 'S', 'H', 'M', '1'};
+
+    const size_t SHM_ALIGN = 64;
+
+    const size_t SHM_HEADER_LEN = SHM_ALIGN;
+
+    const size_t SHM_BLOCK_HEADER_LEN = SHM_ALIGN;
+
+    /**
+     * codec header, token (8 bytes), offset of block (8 bytes)
+     */
+    const size_t SHM_DESCRIPTOR_LEN = Private::CODEC_HEADER_LEN + 8 + 8;
+
+    const uint32_t SHM_BLOCK_FREE = 0;
+
+    const uint32_t SHM_BLOCK_USED = 1;
+
+    struct ShmHeader
+    {
+      char magic[sizeof(SHM_MAGIC)];
+      uint64_t token;
+      uint64_t capacity;
+    };
+
+    struct ShmBlock
+    {
+      volatile uint32_t state;
+      uint32_t reserved;
+      uint64_t len;
+    };
+
+    inline
+    size_t
+    shm_align(size_t sz)
+    {
+      return (sz + SHM_ALIGN - 1) & ~(SHM_ALIGN - 1);
+    }
+
+    inline
+    ShmBlock*
+    shm_block(char* data, size_t offset)
+    {
+      return reinterpret_cast<ShmBlock*>(data + offset);
+    }
+
+    void
+    put_uint64(char* dst, uint64_t v)
+    {
+      for (size_t i = 0; i < 8; ++i)
+      {
+        dst[i] = static_cast<char>((v >> (8 * i)) & 0xff);
+      }
+    }
+
+    uint64_t
+    get_uint64(const unsigned char* src)
+    {
+      uint64_t v = 0;
+      for (size_t i = 0; i < 8; ++i)
+      {
+        v |= static_cast<uint64_t>(src[i]) << (8 * i);
+      }
+      return v;
+    }
+  }
+
+  ShmCodec::ShmCodec(const std::string& name, size_t capacity,
+    size_t threshold) throw(ZmqErrorType) :
+    PartCodec(threshold), name_(name), mapping_(0), token_(0), data_(0),
+    capacity_(shm_align(capacity)), head_(0), used_(0), producer_(true)
+  {
+    ::shm_unlink(name_.c_str());
+    const int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+    {
+      throw_zmq_exception(zmq::error_t());
+    }
+    const size_t len = SHM_HEADER_LEN + capacity_;
+    if (::ftruncate(fd, len) < 0)
+    {
+      const zmq::error_t e;
+      ::close(fd);
+      ::shm_unlink(name_.c_str());
+      throw_zmq_exception(e);
+    }
+    void* base = ::mmap(0, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+    {
+      const zmq::error_t e;
+      ::close(fd);
+      ::shm_unlink(name_.c_str());
+      throw_zmq_exception(e);
+    }
+    ::close(fd);
+
+    mapping_ = new Mapping;
+    mapping_->base = base;
+    mapping_->len = len;
+    mapping_->refs = 1;
+    data_ = static_cast<char*>(base) + SHM_HEADER_LEN;
+
+    //tells segments of the same name apart
+    token_ = (monotonic_usec() << 16) ^ ::getpid() ^
+      reinterpret_cast<uintptr_t>(base);
+    ShmHeader* header = static_cast<ShmHeader*>(base);
+    header->token = token_;
+    header->capacity = capacity_;
+    ::memcpy(header->magic, SHM_MAGIC, sizeof(SHM_MAGIC));
+  }
+
+  ShmCodec::ShmCodec(const std::string& name) :
+    PartCodec(DEFAULT_SHM_THRESHOLD), name_(name), mapping_(0), token_(0),
+    data_(0), capacity_(0), head_(0), used_(0), producer_(false)
+  {}
+
+  ShmCodec::~ShmCodec()
+  {
+    detach();
+    if (producer_)
+    {
+      ::shm_unlink(name_.c_str());
+    }
+  }
+
+  bool
+  ShmCodec::is_local(const char* endpoint)
+  {
+    return !::strncmp(endpoint, "ipc://", 6) ||
+      !::strncmp(endpoint, "inproc://", 9);
+  }
+
+  size_t
+  ShmCodec::in_use()
+  {
+    reclaim();
+    return used_;
+  }
+
+  bool
+  ShmCodec::decode_on_receive() const
+  {
+    return true;
+  }
+
+  char
+  ShmCodec::id() const
+  {
+    return 2;
+  }
+
+  size_t
+  ShmCodec::compress(const char* src, size_t sz, char* dst, size_t cap)
+  {
+    return 0;
+  }
+
+  bool
+  ShmCodec::decompress(const char* src, size_t sz, char* dst, size_t orig)
+  {
+    return false;
+  }
+
+  void
+  ShmCodec::reclaim()
+  {
+    for (Blocks::iterator it = blocks_.begin(); it != blocks_.end(); )
+    {
+      if (shm_block(data_, it->first)->state == SHM_BLOCK_FREE)
+      {
+        used_ -= it->second;
+        blocks_.erase(it++);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+    //consumer is done with block payload before we reuse it
+    __sync_synchronize();
+  }
+
+  char*
+  ShmCodec::allocate(size_t len)
+  {
+    reclaim();
+    //gaps from head to the end of ring, then from its beginning to head
+    size_t pos = head_;
+    bool wrapped = false;
+    for (;;)
+    {
+      if (wrapped && pos >= head_)
+      {
+        return 0; //no gap large enough
+      }
+      Blocks::const_iterator next = blocks_.lower_bound(pos);
+      const size_t end = next == blocks_.end() ? capacity_ : next->first;
+      if (end - pos >= len)
+      {
+        break;
+      }
+      if (next == blocks_.end())
+      {
+        if (wrapped)
+        {
+          return 0;
+        }
+        wrapped = true;
+        pos = 0;
+      }
+      else
+      {
+        pos = next->first + next->second;
+      }
+    }
+
+    blocks_.insert(std::make_pair(pos, len));
+    used_ += len;
+    head_ = pos + len == capacity_ ? 0 : pos + len;
+    ShmBlock* block = shm_block(data_, pos);
+    block->len = len;
+    block->state = SHM_BLOCK_USED;
+    return reinterpret_cast<char*>(block);
+  }
+
+  void
+  ShmCodec::encode(Part& part) throw(ZmqErrorType)
+  {
+    const bool magic = is_encoded(part.msg());
+    if (magic && part.received())
+    {
+      return; //received encoded, forwarded as is
+    }
+
+    const size_t sz = part.msg().size();
+    char* block = 0;
+    if (producer_ && sz >= threshold() && sz <= 0xffffffffu &&
+      SHM_BLOCK_HEADER_LEN + sz <= capacity_)
+    {
+      block = allocate(shm_align(SHM_BLOCK_HEADER_LEN + sz));
+    }
+    if (!block)
+    {
+      if (magic)
+      {
+        store(part);
+      }
+      else
+      {
+        ++stats_.skipped;
+      }
+      return;
+    }
+
+    const uint64_t start = monotonic_usec();
+    ::memcpy(block + SHM_BLOCK_HEADER_LEN, part.msg().data(), sz);
+    Part descriptor(SHM_DESCRIPTOR_LEN);
+    char* dst = static_cast<char*>(descriptor.msg().data());
+    put_codec_header(dst, id(), sz);
+    put_uint64(dst + Private::CODEC_HEADER_LEN, token_);
+    put_uint64(dst + Private::CODEC_HEADER_LEN + 8, block - data_);
+    part.move(descriptor);
+
+    ++stats_.encoded;
+    stats_.raw_bytes += sz;
+    stats_.encoded_bytes += SHM_DESCRIPTOR_LEN;
+    stats_.encode_usec += monotonic_usec() - start;
+  }
+
+  void
+  ShmCodec::decode(Part& part) throw(ZmqErrorType)
+  {
+    if (!part.received() || part.msg().size() != SHM_DESCRIPTOR_LEN ||
+      !is_encoded(part.msg()))
+    {
+      PartCodec::decode(part);
+      return;
+    }
+    const unsigned char* const header =
+      static_cast<const unsigned char*>(part.msg().data());
+    if (static_cast<char>(header[Private::CODEC_MAGIC_LEN]) != id())
+    {
+      PartCodec::decode(part);
+      return;
+    }
+
+    const uint64_t start = monotonic_usec();
+    size_t orig = 0;
+    for (size_t i = 0; i < 4; ++i)
+    {
+      orig |= static_cast<size_t>(header[Private::CODEC_MAGIC_LEN + 1 + i])
+        << (8 * i);
+    }
+    const uint64_t token = get_uint64(header + Private::CODEC_HEADER_LEN);
+    const uint64_t offset = get_uint64(header + Private::CODEC_HEADER_LEN + 8);
+
+    part.set_received(false);
+    if ((!mapping_ || token != token_) && !attach(token))
+    {
+      ++stats_.errors;
+      ZMQMESSAGE_LOG_STREAM << "Cannot map shared memory segment "
+        << name_ << ": leaving part as is" << ZMQMESSAGE_LOG_TERM;
+      return;
+    }
+    if (offset % SHM_ALIGN || offset >= capacity_ ||
+      SHM_BLOCK_HEADER_LEN + orig > capacity_ - offset)
+    {
+      ++stats_.errors;
+      ZMQMESSAGE_LOG_STREAM << "Bad shared memory block " << offset
+        << " of " << orig << " bytes: leaving part as is"
+        << ZMQMESSAGE_LOG_TERM;
+      return;
+    }
+
+    char* block = data_ + offset;
+    __sync_add_and_fetch(&mapping_->refs, 1);
+    Part plain(block + SHM_BLOCK_HEADER_LEN, orig, &ShmCodec::release,
+      mapping_);
+    part.move(plain);
+
+    ++stats_.decoded;
+    stats_.decode_usec += monotonic_usec() - start;
+  }
+
+  bool
+  ShmCodec::attach(uint64_t token)
+  {
+    detach();
+    const int fd = ::shm_open(name_.c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+      return false;
+    }
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 &&
+      static_cast<size_t>(st.st_size) > SHM_HEADER_LEN)
+    {
+      base = ::mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (base == MAP_FAILED)
+    {
+      return false;
+    }
+    const ShmHeader* header = static_cast<const ShmHeader*>(base);
+    if (::memcmp(header->magic, SHM_MAGIC, sizeof(SHM_MAGIC)) ||
+      header->token != token ||
+      header->capacity != static_cast<uint64_t>(st.st_size) - SHM_HEADER_LEN)
+    {
+      ::munmap(base, st.st_size);
+      return false;
+    }
+
+    mapping_ = new Mapping;
+    mapping_->base = base;
+    mapping_->len = st.st_size;
+    mapping_->refs = 1;
+    token_ = token;
+    data_ = static_cast<char*>(base) + SHM_HEADER_LEN;
+    capacity_ = header->capacity;
+    return true;
+  }
+
+  void
+  ShmCodec::detach()
+  {
+    if (mapping_)
+    {
+      Mapping* mapping = mapping_;
+      mapping_ = 0;
+      data_ = 0;
+      if (__sync_sub_and_fetch(&mapping->refs, 1) == 0)
+      {
+        ::munmap(mapping->base, mapping->len);
+        delete mapping;
+      }
+    }
+  }
+
+  void
+  ShmCodec::release(void* data, void* hint)
+  {
+    Mapping* mapping = static_cast<Mapping*>(hint);
+    ShmBlock* block = reinterpret_cast<ShmBlock*>(
+      static_cast<char*>(data) - SHM_BLOCK_HEADER_LEN);
+    //payload is read before producer sees the block free
+    __sync_synchronize();
+    block->state = SHM_BLOCK_FREE;
+    if (__sync_sub_and_fetch(&mapping->refs, 1) == 0)
+    {
+      ::munmap(mapping->base, mapping->len);
+      delete mapping;
+    }
+  }
+}
+
+#endif /* ZMQMESSAGE_SHMCODECFULLIMPL_HPP_ */
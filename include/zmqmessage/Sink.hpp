@@ -9,6 +9,7 @@
 
 #include <memory>
 #include <climits>
+#include <vector>
 
 #include <ZmqMessageFwd.hpp>
 
@@ -19,6 +20,8 @@
 #include <zmqmessage/OutOptions.hpp>
 #include <zmqmessage/MultipartContainer.hpp>
 #include <zmqmessage/RawMessage.hpp>
+#include <zmqmessage/Handoff.hpp>
+#include <zmqmessage/Transport.hpp>
 
 namespace ZmqMessage
 {
@@ -118,12 +121,18 @@ namespace ZmqMessage
   private:
     typedef std::auto_ptr<zmq::message_t> MsgPtr;
 
-    zmq::socket_t& dst_;
+    zmq::socket_t* dst_;
+
+    Transport* transport_; //!< used instead of socket if not null
 
     unsigned options_;
 
     OutOptions::SendObserverPtr send_observer_;
 
+    PartAllocator* part_allocator_;
+
+    PartCodec* codec_; //!< compresses body parts if not null
+
     /**
      * If not null, the routing will be taken from it.
      * Either, when sending/inserting zmq messages to Outgoing,
@@ -156,12 +165,36 @@ namespace ZmqMessage
 
     size_t pending_routing_parts_;
 
+    /**
+     * Routing parts to be inserted (they are never packed)
+     */
+    size_t routing_to_insert_;
+
+    /**
+     * Logical parts packed so far (in PACKED mode)
+     */
+    std::vector<char> packed_area_;
+    size_t packed_parts_;
+
   protected:
     Sink(zmq::socket_t& dst, unsigned options,
-      OutOptions::SendObserverPtr so = 0, Multipart* incoming = 0) :
-      dst_(dst), options_(options), send_observer_(so), incoming_(incoming),
+      OutOptions::SendObserverPtr so = 0, Multipart* incoming = 0,
+      PartAllocator* pa = 0) :
+      dst_(&dst), transport_(0),
+      options_(options), send_observer_(so), part_allocator_(pa),
+      codec_(0), incoming_(incoming),
+      outgoing_queue_(0), cached_(false), state_(NOTSENT),
+      pending_routing_parts_(0), routing_to_insert_(0), packed_parts_(0)
+    {}
+
+    Sink(Transport& dst, unsigned options,
+      OutOptions::SendObserverPtr so = 0, Multipart* incoming = 0,
+      PartAllocator* pa = 0) :
+      dst_(dst.socket()), transport_(&dst),
+      options_(options), send_observer_(so), part_allocator_(pa),
+      codec_(0), incoming_(incoming),
       outgoing_queue_(0), cached_(false), state_(NOTSENT),
-      pending_routing_parts_(0)
+      pending_routing_parts_(0), routing_to_insert_(0), packed_parts_(0)
     {}
 
     inline
@@ -169,6 +202,7 @@ namespace ZmqMessage
     add_pending_routing_part()
     {
       ++pending_routing_parts_;
+      ++routing_to_insert_;
     }
 
     void
@@ -184,6 +218,25 @@ namespace ZmqMessage
     void
     send_owned(Part& owned) throw(ZmqErrorType);
 
+    /**
+     * Send part bypassing codec (it must not be copied),
+     * called from template operator << as well.
+     */
+    void
+    send_owned_as_is(Part& owned) throw(ZmqErrorType);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    do_send_owned(Part& owned) throw(ZmqErrorType);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    pack_owned(Part& owned);
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    send_packed() throw(ZmqErrorType);
+
     ZMQMESSAGE_DLL_LOCAL
     void
     do_send_one(Part& msg, bool last) throw(ZmqErrorType);
@@ -238,6 +291,36 @@ namespace ZmqMessage
       send_observer_ = se;
     }
 
+    /**
+     * Assign allocator of payload buffers for parts
+     * composed by this object (inserted values, copied RawMessage).
+     * Parts larger than \ref ZMQMESSAGE_POOL_MIN_PART_SIZE
+     * take their buffers from it, others are stored inline in zmq message.
+     * Allocator is not owned by Sink and must outlive all sent messages.
+     * Pass 0 to compose parts as usual.
+     */
+    inline
+    void
+    set_part_allocator(PartAllocator* pa)
+    {
+      part_allocator_ = pa;
+    }
+
+    /**
+     * Assign codec to compress message parts (but routing ones)
+     * larger than codec's threshold. In PACKED mode packed frame
+     * is compressed as a whole. Parts received and not decoded
+     * are sent as is (still encoded).
+     * Codec is not owned by Sink. Pass 0 to send parts as is.
+     * See \ref zm_codec "compression"
+     */
+    inline
+    void
+    set_codec(PartCodec* codec)
+    {
+      codec_ = codec;
+    }
+
     /**
      * Get pointer to incoming message this outgoing message is linked to.
      * @return null if not linked.
@@ -280,14 +363,27 @@ namespace ZmqMessage
       return (state_ == DROPPING);
     }
 
+    /**
+     * @return false if Sink is created with transport without socket
+     *  (so dst() may not be used)
+     */
+    inline
+    bool
+    has_dst() const
+    {
+      return dst_ != 0;
+    }
+
     /**
      * @return destination socket
+     *  (transport must have it if Sink is created with one, see has_dst())
      */
     inline
     zmq::socket_t&
     dst()
     {
-      return dst_;
+      assert(dst_);
+      return *dst_;
     }
 
     /**
@@ -332,6 +428,13 @@ namespace ZmqMessage
     relay_from(zmq::socket_t& relay_src,
       ReceiveObserver* receive_observer = 0) throw(ZmqErrorType);
 
+    /**
+     * Receive and send/enqueue pending messages from transport
+     */
+    void
+    relay_from(Transport& relay_src,
+      ReceiveObserver* receive_observer = 0) throw(ZmqErrorType);
+
     /**
      * Receive and send/enqueue pending messages from relay_src socket,
      * counting sizes of received messages
@@ -344,6 +447,19 @@ namespace ZmqMessage
       ReceiveObserver* receive_observer)
     throw (ZmqErrorType);
 
+    /**
+     * Send message parts received by @c incoming
+     * (starting from @c idx_from), then relay parts not received yet
+     * from its socket: the whole message passes in one go over the socket.
+     * Received parts are disowned from @c incoming (not copied)
+     * and sent as received (not decoded by its codec).
+     * Incoming becomes terminal.
+     */
+    template <class RoutingPolicy, class PartsStorage>
+    void
+    splice_from(Incoming<RoutingPolicy, PartsStorage>& incoming,
+      size_t idx_from = 0) throw (ZmqErrorType);
+
     /**
      * Lowest priority in overload. Uses @c ZmqMessage::init_msg functions
      * to compose message part and send.
@@ -405,6 +521,15 @@ namespace ZmqMessage
     Sink&
     operator<< (const RawMessage& m) throw (ZmqErrorType);
 
+    /**
+     * Insert object (see @c Handoff), it's released from auto_ptr.
+     * Part is not encoded by codec. Sink with OutOptions::PACKED
+     * refuses it (EINVAL), object stays in auto_ptr.
+     */
+    template <typename T>
+    Sink&
+    operator<< (const Handoff<T>& h) throw (ZmqErrorType);
+
     /**
      * Handle a manipulator
      */
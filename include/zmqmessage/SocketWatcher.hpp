@@ -0,0 +1,139 @@
+/**
+ * @file SocketWatcher.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_SOCKETWATCHER_HPP_
+#define ZMQMESSAGE_SOCKETWATCHER_HPP_
+
+#include <stdint.h>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/Destination.hpp>
+#include <zmqmessage/Reactor.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Socket serviced by external event loop
+   * (libev, libevent, asio, own epoll etc).
+   *
+   * Descriptor returned by fd() is registered in the loop for reading,
+   * it's edge-triggered: it signals that socket state may have changed
+   * and does not signal again until ZMQ_EVENTS is read.
+   * So on each readiness on_ready() must be called,
+   * it checks ZMQ_EVENTS until nothing can be done:
+   * messages available are passed to handler
+   * (Reactor::IncomingHandler receives them with Incoming),
+   * messages queued with queue() are sent while socket is writable.
+   * @code
+   * Handler handler; //Reactor::IncomingHandler<SimpleRouting>
+   * ZmqMessage::SocketWatcher watcher(sock, handler, 100);
+   * ev_io_init(&io, callback, watcher.fd(), EV_READ);
+   * ...
+   * //in callback:
+   * if (watcher.on_ready())
+   * {
+   *   //budget is exhausted, schedule another call (ev_idle etc)
+   * }
+   * @endcode
+   * on_ready() must also be called after socket is used
+   * not from the watcher (this may consume the edge).
+   * SocketWatcher does not own socket and handler.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC SocketWatcher : private Private::NonCopyable
+  {
+  public:
+    struct Stats
+    {
+      uint64_t wakeups; //!< on_ready() calls
+      uint64_t messages; //!< messages passed to handler
+
+      Stats();
+    };
+
+    static const size_t DEFAULT_MAX_QUEUED = 1000;
+
+    /**
+     * @param budget max messages passed to handler by one on_ready() call,
+     *  0 means no limit
+     * @param max_queued max messages waiting to be sent,
+     *  more are dropped
+     */
+    SocketWatcher(zmq::socket_t& sock, Reactor::Handler& handler,
+      size_t budget = 0, size_t max_queued = DEFAULT_MAX_QUEUED)
+      throw(ZmqErrorType);
+
+    /**
+     * @return descriptor to register in event loop (for reading)
+     */
+    inline
+    int
+    fd() const
+    {
+      return fd_;
+    }
+
+    /**
+     * Take messages queued by flushed sink
+     * (OutOptions::CACHE_ON_BLOCK) on watched socket,
+     * they are sent (in order) by on_ready().
+     * Sink over transport without socket is rejected with EINVAL error.
+     * @return false if sink has nothing queued
+     *   or it's dropped because queue is full
+     */
+    bool
+    queue(Sink& sink) throw(ZmqErrorType);
+
+    /**
+     * @return number of messages waiting to be sent
+     */
+    inline
+    size_t
+    queued() const
+    {
+      return out_.queued();
+    }
+
+    /**
+     * Receive and send messages while socket is ready.
+     * @return true if there is more work to do (budget exhausted):
+     *  on_ready() should be called again without waiting for fd().
+     */
+    bool
+    on_ready() throw(ZmqErrorType);
+
+    inline
+    const Stats&
+    stats() const
+    {
+      return stats_;
+    }
+
+    /**
+     * @return counters of messages sent from queue
+     */
+    inline
+    const DestinationStats&
+    out_stats() const
+    {
+      return out_.stats();
+    }
+
+  private:
+    zmq::socket_t& sock_;
+    Reactor::Handler& handler_;
+    const size_t budget_;
+    int fd_;
+    Private::Destination out_;
+    Stats stats_;
+  };
+}
+
+#endif /* ZMQMESSAGE_SOCKETWATCHER_HPP_ */
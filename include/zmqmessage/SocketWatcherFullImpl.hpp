@@ -0,0 +1,96 @@
+/**
+ * @file SocketWatcherFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of SocketWatcher methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_SOCKETWATCHERFULLIMPL_HPP_
+#define ZMQMESSAGE_SOCKETWATCHERFULLIMPL_HPP_
+
+#include <cerrno>
+
+namespace ZmqMessage
+{
+  SocketWatcher::Stats::Stats() :
+    wakeups(0), messages(0)
+  {}
+
+  SocketWatcher::SocketWatcher(
+    zmq::socket_t& sock, Reactor::Handler& handler,
+    size_t budget, size_t max_queued) throw(ZmqErrorType) :
+    sock_(sock), handler_(handler), budget_(budget), fd_(-1),
+    out_(sock, OutOptions::CACHE_ON_BLOCK, max_queued)
+  {
+    size_t sz = sizeof(fd_);
+    try
+    {
+      sock.getsockopt(ZMQ_FD, &fd_, &sz);
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+  }
+
+  bool
+  SocketWatcher::queue(Sink& sink) throw(ZmqErrorType)
+  {
+    if (!sink.has_dst())
+    {
+      errno = EINVAL;
+      throw_zmq_exception(zmq::error_t());
+    }
+    if (!sink.is_queued())
+    {
+      return false;
+    }
+    return out_.enqueue(sink.detach());
+  }
+
+  bool
+  SocketWatcher::on_ready() throw(ZmqErrorType)
+  {
+    ++stats_.wakeups;
+    size_t received = 0;
+    for (bool progress = true; progress; )
+    {
+      progress = false;
+      uint32_t events = 0;
+      size_t sz = sizeof(events);
+      try
+      {
+        sock_.getsockopt(ZMQ_EVENTS, &events, &sz);
+      }
+      catch (const zmq::error_t& e)
+      {
+        throw_zmq_exception(e);
+      }
+
+      if ((events & ZMQ_POLLOUT) && out_.queued())
+      {
+        const uint64_t sent = out_.stats().sent;
+        out_.flush();
+        progress = out_.stats().sent != sent;
+      }
+
+      if (events & ZMQ_POLLIN)
+      {
+        if (budget_ && received == budget_)
+        {
+          return true;
+        }
+        ++received;
+        ++stats_.messages;
+        handler_.on_readable(sock_);
+        progress = true;
+      }
+    }
+    return false;
+  }
+}
+
+#endif /* ZMQMESSAGE_SOCKETWATCHERFULLIMPL_HPP_ */
@@ -0,0 +1,139 @@
+/**
+ * @file SpinWait.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_SPINWAIT_HPP_
+#define ZMQMESSAGE_SPINWAIT_HPP_
+
+#include <stdint.h>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Spin-then-block receiving of message parts.
+   *
+   * Blocking recv() on idle socket puts thread to sleep,
+   * and the next message pays for its wakeup (futex, scheduler).
+   * SpinWait first polls socket in non-blocking mode
+   * with exponentially growing pauses between attempts,
+   * for up to @c max_spin microseconds, and only then blocks.
+   *
+   * Spinning is adaptive: moving average of inter-arrival time
+   * is kept, and the thread spins up to twice of it (but @c max_spin),
+   * so it does not burn CPU when messages come rarely.
+   *
+   * It's set to Incoming with Incoming::set_spin_wait()
+   * (then first part of each message is received with it)
+   * or used directly:
+   * @code
+   * ZmqMessage::SpinWait spin(20); //spin up to 20 usec
+   * for (;;)
+   * {
+   *   ZmqMessage::Incoming<ZmqMessage::SimpleRouting> incoming(sock);
+   *   incoming.set_spin_wait(&spin);
+   *   incoming.receive_all();
+   *   ...
+   * }
+   * @endcode
+   * Counters show what spinning brings: messages caught while spinning
+   * vs ones we had to block for, and CPU time spent in spinning.
+   * SpinWait is to be used by one thread.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC SpinWait : private Private::NonCopyable
+  {
+  public:
+    struct Stats
+    {
+      uint64_t immediate; //!< parts ready on first attempt
+      uint64_t spin_hits; //!< parts received while spinning
+      uint64_t blocks; //!< parts received with blocking recv
+      uint64_t spin_nsec; //!< time spent in spinning
+
+      Stats();
+    };
+
+    static const long DEFAULT_MAX_SPIN = 50; //usec
+
+    /**
+     * @param max_spin max time to spin before blocking, microseconds.
+     * 0 disables spinning.
+     */
+    explicit
+    SpinWait(long max_spin = DEFAULT_MAX_SPIN);
+
+    /**
+     * Receive message part from socket
+     */
+    void
+    recv(zmq::socket_t& sock, zmq::message_t& msg) throw(ZmqErrorType);
+
+    /**
+     * @return moving average of time between parts received, microseconds
+     */
+    inline
+    long
+    average_gap() const
+    {
+      return static_cast<long>(gap_ns_ / 1000);
+    }
+
+    inline
+    const Stats&
+    stats() const
+    {
+      return stats_;
+    }
+
+    inline
+    void
+    reset_stats()
+    {
+      stats_ = Stats();
+    }
+
+  private:
+    enum
+    {
+      MAX_PAUSES = 64, //!< max pause instructions between attempts
+      GAP_WEIGHT = 8 //!< moving average factor: 1/8 of new gap
+    };
+
+    const uint64_t max_spin_ns_;
+
+    uint64_t gap_ns_; //!< average inter-arrival time
+
+    uint64_t last_arrival_ns_;
+
+    Stats stats_;
+
+    ZMQMESSAGE_DLL_LOCAL
+    void
+    arrived(uint64_t now);
+  };
+
+  namespace Private
+  {
+    /**
+     * Hint processor that we are in spin loop
+     */
+    inline
+    void
+    cpu_relax()
+    {
+#if defined(__i386__) || defined(__x86_64__)
+      __asm__ __volatile__ ("pause");
+#elif defined(__aarch64__) || defined(__arm__)
+      __asm__ __volatile__ ("yield");
+#endif
+    }
+  }
+}
+
+#endif /* ZMQMESSAGE_SPINWAIT_HPP_ */
@@ -0,0 +1,77 @@
+/**
+ * @file SpinWaitFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of SpinWait methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_SPINWAITFULLIMPL_HPP_
+#define ZMQMESSAGE_SPINWAITFULLIMPL_HPP_
+
+#include <algorithm>
+
+namespace ZmqMessage
+{
+  SpinWait::Stats::Stats() :
+    immediate(0), spin_hits(0), blocks(0), spin_nsec(0)
+  {}
+
+  SpinWait::SpinWait(long max_spin) :
+    max_spin_ns_(max_spin > 0 ? static_cast<uint64_t>(max_spin) * 1000 : 0),
+    gap_ns_(max_spin_ns_), last_arrival_ns_(monotonic_nsec())
+  {}
+
+  void
+  SpinWait::arrived(uint64_t now)
+  {
+    const uint64_t gap = now - last_arrival_ns_;
+    gap_ns_ = (gap_ns_ * (GAP_WEIGHT - 1) + gap) / GAP_WEIGHT;
+    last_arrival_ns_ = now;
+  }
+
+  void
+  SpinWait::recv(zmq::socket_t& sock, zmq::message_t& msg)
+    throw(ZmqErrorType)
+  {
+    if (try_recv_msg(sock, msg))
+    {
+      ++stats_.immediate;
+      arrived(monotonic_nsec());
+      return;
+    }
+
+    //spin while message is likely to come soon
+    const uint64_t limit = std::min(max_spin_ns_, 2 * gap_ns_);
+    const uint64_t start = monotonic_nsec();
+    uint64_t now = start;
+    unsigned pauses = 1;
+    while (now - start < limit)
+    {
+      for (unsigned i = 0; i < pauses; ++i)
+      {
+        Private::cpu_relax();
+      }
+      pauses = std::min(pauses * 2, static_cast<unsigned>(MAX_PAUSES));
+
+      const bool received = try_recv_msg(sock, msg);
+      now = monotonic_nsec();
+      if (received)
+      {
+        ++stats_.spin_hits;
+        stats_.spin_nsec += now - start;
+        arrived(now);
+        return;
+      }
+    }
+    stats_.spin_nsec += now - start;
+
+    ++stats_.blocks;
+    recv_msg(sock, msg);
+    arrived(monotonic_nsec());
+  }
+}
+
+#endif /* ZMQMESSAGE_SPINWAITFULLIMPL_HPP_ */
@@ -0,0 +1,177 @@
+/**
+ * @file TimerWheel.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_TIMERWHEEL_HPP_
+#define ZMQMESSAGE_TIMERWHEEL_HPP_
+
+#include <stdint.h>
+#include <map>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+
+namespace ZmqMessage
+{
+  typedef unsigned long TimerId;
+
+  /**
+   * Callback of timer, see Reactor::add_timer()
+   */
+  class ZMQMESSAGE_DLL_PUBLIC TimerHandler
+  {
+  public:
+    virtual
+    ~TimerHandler();
+
+    virtual
+    void
+    on_timer(TimerId id) = 0;
+  };
+
+  namespace Private
+  {
+    /**
+     * Hierarchical timer wheel (as in Varghese, Lauck and Linux kernel).
+     * Time is measured in ticks. Timers expiring in next 256 ticks
+     * are kept in first level slots, one slot per tick,
+     * later ones in 3 levels of 64 slots each,
+     * 64 times coarser than previous level; they are moved (cascaded)
+     * to lower level when their time comes closer.
+     * Adding and cancelling a timer are O(1) (plus id lookup),
+     * ticks with no timers are skipped.
+     * Timers farther than 2^26 ticks are rescheduled on cascade.
+     */
+    class ZMQMESSAGE_DLL_PUBLIC TimerWheel : private NonCopyable
+    {
+    public:
+      static const uint64_t NEVER = ~static_cast<uint64_t>(0);
+
+      explicit
+      TimerWheel(uint64_t now = 0);
+
+      /**
+       * Deletes pending timers (handlers are not called)
+       */
+      ~TimerWheel();
+
+      /**
+       * Add timer expiring at @c expires tick
+       * (next processed tick if it's in the past).
+       * @param interval if not 0 timer is periodic
+       * @return id of timer, never 0
+       */
+      TimerId
+      add(uint64_t expires, uint64_t interval, TimerHandler& handler);
+
+      /**
+       * @return false if there is no such timer (e.g. fired one-shot)
+       */
+      bool
+      cancel(TimerId id);
+
+      inline
+      size_t
+      size() const
+      {
+        return timers_.size();
+      }
+
+      /**
+       * @return next tick to be processed
+       */
+      inline
+      uint64_t
+      now() const
+      {
+        return next_tick_;
+      }
+
+      /**
+       * @return tick when wheel has work to do: timer expires
+       *  or (earlier) it's moved to lower level. NEVER if no timers
+       */
+      uint64_t
+      next_expiry() const;
+
+      /**
+       * Fire timers expiring up to @c tick inclusive.
+       * Handlers may add and cancel timers.
+       * @return number of timers fired
+       */
+      size_t
+      advance(uint64_t tick);
+
+    private:
+      enum
+      {
+        ROOT_BITS = 8,
+        LEVEL_BITS = 6,
+        LEVELS = 3, //!< besides root
+        ROOT_SIZE = 1 << ROOT_BITS,
+        LEVEL_SIZE = 1 << LEVEL_BITS,
+        ROOT_MASK = ROOT_SIZE - 1,
+        LEVEL_MASK = LEVEL_SIZE - 1
+      };
+
+      struct Entry
+      {
+        Entry* prev;
+        Entry* next;
+        uint64_t expires;
+        uint64_t interval;
+        TimerHandler* handler;
+        TimerId id;
+      };
+
+      Entry root_[ROOT_SIZE]; //!< list heads
+      Entry levels_[LEVELS][LEVEL_SIZE]; //!< list heads
+
+      std::map<TimerId, Entry*> timers_;
+
+      TimerId last_id_;
+
+      uint64_t next_tick_;
+
+      ZMQMESSAGE_DLL_LOCAL
+      static
+      void
+      init(Entry& head);
+
+      ZMQMESSAGE_DLL_LOCAL
+      static
+      void
+      unlink(Entry* entry);
+
+      ZMQMESSAGE_DLL_LOCAL
+      static
+      void
+      splice(Entry& from, Entry& to);
+
+      /**
+       * Put entry into slot according to its expiration time
+       */
+      ZMQMESSAGE_DLL_LOCAL
+      void
+      link(Entry* entry);
+
+      /**
+       * Move entries of level slot to lower levels
+       * @return slot index
+       */
+      ZMQMESSAGE_DLL_LOCAL
+      size_t
+      cascade(size_t level, size_t index);
+
+      ZMQMESSAGE_DLL_LOCAL
+      void
+      fire(Entry* entry, uint64_t tick);
+    };
+  }
+}
+
+#endif /* ZMQMESSAGE_TIMERWHEEL_HPP_ */
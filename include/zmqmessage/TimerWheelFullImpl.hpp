@@ -0,0 +1,276 @@
+/**
+ * @file TimerWheelFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of TimerWheel methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_TIMERWHEELFULLIMPL_HPP_
+#define ZMQMESSAGE_TIMERWHEELFULLIMPL_HPP_
+
+#include <algorithm>
+
+namespace ZmqMessage
+{
+  TimerHandler::~TimerHandler()
+  {}
+
+  namespace Private
+  {
+    TimerWheel::TimerWheel(uint64_t now) :
+      last_id_(0), next_tick_(now)
+    {
+      for (size_t i = 0; i < ROOT_SIZE; ++i)
+      {
+        init(root_[i]);
+      }
+      for (size_t l = 0; l < LEVELS; ++l)
+      {
+        for (size_t i = 0; i < LEVEL_SIZE; ++i)
+        {
+          init(levels_[l][i]);
+        }
+      }
+    }
+
+    TimerWheel::~TimerWheel()
+    {
+      for (std::map<TimerId, Entry*>::iterator it = timers_.begin();
+           it != timers_.end(); ++it)
+      {
+        delete it->second;
+      }
+    }
+
+    void
+    TimerWheel::init(Entry& head)
+    {
+      head.prev = head.next = &head;
+    }
+
+    void
+    TimerWheel::unlink(Entry* entry)
+    {
+      entry->prev->next = entry->next;
+      entry->next->prev = entry->prev;
+      entry->prev = entry->next = entry;
+    }
+
+    void
+    TimerWheel::splice(Entry& from, Entry& to)
+    {
+      init(to);
+      if (from.next == &from)
+      {
+        return;
+      }
+      to.next = from.next;
+      to.prev = from.prev;
+      to.next->prev = &to;
+      to.prev->next = &to;
+      init(from);
+    }
+
+    void
+    TimerWheel::link(Entry* entry)
+    {
+      uint64_t expires = std::max(entry->expires, next_tick_);
+      const uint64_t delta = expires - next_tick_;
+      Entry* head = 0;
+      if (delta < ROOT_SIZE)
+      {
+        head = &root_[expires & ROOT_MASK];
+      }
+      else
+      {
+        const uint64_t max_delta = 1ULL << (ROOT_BITS + LEVELS * LEVEL_BITS);
+        if (delta >= max_delta)
+        {
+          //to be rescheduled when cascaded to root
+          expires = next_tick_ + max_delta - 1;
+        }
+        size_t level = 0;
+        while (expires - next_tick_ >=
+          (1ULL << (ROOT_BITS + (level + 1) * LEVEL_BITS)))
+        {
+          ++level;
+        }
+        const unsigned shift = ROOT_BITS + level * LEVEL_BITS;
+        head = &levels_[level][(expires >> shift) & LEVEL_MASK];
+      }
+      entry->next = head;
+      entry->prev = head->prev;
+      head->prev->next = entry;
+      head->prev = entry;
+    }
+
+    size_t
+    TimerWheel::cascade(size_t level, size_t index)
+    {
+      Entry moved;
+      splice(levels_[level][index], moved);
+      while (moved.next != &moved)
+      {
+        Entry* entry = moved.next;
+        unlink(entry);
+        link(entry);
+      }
+      return index;
+    }
+
+    uint64_t
+    TimerWheel::next_expiry() const
+    {
+      if (timers_.empty())
+      {
+        return NEVER;
+      }
+      uint64_t next = NEVER;
+      for (size_t k = 0; k < ROOT_SIZE; ++k)
+      {
+        const Entry& head = root_[(next_tick_ + k) & ROOT_MASK];
+        if (head.next != &head)
+        {
+          next = next_tick_ + k;
+          break;
+        }
+      }
+      for (size_t l = 0; l < LEVELS; ++l)
+      {
+        const unsigned shift = ROOT_BITS + l * LEVEL_BITS;
+        const uint64_t group = next_tick_ >> shift;
+        //slot of current group is cascaded at its first tick
+        const size_t first =
+          (next_tick_ & ((1ULL << shift) - 1)) ? 1 : 0;
+        for (size_t k = first; k < first + LEVEL_SIZE; ++k)
+        {
+          const Entry& head = levels_[l][(group + k) & LEVEL_MASK];
+          if (head.next != &head)
+          {
+            next = std::min(next, (group + k) << shift);
+            break;
+          }
+        }
+      }
+      return next;
+    }
+
+    void
+    TimerWheel::fire(Entry* entry, uint64_t tick)
+    {
+      const TimerId id = entry->id;
+      TimerHandler* handler = entry->handler;
+      if (entry->interval)
+      {
+        entry->expires = tick + entry->interval;
+        link(entry);
+      }
+      else
+      {
+        timers_.erase(id);
+        delete entry;
+      }
+      //entry may be cancelled by handler
+      handler->on_timer(id);
+    }
+
+    size_t
+    TimerWheel::advance(uint64_t tick)
+    {
+      size_t fired = 0;
+      while (next_tick_ <= tick)
+      {
+        //skip ticks with nothing to do
+        const uint64_t next = next_expiry();
+        if (next > tick)
+        {
+          next_tick_ = tick + 1;
+          break;
+        }
+        next_tick_ = std::max(next_tick_, next);
+
+        const size_t index = next_tick_ & ROOT_MASK;
+        if (!index &&
+          !cascade(0, (next_tick_ >> ROOT_BITS) & LEVEL_MASK) &&
+          !cascade(1, (next_tick_ >> (ROOT_BITS + LEVEL_BITS)) & LEVEL_MASK))
+        {
+          cascade(2, (next_tick_ >> (ROOT_BITS + 2 * LEVEL_BITS)) & LEVEL_MASK);
+        }
+        const uint64_t current = next_tick_++;
+
+        Entry expired;
+        splice(root_[index], expired);
+        try
+        {
+          while (expired.next != &expired)
+          {
+            Entry* entry = expired.next;
+            unlink(entry);
+            if (entry->expires > current)
+            {
+              link(entry); //too far to be placed on wheel before
+              continue;
+            }
+            ++fired;
+            fire(entry, current);
+          }
+        }
+        catch (...)
+        {
+          while (expired.next != &expired)
+          {
+            Entry* entry = expired.next;
+            unlink(entry);
+            link(entry);
+          }
+          throw;
+        }
+      }
+      return fired;
+    }
+
+    TimerId
+    TimerWheel::add(uint64_t expires, uint64_t interval, TimerHandler& handler)
+    {
+      Entry* entry = new Entry;
+      entry->expires = expires;
+      entry->interval = interval;
+      entry->handler = &handler;
+      entry->id = ++last_id_;
+      if (!entry->id)
+      {
+        entry->id = ++last_id_;
+      }
+      try
+      {
+        timers_.insert(std::make_pair(entry->id, entry));
+      }
+      catch (...)
+      {
+        delete entry;
+        throw;
+      }
+      link(entry);
+      return entry->id;
+    }
+
+    bool
+    TimerWheel::cancel(TimerId id)
+    {
+      std::map<TimerId, Entry*>::iterator it = timers_.find(id);
+      if (it == timers_.end())
+      {
+        return false;
+      }
+      unlink(it->second);
+      delete it->second;
+      timers_.erase(it);
+      return true;
+    }
+  }
+}
+
+#endif /* ZMQMESSAGE_TIMERWHEELFULLIMPL_HPP_ */
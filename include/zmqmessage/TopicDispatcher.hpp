@@ -0,0 +1,172 @@
+/**
+ * @file TopicDispatcher.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_TOPICDISPATCHER_HPP_
+#define ZMQMESSAGE_TOPICDISPATCHER_HPP_
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <ZmqMessageFwd.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/Reactor.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Dispatch of messages received from SUB socket by topic.
+   *
+   * Handler is registered for topic prefix, message goes to
+   * the handler of the longest prefix of its first part
+   * (as SUB socket filters it). Prefixes are compiled into trie
+   * kept in flat arrays (children labels of node are contiguous),
+   * so matching takes O(topic length) regardless of number of topics.
+   *
+   * subscribe() brings socket subscriptions in line with prefixes
+   * registered: only prefixes not covered by shorter ones are subscribed,
+   * and only changes since previous call are passed to setsockopt.
+   * @code
+   * ZmqMessage::TopicDispatcher topics(sub_sock);
+   * topics.add("quote.", quotes);
+   * topics.add("trade.", trades);
+   * topics.subscribe();
+   * reactor.add(sub_sock, topics); //or call topics.on_readable(sub_sock)
+   * @endcode
+   * TopicDispatcher does not own handlers.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC TopicDispatcher :
+    public Reactor::Handler, private Private::NonCopyable
+  {
+  public:
+    class ZMQMESSAGE_DLL_PUBLIC Handler
+    {
+    public:
+      virtual
+      ~Handler();
+
+      /**
+       * @param incoming first part (topic) is received,
+       *  the rest may be received by handler
+       */
+      virtual
+      void
+      handle(Incoming<SimpleRouting>& incoming) = 0;
+    };
+
+    /**
+     * @param sock SUB socket to subscribe
+     */
+    explicit
+    TopicDispatcher(zmq::socket_t& sock);
+
+    /**
+     * Register (or replace) handler of topic prefix.
+     * Empty prefix matches all topics.
+     */
+    void
+    add(const std::string& prefix, Handler& handler);
+
+    /**
+     * @return false if prefix is not registered
+     */
+    bool
+    remove(const std::string& prefix);
+
+    /**
+     * @return number of prefixes registered
+     */
+    inline
+    size_t
+    size() const
+    {
+      return topics_.size();
+    }
+
+    /**
+     * @return handler of the longest prefix of topic, 0 if none
+     */
+    Handler*
+    match(const void* topic, size_t sz);
+
+    /**
+     * Subscribe socket to prefixes added and unsubscribe from ones removed
+     * since previous call.
+     * @return number of setsockopt calls made
+     */
+    size_t
+    subscribe() throw(ZmqErrorType);
+
+    /**
+     * Receive topic of message (if not received yet)
+     * and pass message to its handler.
+     * @return false if there is no handler (message is not received further)
+     */
+    bool
+    dispatch(Incoming<SimpleRouting>& incoming)
+      throw(ZmqErrorType, MessageFormatError);
+
+    /**
+     * Receive message from socket and dispatch it
+     * (rest of message not received by handler is dropped)
+     */
+    void
+    on_readable(zmq::socket_t& sock);
+
+    /**
+     * @return number of messages without handler
+     */
+    inline
+    uint64_t
+    unmatched() const
+    {
+      return unmatched_;
+    }
+
+  private:
+    typedef std::map<std::string, Handler*> Topics;
+
+    struct Node
+    {
+      uint32_t edges; //!< index of first child in labels_ and targets_
+      uint32_t count; //!< number of children
+      Handler* handler;
+    };
+
+    zmq::socket_t& sock_;
+
+    Topics topics_;
+
+    std::set<std::string> subscribed_;
+
+    std::vector<Node> nodes_; //!< trie, root is 0
+
+    std::vector<unsigned char> labels_; //!< sorted per node
+
+    std::vector<uint32_t> targets_;
+
+    bool compiled_;
+
+    uint64_t unmatched_;
+
+    /**
+     * Build node for topics from @c lo to @c hi sharing @c depth bytes
+     * @return node index
+     */
+    ZMQMESSAGE_DLL_LOCAL
+    uint32_t
+    build(Topics::const_iterator lo, Topics::const_iterator hi,
+      size_t depth);
+  };
+}
+
+#endif /* ZMQMESSAGE_TOPICDISPATCHER_HPP_ */
@@ -0,0 +1,198 @@
+/**
+ * @file TopicDispatcherFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of TopicDispatcher methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_TOPICDISPATCHERFULLIMPL_HPP_
+#define ZMQMESSAGE_TOPICDISPATCHERFULLIMPL_HPP_
+
+#include <algorithm>
+
+namespace ZmqMessage
+{
+  TopicDispatcher::Handler::~Handler()
+  {}
+
+  TopicDispatcher::TopicDispatcher(zmq::socket_t& sock) :
+    sock_(sock), compiled_(false), unmatched_(0)
+  {}
+
+  void
+  TopicDispatcher::add(const std::string& prefix, Handler& handler)
+  {
+    topics_[prefix] = &handler;
+    compiled_ = false;
+  }
+
+  bool
+  TopicDispatcher::remove(const std::string& prefix)
+  {
+    if (!topics_.erase(prefix))
+    {
+      return false;
+    }
+    compiled_ = false;
+    return true;
+  }
+
+  uint32_t
+  TopicDispatcher::build(Topics::const_iterator lo, Topics::const_iterator hi,
+    size_t depth)
+  {
+    const uint32_t index = static_cast<uint32_t>(nodes_.size());
+    const Node node = {0, 0, 0};
+    nodes_.push_back(node);
+    //topics are sorted, so the one ending here is first
+    if (lo != hi && lo->first.size() == depth)
+    {
+      nodes_[index].handler = lo->second;
+      ++lo;
+    }
+
+    std::vector<Topics::const_iterator> groups;
+    for (Topics::const_iterator it = lo; it != hi; ++it)
+    {
+      if (groups.empty() ||
+        it->first[depth] != groups.back()->first[depth])
+      {
+        groups.push_back(it);
+      }
+    }
+    const uint32_t edges = static_cast<uint32_t>(labels_.size());
+    nodes_[index].edges = edges;
+    nodes_[index].count = static_cast<uint32_t>(groups.size());
+    for (size_t g = 0; g < groups.size(); ++g)
+    {
+      labels_.push_back(static_cast<unsigned char>(groups[g]->first[depth]));
+      targets_.push_back(0);
+    }
+    groups.push_back(hi);
+    for (size_t g = 0; g + 1 < groups.size(); ++g)
+    {
+      const uint32_t child = build(groups[g], groups[g + 1], depth + 1);
+      targets_[edges + g] = child;
+    }
+    return index;
+  }
+
+  TopicDispatcher::Handler*
+  TopicDispatcher::match(const void* topic, size_t sz)
+  {
+    if (!compiled_)
+    {
+      nodes_.clear();
+      labels_.clear();
+      targets_.clear();
+      build(topics_.begin(), topics_.end(), 0);
+      compiled_ = true;
+    }
+
+    const unsigned char* p = static_cast<const unsigned char*>(topic);
+    const unsigned char* const labels =
+      labels_.empty() ? 0 : &labels_[0];
+    Handler* found = nodes_[0].handler;
+    uint32_t node = 0;
+    for (size_t i = 0; i < sz; ++i)
+    {
+      const Node& n = nodes_[node];
+      const unsigned char* const begin = labels + n.edges;
+      const unsigned char* const end = begin + n.count;
+      const unsigned char* const edge = std::lower_bound(begin, end, p[i]);
+      if (edge == end || *edge != p[i])
+      {
+        break;
+      }
+      node = targets_[edge - labels];
+      if (nodes_[node].handler)
+      {
+        found = nodes_[node].handler;
+      }
+    }
+    return found;
+  }
+
+  size_t
+  TopicDispatcher::subscribe() throw(ZmqErrorType)
+  {
+    //prefixes not covered by shorter ones (they precede in sorted order)
+    std::set<std::string> wanted;
+    const std::string* last = 0;
+    for (Topics::const_iterator it = topics_.begin();
+         it != topics_.end(); ++it)
+    {
+      if (last && !it->first.compare(0, last->size(), *last))
+      {
+        continue;
+      }
+      wanted.insert(wanted.end(), it->first);
+      last = &it->first;
+    }
+
+    size_t calls = 0;
+    try
+    {
+      //new subscriptions first, so no message is lost in between
+      for (std::set<std::string>::const_iterator it = wanted.begin();
+           it != wanted.end(); ++it)
+      {
+        if (!subscribed_.count(*it))
+        {
+          sock_.setsockopt(ZMQ_SUBSCRIBE, it->data(), it->size());
+          subscribed_.insert(*it);
+          ++calls;
+        }
+      }
+      for (std::set<std::string>::iterator it = subscribed_.begin();
+           it != subscribed_.end(); )
+      {
+        if (wanted.count(*it))
+        {
+          ++it;
+          continue;
+        }
+        sock_.setsockopt(ZMQ_UNSUBSCRIBE, it->data(), it->size());
+        subscribed_.erase(it++);
+        ++calls;
+      }
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+    return calls;
+  }
+
+  bool
+  TopicDispatcher::dispatch(Incoming<SimpleRouting>& incoming)
+    throw(ZmqErrorType, MessageFormatError)
+  {
+    if (!incoming.size())
+    {
+      incoming.receive(1, false);
+    }
+    zmq::message_t& topic = incoming[0].msg();
+    Handler* handler = match(topic.data(), topic.size());
+    if (!handler)
+    {
+      ++unmatched_;
+      return false;
+    }
+    handler->handle(incoming);
+    return true;
+  }
+
+  void
+  TopicDispatcher::on_readable(zmq::socket_t& sock)
+  {
+    Incoming<SimpleRouting> incoming(sock);
+    dispatch(incoming);
+    incoming.drop_tail();
+  }
+}
+
+#endif /* ZMQMESSAGE_TOPICDISPATCHERFULLIMPL_HPP_ */
@@ -0,0 +1,309 @@
+/**
+ * @file Transport.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ */
+
+#ifndef ZMQMESSAGE_TRANSPORT_HPP_
+#define ZMQMESSAGE_TRANSPORT_HPP_
+
+#include <cerrno>
+#include <deque>
+#include <memory>
+
+#include <ZmqMessageFwd.hpp>
+#include <ZmqTools.hpp>
+
+#include <zmqmessage/Config.hpp>
+#include <zmqmessage/NonCopyable.hpp>
+#include <zmqmessage/Part.hpp>
+#include <zmqmessage/LocalChannel.hpp>
+
+namespace ZmqMessage
+{
+  /**
+   * @brief Message parts transport for Incoming and Sink
+   * other than zmq socket.
+   *
+   * It's what Incoming and Sink need from socket:
+   * send and receive one part with zmq flags
+   * (ZMQ_SNDMORE, ZMQ_NOBLOCK), has_more(), waiting for message.
+   * Multipart message is atomic as in zmq: sending may block (fail)
+   * only on its first part, receiving of the first part
+   * means the rest is available.
+   * @code
+   * ZmqMessage::LoopbackTransport loop;
+   * ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+   * out << "a" << "b" << ZmqMessage::Flush;
+   * ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+   * in.receive_all();
+   * @endcode
+   */
+  class ZMQMESSAGE_DLL_PUBLIC Transport
+  {
+  public:
+    virtual
+    ~Transport();
+
+    /**
+     * Send message part, its content is moved (message becomes empty).
+     * @return false if it would block
+     */
+    virtual
+    bool
+    send(zmq::message_t& msg, int flags) throw(ZmqErrorType) = 0;
+
+    /**
+     * Receive message part into msg (its previous content is released).
+     * @return false if it would block (transports which cannot wait
+     *  return false without ZMQ_NOBLOCK too)
+     */
+    virtual
+    bool
+    recv(zmq::message_t& msg, int flags) throw(ZmqErrorType) = 0;
+
+    /**
+     * @return true if received part is not the last one
+     */
+    virtual
+    bool
+    has_more() = 0;
+
+    /**
+     * Wait until message can be received.
+     * @param timeout microseconds as in zmq_poll, -1 means infinite
+     * @return false if timeout expired
+     */
+    virtual
+    bool
+    wait_readable(long timeout) throw(ZmqErrorType) = 0;
+
+    /**
+     * @return zmq socket parts are passed through, 0 if none
+     */
+    virtual
+    zmq::socket_t*
+    socket();
+  };
+
+  /**
+   * Transport of zmq socket
+   */
+  class ZMQMESSAGE_DLL_PUBLIC ZmqTransport : public Transport
+  {
+  public:
+    explicit
+    ZmqTransport(zmq::socket_t& sock);
+
+    bool
+    send(zmq::message_t& msg, int flags) throw(ZmqErrorType);
+
+    bool
+    recv(zmq::message_t& msg, int flags) throw(ZmqErrorType);
+
+    bool
+    has_more();
+
+    bool
+    wait_readable(long timeout) throw(ZmqErrorType);
+
+    zmq::socket_t*
+    socket();
+
+  private:
+    zmq::socket_t& sock_;
+  };
+
+  /**
+   * @brief In-memory transport: parts sent are received from it
+   * in the same order.
+   *
+   * It's deterministic (no threads, nothing is waited for),
+   * so it's for tests and benchmarks of code above the transport:
+   * with set_blocked() sends of new messages would block,
+   * e.g. to drive Sink to QUEUEING or DROPPING state.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC LoopbackTransport :
+    public Transport, private Private::NonCopyable
+  {
+  public:
+    LoopbackTransport();
+
+    bool
+    send(zmq::message_t& msg, int flags) throw(ZmqErrorType);
+
+    bool
+    recv(zmq::message_t& msg, int flags) throw(ZmqErrorType);
+
+    bool
+    has_more();
+
+    /**
+     * Nothing is waited for
+     * @return true if there are parts to receive
+     */
+    bool
+    wait_readable(long timeout) throw(ZmqErrorType);
+
+    /**
+     * Make sending of the next messages would block (or not).
+     * Message being sent is not affected.
+     */
+    inline
+    void
+    set_blocked(bool blocked)
+    {
+      blocked_ = blocked;
+    }
+
+    /**
+     * @return number of parts to receive
+     */
+    inline
+    size_t
+    queued() const
+    {
+      return frames_.size();
+    }
+
+  private:
+    struct Frame
+    {
+      Part part;
+      bool more;
+    };
+
+    std::deque<Frame> frames_;
+
+    bool blocked_;
+
+    bool sending_; //!< message is being sent (its parts are accepted)
+
+    bool more_;
+  };
+
+  /**
+   * @brief Transport of LocalChannel: one Multipart is passed
+   * for each message, parts are moved to and from it.
+   *
+   * Any number of transports may send to channel,
+   * one transport (thread) receives.
+   * Sending would block on the first part if channel is full.
+   * If channel becomes full while parts of message are sent
+   * (by other senders), the last part waits for room,
+   * as message is accepted already. Blocked sender sleeps
+   * in LocalChannel::wait_writable() until receiver takes a message,
+   * so it waits as long as receiver does not receive (like zmq socket
+   * at HWM), but does not spin.
+   */
+  class ZMQMESSAGE_DLL_PUBLIC LocalChannelTransport :
+    public Transport, private Private::NonCopyable
+  {
+  public:
+    explicit
+    LocalChannelTransport(LocalChannel& channel);
+
+    bool
+    send(zmq::message_t& msg, int flags) throw(ZmqErrorType);
+
+    bool
+    recv(zmq::message_t& msg, int flags) throw(ZmqErrorType);
+
+    bool
+    has_more();
+
+    bool
+    wait_readable(long timeout) throw(ZmqErrorType);
+
+    inline
+    LocalChannel&
+    channel()
+    {
+      return channel_;
+    }
+
+  private:
+    LocalChannel& channel_;
+
+    std::auto_ptr<LocalChannel::Message> out_; //!< message being sent
+
+    std::auto_ptr<Multipart> in_; //!< message being received
+
+    size_t in_idx_; //!< next part of @c in_ to receive
+
+    bool more_;
+  };
+
+  /**
+   * Receive message part from transport
+   */
+  ZMQMESSAGE_DLL_PUBLIC
+  inline
+  void
+  recv_msg(Transport& transport, zmq::message_t& msg,
+    int flags = 0) throw(ZmqErrorType)
+  {
+    if (!transport.recv(msg, flags))
+    {
+      errno = EAGAIN;
+      throw_zmq_exception(zmq::error_t());
+    }
+  }
+
+  /**
+   * Try to receive message part from transport.
+   * @return false if would block
+   */
+  ZMQMESSAGE_DLL_PUBLIC
+  inline
+  bool
+  try_recv_msg(Transport& transport, zmq::message_t& msg,
+    int flags = ZMQ_NOBLOCK) throw(ZmqErrorType)
+  {
+    return transport.recv(msg, flags);
+  }
+
+  /**
+   * Send message part to transport with specified flags
+   */
+  ZMQMESSAGE_DLL_PUBLIC
+  inline
+  void
+  send_msg(Transport& transport, zmq::message_t& msg, int flags)
+    throw(ZmqErrorType)
+  {
+    if (!transport.send(msg, flags))
+    {
+      errno = EAGAIN;
+      throw_zmq_exception(zmq::error_t());
+    }
+  }
+
+  /**
+   * Does specified transport has more messages to receive
+   */
+  ZMQMESSAGE_DLL_PUBLIC
+  inline
+  bool
+  has_more(Transport& transport)
+  {
+    return transport.has_more();
+  }
+
+  /**
+   * Wait until transport has message to receive.
+   * @param timeout microseconds as in zmq_poll, -1 means infinite
+   * @return false if timeout expired
+   */
+  ZMQMESSAGE_DLL_PUBLIC
+  inline
+  bool
+  wait_readable(Transport& transport, long timeout) throw(ZmqErrorType)
+  {
+    return transport.wait_readable(timeout);
+  }
+}
+
+#endif /* ZMQMESSAGE_TRANSPORT_HPP_ */
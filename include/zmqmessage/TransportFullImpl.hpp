@@ -0,0 +1,202 @@
+/**
+ * @file TransportFullImpl.hpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ * Full definition of Transport methods.
+ * Included from ZmqMessageImpl.hpp, see ZmqMessageFullImpl.hpp.
+ */
+
+#ifndef ZMQMESSAGE_TRANSPORTFULLIMPL_HPP_
+#define ZMQMESSAGE_TRANSPORTFULLIMPL_HPP_
+
+namespace ZmqMessage
+{
+  Transport::~Transport()
+  {}
+
+  zmq::socket_t*
+  Transport::socket()
+  {
+    return 0;
+  }
+
+  ZmqTransport::ZmqTransport(zmq::socket_t& sock) :
+    sock_(sock)
+  {}
+
+  bool
+  ZmqTransport::send(zmq::message_t& msg, int flags) throw(ZmqErrorType)
+  {
+    bool res = false;
+    try
+    {
+      res = sock_.send(msg, flags);
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+    return res;
+  }
+
+  bool
+  ZmqTransport::recv(zmq::message_t& msg, int flags) throw(ZmqErrorType)
+  {
+    return try_recv_msg(sock_, msg, flags);
+  }
+
+  bool
+  ZmqTransport::has_more()
+  {
+    return ZmqMessage::has_more(sock_);
+  }
+
+  bool
+  ZmqTransport::wait_readable(long timeout) throw(ZmqErrorType)
+  {
+    return ZmqMessage::wait_readable(sock_, timeout);
+  }
+
+  zmq::socket_t*
+  ZmqTransport::socket()
+  {
+    return &sock_;
+  }
+
+  LoopbackTransport::LoopbackTransport() :
+    blocked_(false), sending_(false), more_(false)
+  {}
+
+  bool
+  LoopbackTransport::send(zmq::message_t& msg, int flags)
+    throw(ZmqErrorType)
+  {
+    if (!sending_ && blocked_)
+    {
+      return false;
+    }
+    frames_.push_back(Frame());
+    Frame& frame = frames_.back();
+    frame.part.move(msg);
+    frame.more = flags & ZMQ_SNDMORE;
+    sending_ = frame.more;
+    return true;
+  }
+
+  bool
+  LoopbackTransport::recv(zmq::message_t& msg, int flags)
+    throw(ZmqErrorType)
+  {
+    if (frames_.empty())
+    {
+      return false;
+    }
+    Frame& frame = frames_.front();
+    try
+    {
+      msg.move(&frame.part.msg());
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+    more_ = frame.more;
+    frames_.pop_front();
+    return true;
+  }
+
+  bool
+  LoopbackTransport::has_more()
+  {
+    return more_;
+  }
+
+  bool
+  LoopbackTransport::wait_readable(long timeout) throw(ZmqErrorType)
+  {
+    return !frames_.empty();
+  }
+
+  LocalChannelTransport::LocalChannelTransport(LocalChannel& channel) :
+    channel_(channel), in_idx_(0), more_(false)
+  {}
+
+  bool
+  LocalChannelTransport::send(zmq::message_t& msg, int flags)
+    throw(ZmqErrorType)
+  {
+    if (!out_.get())
+    {
+      while (channel_.size() >= channel_.capacity())
+      {
+        if (flags & ZMQ_NOBLOCK)
+        {
+          return false;
+        }
+        channel_.wait_writable(-1);
+      }
+      out_.reset(new LocalChannel::Message);
+    }
+    out_->add().move(msg);
+    if (flags & ZMQ_SNDMORE)
+    {
+      return true;
+    }
+
+    std::auto_ptr<Multipart> ready(out_.release());
+    while (!channel_.send(ready))
+    {
+      channel_.wait_writable(-1);
+    }
+    return true;
+  }
+
+  bool
+  LocalChannelTransport::recv(zmq::message_t& msg, int flags)
+    throw(ZmqErrorType)
+  {
+    while (!in_.get() || in_idx_ >= in_->size())
+    {
+      in_.reset(channel_.receive());
+      in_idx_ = 0;
+      if (!in_.get())
+      {
+        if (flags & ZMQ_NOBLOCK)
+        {
+          return false;
+        }
+        channel_.wait(-1);
+      }
+    }
+    try
+    {
+      msg.move(&(*in_)[in_idx_].msg());
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+    more_ = ++in_idx_ < in_->size();
+    if (!more_)
+    {
+      in_.reset();
+    }
+    return true;
+  }
+
+  bool
+  LocalChannelTransport::has_more()
+  {
+    return more_;
+  }
+
+  bool
+  LocalChannelTransport::wait_readable(long timeout) throw(ZmqErrorType)
+  {
+    return in_.get() || channel_.wait(timeout);
+  }
+}
+
+#endif /* ZMQMESSAGE_TRANSPORTFULLIMPL_HPP_ */
@@ -13,6 +13,7 @@
 #ifndef ZMQMESSAGE_ZMQMESSAGEFULLIMPL_HPP_
 #define ZMQMESSAGE_ZMQMESSAGEFULLIMPL_HPP_
 
+#include <cstring>
 #include <tr1/functional>
 
 namespace ZmqMessage
@@ -57,10 +58,20 @@ namespace ZmqMessage
     }
   }
 
+  void
+  Multipart::decode_part(Part& part) const
+  {
+    if (codec_ && part.received())
+    {
+      codec_->decode(part);
+    }
+  }
+
   Part&
   Multipart::operator[](size_t i) throw (NoSuchPartError)
   {
     check_has_part(i);
+    decode_part((*parts_ptr_)[i]);
     return (*parts_ptr_)[i];
   }
 
@@ -68,6 +79,7 @@ namespace ZmqMessage
   Multipart::operator[](size_t i) const throw (NoSuchPartError)
   {
     check_has_part(i);
+    decode_part((*parts_ptr_)[i]);
     return (*parts_ptr_)[i];
   }
 
@@ -91,6 +103,14 @@ namespace ZmqMessage
   void
   XRouting::receive_routing(zmq::socket_t& sock)
     throw (MessageFormatError, ZmqErrorType)
+  {
+    ZmqTransport transport(sock);
+    receive_routing(transport);
+  }
+
+  void
+  XRouting::receive_routing(Transport& transport)
+    throw (MessageFormatError, ZmqErrorType)
   {
     if (size_)
     {
@@ -108,7 +128,7 @@ namespace ZmqMessage
         throw MessageFormatError(ss.str());
       }
 
-      recv_msg(sock, part->msg());
+      recv_msg(transport, part->msg());
       ZMQMESSAGE_LOG_STREAM <<
         "Received X route: " << part->msg().size() << "bytes;" <<
         ZMQMESSAGE_LOG_TERM;
@@ -117,7 +137,7 @@ namespace ZmqMessage
       {
         break;
       }
-      if (!has_more(sock))
+      if (!has_more(transport))
       {
         std::ostringstream ss;
         ss << "Receiving multipart message: reading route info failed: "
@@ -175,6 +195,38 @@ namespace ZmqMessage
     }
   }
 
+  template <>
+  void
+  Outgoing<SimpleRouting>::send_route(
+    const Private::RouteOf<SimpleRouting>::type& route) throw (ZmqErrorType)
+  {
+    //never called: there is no route of simple routing
+  }
+
+  template <>
+  void
+  Outgoing<XRouting>::send_route(
+    const RouteHandle& route) throw (ZmqErrorType)
+  {
+    if (route.empty())
+    {
+      send_routing(0, 0);
+      return;
+    }
+    for (size_t n = 0; n < route.size(); ++n)
+    {
+      const char* data = 0;
+      const size_t sz = route.part(n, data);
+      Part part(sz);
+      if (sz)
+      {
+        ::memcpy(part.msg().data(), data, sz);
+      }
+      add_pending_routing_part();
+      send_one(part, false);
+    }
+  }
+
   Sink&
   Sink::operator<< (Part& msg)
     throw (ZmqErrorType)
@@ -203,6 +255,12 @@ namespace ZmqMessage
       Part part(m.data.ptr, m.sz, m.deleter, m.hint);
       send_owned(part);
     }
+    else if (part_allocator_)
+    {
+      Part part;
+      init_msg(m.data.cptr, m.sz, part.msg(), *part_allocator_);
+      send_owned(part);
+    }
     else
     {
       Part part;
@@ -215,6 +273,7 @@ namespace ZmqMessage
   void
   Sink::add_to_queue(Part& msg)
   {
+    ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_SINK_QUEUE);
     Part* target = outgoing_queue_->next();
     assert(target);
     target->move(msg);
@@ -228,7 +287,14 @@ namespace ZmqMessage
     const int flags = get_send_flags(last);
     notify_on_send(msg, flags);
 
-    send_msg(dst_, msg.msg(), flags);
+    if (transport_)
+    {
+      send_msg(*transport_, msg.msg(), flags);
+    }
+    else
+    {
+      send_msg(*dst_, msg.msg(), flags);
+    }
 
     if (pending_routing_parts_ > 0)
     {
@@ -245,13 +311,20 @@ namespace ZmqMessage
     notify_on_send(msg, flags);
 
     bool ok = false;
-    try
+    if (transport_)
     {
-      ok = dst_.send(msg, flags);
+      ok = transport_->send(msg.msg(), flags);
     }
-    catch (const zmq::error_t& e)
+    else
     {
-      throw_zmq_exception(e);
+      try
+      {
+        ok = dst_->send(msg, flags);
+      }
+      catch (const zmq::error_t& e)
+      {
+        throw_zmq_exception(e);
+      }
     }
 
     if (ok && pending_routing_parts_ > 0)
@@ -278,6 +351,7 @@ namespace ZmqMessage
       send_observer_->on_send_part(msg.msg());
     }
 
+    ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_LOGGING);
     ZMQMESSAGE_LOG_STREAM
       << "Outgoing sending msg, " << msg.msg().size() << " bytes: "
       << ZMQMESSAGE_STRING_CLASS((const char*)msg.msg().data(),
@@ -322,6 +396,7 @@ namespace ZmqMessage
           << "Cannot send first outgoing message: would block: start caching"
           << ZMQMESSAGE_LOG_TERM;
         state_ = QUEUEING;
+        ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_SINK_QUEUE);
         outgoing_queue_.reset(new QueueContainer(init_queue_len));
         add_to_queue(cached_);
       }
@@ -363,6 +438,71 @@ namespace ZmqMessage
 
   void
   Sink::send_owned(Part& owned) throw(ZmqErrorType)
+  {
+    if (routing_to_insert_)
+    {
+      --routing_to_insert_;
+    }
+    else if (options_ & OutOptions::PACKED)
+    {
+      pack_owned(owned);
+      return;
+    }
+    else if (codec_ && state_ != FLUSHED && state_ != DROPPING)
+    {
+      codec_->encode(owned);
+    }
+    do_send_owned(owned);
+  }
+
+  void
+  Sink::send_owned_as_is(Part& owned) throw(ZmqErrorType)
+  {
+    if (routing_to_insert_)
+    {
+      --routing_to_insert_;
+    }
+    do_send_owned(owned);
+  }
+
+  void
+  Sink::pack_owned(Part& owned)
+  {
+    Part consumed;
+    consumed.move(owned);
+    if (state_ == FLUSHED)
+    {
+      ZMQMESSAGE_LOG_STREAM << "trying to send a message in FLUSHED state"
+        << ZMQMESSAGE_LOG_TERM;
+      return;
+    }
+    if (codec_)
+    {
+      //frame is encoded as a whole, forwarded parts must be plain
+      codec_->decode(consumed);
+    }
+    Private::pack_append(packed_area_,
+      consumed.msg().data(), consumed.msg().size());
+    ++packed_parts_;
+  }
+
+  void
+  Sink::send_packed() throw(ZmqErrorType)
+  {
+    Part frame;
+    Private::pack_frame(packed_area_, packed_parts_, frame.msg(),
+      part_allocator_);
+    packed_parts_ = 0;
+    packed_area_.clear();
+    if (codec_)
+    {
+      codec_->encode(frame);
+    }
+    do_send_owned(frame);
+  }
+
+  void
+  Sink::do_send_owned(Part& owned) throw(ZmqErrorType)
   {
     switch (state_)
     {
@@ -417,6 +557,10 @@ namespace ZmqMessage
   void
   Sink::flush() throw(ZmqErrorType)
   {
+    if (packed_parts_)
+    {
+      send_packed();
+    }
     if (state_ == DROPPING)
     {
       return;
@@ -483,6 +627,26 @@ namespace ZmqMessage
     {
       Part cur_part;
       recv_msg(relay_src, cur_part.msg());
+      cur_part.set_received(true);
+      more = has_more(relay_src);
+      if (receive_observer)
+      {
+        receive_observer->on_receive_part(cur_part.msg(), more);
+      }
+      send_owned(cur_part);
+    }
+  }
+
+  void
+  Sink::relay_from(
+    Transport& relay_src, ReceiveObserver* receive_observer)
+    throw (ZmqErrorType)
+  {
+    for (bool more = has_more(relay_src); more; )
+    {
+      Part cur_part;
+      recv_msg(relay_src, cur_part.msg());
+      cur_part.set_received(true);
       more = has_more(relay_src);
       if (receive_observer)
       {
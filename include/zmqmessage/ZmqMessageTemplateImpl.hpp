@@ -8,6 +8,7 @@
  * They are to be instantiated in client code.
  */
 
+#include <cerrno>
 #include <functional>
 #include <algorithm>
 
@@ -37,23 +38,30 @@ namespace ZmqMessage
       return;
     }
 
+    ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_ITERATOR);
     get((*multipart_)[idx_].msg(), cur_, binary_mode_);
   }
 
   template <typename Allocator>
   DynamicPartsStorage<Allocator>::DynamicPartsStorage(size_t capacity) :
-    parts_(Allocator::allocate(capacity)),
+    parts_(0),
     capacity_(capacity),
     size_(0)
-  {}
+  {
+    ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_PARTS_STORAGE);
+    parts_ = Allocator::allocate(capacity);
+  }
 
   template <typename Allocator>
   DynamicPartsStorage<Allocator>::DynamicPartsStorage(
     Private::RoutingStorageTag tag) :
-    parts_(Allocator::allocate(ZMQMESSAGE_ROUTING_CAPACITY)),
+    parts_(0),
     capacity_(ZMQMESSAGE_ROUTING_CAPACITY),
     size_(0)
-  {}
+  {
+    ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_PARTS_STORAGE);
+    parts_ = Allocator::allocate(ZMQMESSAGE_ROUTING_CAPACITY);
+  }
 
   template <typename Allocator>
   DynamicPartsStorage<Allocator>::DynamicPartsStorage() :
@@ -86,6 +94,7 @@ namespace ZmqMessage
 
     if (size_ == capacity_)
     {
+      ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_PARTS_STORAGE);
       const size_t new_capacity = capacity_ << 1;
       Private::ScopedAlloc<Allocator> alloc(new_capacity);
 
@@ -112,6 +121,7 @@ namespace ZmqMessage
   DynamicPartsStorage<Allocator>::detach()
   {
     typedef Private::MultipartContainer<DynamicPartsStorage<Allocator> > Cont;
+    ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_PARTS_STORAGE);
     std::auto_ptr<Cont> ptr(new Cont());
     ptr->parts_ = parts_;
     ptr->capacity_ = capacity_;
@@ -128,23 +138,67 @@ namespace ZmqMessage
     Part& part) throw(ZmqErrorType)
   {
     assert(part.valid());
-    recv_msg(src_, part.msg());
-    const bool more = has_more(src_);
+    //next parts of multipart are delivered together with the first one
+    if (spin_wait_ && !transport_ && size() == 1)
+    {
+      spin_wait_->recv(*src_, part.msg());
+    }
+    else if (transport_)
+    {
+      recv_msg(*transport_, part.msg());
+    }
+    else
+    {
+      recv_msg(*src_, part.msg());
+    }
+    part.set_received(true);
+    const bool more = src_has_more();
     if (receive_observer_)
     {
       receive_observer_->on_receive_part(part.msg(), more);
     }
+    PartCodec* codec = this->codec();
+    if (codec && codec->decode_on_receive())
+    {
+      codec->decode(part);
+    }
     return more;
   }
 
+  template <class RoutingPolicy, class PartsStorage>
+  bool
+  Incoming<RoutingPolicy, PartsStorage>::try_recv_part(
+    zmq::message_t& msg, int flags) throw(ZmqErrorType)
+  {
+    return transport_ ? try_recv_msg(*transport_, msg, flags) :
+      try_recv_msg(*src_, msg, flags);
+  }
+
+  template <class RoutingPolicy, class PartsStorage>
+  bool
+  Incoming<RoutingPolicy, PartsStorage>::src_has_more()
+  {
+    return transport_ ? has_more(*transport_) : has_more(*src_);
+  }
+
+  template <class RoutingPolicy, class PartsStorage>
+  bool
+  Incoming<RoutingPolicy, PartsStorage>::src_readable(long timeout)
+    throw(ZmqErrorType)
+  {
+    return transport_ ? wait_readable(*transport_, timeout) :
+      wait_readable(*src_, timeout);
+  }
+
   template <class RoutingPolicy, class PartsStorage>
   template <typename T>
   Incoming<RoutingPolicy, PartsStorage>&
   Incoming<RoutingPolicy, PartsStorage>::operator>> (T& t)
   throw(NoSuchPartError)
   {
-    Multipart::check_has_part(cur_extract_idx_);
-    get(Multipart::parts()[cur_extract_idx_++].msg(), t, binary_mode_);
+    ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_EXTRACT);
+    get(Multipart::operator[](cur_extract_idx_).msg(), t, binary_mode_);
+    ++cur_extract_idx_;
     return *this;
   }
 
@@ -194,14 +248,51 @@ namespace ZmqMessage
 
     const bool more = do_receive_msg(*cur_part);
 
-    ZMQMESSAGE_LOG_STREAM << "Incoming received "
-      << cur_part->msg().size() << " bytes: "
-      << ZMQMESSAGE_STRING_CLASS((const char*)cur_part->msg().data(),
-        std::min(cur_part->msg().size(), static_cast<size_t>(256)))
-      << ", has more = " << more << ZMQMESSAGE_LOG_TERM;
+    {
+      ZMQMESSAGE_ALLOC_SCOPE(ALLOC_SITE_LOGGING);
+      ZMQMESSAGE_LOG_STREAM << "Incoming received "
+        << cur_part->msg().size() << " bytes: "
+        << ZMQMESSAGE_STRING_CLASS((const char*)cur_part->msg().data(),
+          std::min(cur_part->msg().size(), static_cast<size_t>(256)))
+        << ", has more = " << more << ZMQMESSAGE_LOG_TERM;
+    }
+
+    if (packed_ && !more && size() == 1)
+    {
+      //packed frame is encoded as a whole
+      Multipart::decode_part(*cur_part);
+      const size_t count = Private::packed_count(cur_part->msg());
+      if (count)
+      {
+        unpack_received(count);
+      }
+    }
     return more;
   }
 
+  template <class RoutingPolicy, class PartsStorage>
+  void
+  Incoming<RoutingPolicy, PartsStorage>::unpack_received(size_t count)
+  throw(ZmqErrorType, MessageFormatError)
+  {
+    for (size_t i = 1; i < count; ++i)
+    {
+      if (!ContainerType::next())
+      {
+        std::ostringstream ss;
+        ss <<
+          "Receiving multipart: "
+          "Cannot allocate storage for unpacked part, "
+          "size " << size() << " reached, packed " << count;
+        throw MessageFormatError(ss.str());
+      }
+    }
+    //storage is not reallocated any more, parts are contiguous
+    Private::unpack(Multipart::parts()[0], Multipart::parts(), count);
+    ZMQMESSAGE_LOG_STREAM << "Incoming unpacked " << count << " parts"
+      << ZMQMESSAGE_LOG_TERM;
+  }
+
   template <class RoutingPolicy, class PartsStorage>
   void
   Incoming<RoutingPolicy, PartsStorage>::validate(
@@ -237,12 +328,21 @@ namespace ZmqMessage
     size_t part_names_length, bool check_terminal)
     throw (MessageFormatError, ZmqErrorType)
   {
-    RoutingPolicy::receive_routing(src_);
+    if (transport_)
+    {
+      RoutingPolicy::receive_routing(*transport_);
+    }
+    else
+    {
+      RoutingPolicy::receive_routing(*src_);
+    }
     RoutingPolicy::log_routing_received();
 
-    for (size_t i = 0, init_parts = size(); i < parts; ++i)
+    //packed frame brings several parts at once
+    for (size_t init_parts = size(); size() - init_parts < parts; )
     {
       bool more = receive_one();
+      const size_t i = std::min(size() - init_parts, parts) - 1;
       const char* const part_name =
         (i < part_names_length) ? part_names[i] : "<unnamed>";
 
@@ -256,9 +356,12 @@ namespace ZmqMessage
           "(" << (init_parts + i) << "), expected more";
         throw MessageFormatError(ss.str());
       }
-      if (i == parts - 1 && more)
+      //unpacked more parts than requested
+      const bool more_parts = more || (size() - init_parts > parts);
+
+      if (i == parts - 1 && more_parts)
       {
-        is_terminal_= false;
+        is_terminal_= !more;
         if (check_terminal)
         {
           std::ostringstream ss;
@@ -269,7 +372,7 @@ namespace ZmqMessage
           throw MessageFormatError(ss.str());
         }
       }
-      if (i == parts - 1 && !more)
+      if (i == parts - 1 && !more_parts)
       {
         is_terminal_ = true;
       }
@@ -310,6 +413,74 @@ namespace ZmqMessage
     return *this;
   }
 
+  template <class RoutingPolicy, class PartsStorage>
+  bool
+  Incoming<RoutingPolicy, PartsStorage>::try_receive(
+    long timeout, size_t parts, bool check_terminal)
+    throw (MessageFormatError, ZmqErrorType)
+  {
+    //parts of message started are delivered together
+    if (!size() && !src_readable(timeout))
+    {
+      return false;
+    }
+    try
+    {
+      receive(parts, 0, 0, check_terminal);
+    }
+    catch (const MessageFormatError&)
+    {
+      drop_tail();
+      throw;
+    }
+    return true;
+  }
+
+  template <class RoutingPolicy, class PartsStorage>
+  bool
+  Incoming<RoutingPolicy, PartsStorage>::try_receive_all(
+    long timeout, size_t min_parts)
+    throw (MessageFormatError, ZmqErrorType)
+  {
+    if (!size() && !src_readable(timeout))
+    {
+      return false;
+    }
+    try
+    {
+      receive_all(min_parts, 0, 0);
+    }
+    catch (const MessageFormatError&)
+    {
+      drop_tail();
+      throw;
+    }
+    return true;
+  }
+
+  template <class RoutingPolicy, class PartsStorage>
+  bool
+  Incoming<RoutingPolicy, PartsStorage>::try_receive_up_to(
+    long timeout, size_t min_parts,
+    const char* part_names[], size_t max_parts)
+    throw (MessageFormatError, ZmqErrorType)
+  {
+    if (!size() && !src_readable(timeout))
+    {
+      return false;
+    }
+    try
+    {
+      receive_up_to(min_parts, part_names, max_parts);
+    }
+    catch (const MessageFormatError&)
+    {
+      drop_tail();
+      throw;
+    }
+    return true;
+  }
+
   template <class RoutingPolicy, class PartsStorage>
   int
   Incoming<RoutingPolicy, PartsStorage>::fetch_tail(
@@ -325,7 +496,7 @@ namespace ZmqMessage
     size_t delim_sz = (delimiter) ? ::strlen(delimiter) : 0;
 
     int num_messages = 1;
-    for (bool more = has_more(src_); more; ++num_messages)
+    for (bool more = src_has_more(); more; ++num_messages)
     {
       if (delim_sz)
       {
@@ -354,11 +525,11 @@ namespace ZmqMessage
     int num_messages = 0;
     if (!size()) //we haven't received anything
     {
-      if (!try_recv_msg(src_, data_buff.msg(), ZMQ_NOBLOCK))
+      if (!try_recv_part(data_buff.msg(), ZMQ_NOBLOCK))
       {
         return 0;
       }
-      more = has_more(src_);
+      more = src_has_more();
       if (receive_observer_)
       {
         receive_observer_->on_receive_part(data_buff.msg(), more);
@@ -367,13 +538,14 @@ namespace ZmqMessage
     }
     else
     {
-      more = has_more(src_);
+      more = src_has_more();
     }
 
     for (; more; ++num_messages)
     {
       more = do_receive_msg(data_buff);
     }
+    is_terminal_ = true;
     return num_messages;
   }
 
@@ -382,8 +554,53 @@ namespace ZmqMessage
   Incoming<RoutingPolicy, PartsStorage>::operator>> (
     zmq::message_t& msg) throw(NoSuchPartError)
   {
-    Multipart::check_has_part(cur_extract_idx_);
-    copy_msg(msg, Multipart::parts()[cur_extract_idx_++].msg());
+    copy_msg(msg, Multipart::operator[](cur_extract_idx_).msg());
+    ++cur_extract_idx_;
+    return *this;
+  }
+
+  template <class RoutingPolicy, class PartsStorage>
+  uint64_t
+  Incoming<RoutingPolicy, PartsStorage>::write_to(
+    int fd, size_t idx_from) throw(ZmqErrorType)
+  {
+    uint64_t written = 0;
+    if (idx_from < size())
+    {
+      written = write_parts(fd, Multipart::parts() + idx_from,
+        size() - idx_from);
+    }
+    if (is_terminal_ || !size())
+    {
+      return written;
+    }
+
+    static const size_t BATCH = 64;
+    Part batch[BATCH];
+    for (bool more = src_has_more(); more; )
+    {
+      size_t n = 0;
+      for (; n < BATCH && more; ++n)
+      {
+        more = do_receive_msg(batch[n]);
+      }
+      written += write_parts(fd, batch, n);
+    }
+    is_terminal_ = true;
+    return written;
+  }
+
+  template <class RoutingPolicy, class PartsStorage>
+  template <typename T>
+  Incoming<RoutingPolicy, PartsStorage>&
+  Incoming<RoutingPolicy, PartsStorage>::operator>> (const Handoff<T>& h)
+    throw(NoSuchPartError, MessageFormatError)
+  {
+    void* obj = Private::handoff_claim(
+      Multipart::operator[](cur_extract_idx_).msg(),
+      &Private::HandoffTag<T>::tag);
+    h.obj->reset(static_cast<T*>(obj));
+    ++cur_extract_idx_;
     return *this;
   }
 
@@ -402,11 +619,38 @@ namespace ZmqMessage
   {
     Part part;
     bool binary_mode = options_ & OutOptions::BINARY_MODE;
-    init_msg(t, part.msg(), binary_mode);
+    if (part_allocator_)
+    {
+      init_msg(t, part.msg(), binary_mode, *part_allocator_);
+    }
+    else
+    {
+      init_msg(t, part.msg(), binary_mode);
+    }
     send_owned(part);
     return *this;
   }
 
+  template <typename T>
+  Sink&
+  Sink::operator<< (const Handoff<T>& h) throw (ZmqErrorType)
+  {
+    assert(h.obj->get());
+    if (options_ & OutOptions::PACKED)
+    {
+      //packed frame copies the part, object could not be claimed
+      errno = EINVAL;
+      throw_zmq_exception(zmq::error_t());
+    }
+    Part part;
+    Private::handoff_init(part.msg(), h.obj->get(),
+      &Private::HandoffTag<T>::tag, &Private::handoff_delete<T>);
+    //part owns object now, it's deleted if part is dropped
+    h.obj->release();
+    send_owned_as_is(part);
+    return *this;
+  }
+
   template <class OccupationAccumulator>
   void
   Sink::relay_from(
@@ -418,6 +662,7 @@ namespace ZmqMessage
     {
       Part cur_part;
       recv_msg(relay_src, cur_part.msg());
+      cur_part.set_received(true);
       more = has_more(relay_src);
       if (receive_observer)
       {
@@ -428,6 +673,83 @@ namespace ZmqMessage
       send_owned(cur_part);
     }
   }
+
+  template <class RoutingPolicy, class PartsStorage>
+  void
+  Sink::splice_from(Incoming<RoutingPolicy, PartsStorage>& incoming,
+    size_t idx_from) throw (ZmqErrorType)
+  {
+    Multipart& received = incoming;
+    for (size_t i = idx_from; i < received.size(); ++i)
+    {
+      if (received.has_part(i))
+      {
+        send_one(received.parts()[i]);
+      }
+    }
+    if (!incoming.is_terminal_)
+    {
+      if (incoming.transport_)
+      {
+        relay_from(*incoming.transport_, incoming.receive_observer_);
+      }
+      else
+      {
+        relay_from(*incoming.src_, incoming.receive_observer_);
+      }
+      incoming.is_terminal_ = true;
+    }
+  }
+
+  template <class OutRoutingPolicy, class RoutingPolicy,
+    class PartsStorage, class Router>
+  zmq::socket_t*
+  route(Incoming<RoutingPolicy, PartsStorage>& incoming,
+    size_t header_parts, Router router, unsigned options)
+    throw (ZmqErrorType, MessageFormatError)
+  {
+    incoming.receive(header_parts, false);
+    zmq::socket_t* const dst = router(incoming);
+    if (!dst)
+    {
+      const int dropped = incoming.drop_tail();
+      ZMQMESSAGE_LOG_STREAM << "route: no destination, dropped "
+        << (incoming.size() + dropped) << " parts" << ZMQMESSAGE_LOG_TERM;
+      return 0;
+    }
+    Outgoing<OutRoutingPolicy> outgoing(*dst, incoming, options);
+    outgoing.splice_from(incoming);
+    outgoing.flush();
+    return dst;
+  }
+
+  template <class KeyFn>
+  size_t
+  ShardedSink::send_by(Multipart& multipart, KeyFn key_fn,
+    size_t idx_from, size_t idx_to)
+    throw(ZmqErrorType, NoSuchPartError)
+  {
+    const size_t shard = shard_of(key_fn(multipart), size());
+    send_to(shard, multipart, idx_from, idx_to);
+    return shard;
+  }
+
+  template <class RoutingPolicy, class PartsStorage>
+  void
+  Reactor::IncomingHandler<RoutingPolicy, PartsStorage>::on_readable(
+    zmq::socket_t& sock)
+  {
+    Incoming<RoutingPolicy, PartsStorage> incoming(sock);
+    handle(incoming);
+    incoming.drop_tail();
+  }
+
+  template <class PartsStorage>
+  RouteHandle::RouteHandle(Incoming<XRouting, PartsStorage>& incoming) :
+    env_(0)
+  {
+    init(incoming.get_routing(), incoming.get_routing_num());
+  }
 }
 
 #endif /* ZMQMESSAGE_ZMQMESSAGETEMPLATEIMPL_HPP_ */
@@ -13,6 +13,7 @@
 #ifndef ZMQMESSAGE_ZMQTOOLSFULLIMPL_HPP_
 #define ZMQMESSAGE_ZMQTOOLSFULLIMPL_HPP_
 
+#include <time.h>
 #include <string>
 
 namespace ZmqMessage
@@ -31,6 +32,20 @@ namespace ZmqMessage
     return tm;
   }
 
+  uint64_t
+  monotonic_nsec()
+  {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+  uint64_t
+  monotonic_usec()
+  {
+    return monotonic_nsec() / 1000;
+  }
+
   void
   init_msg(const void* t, size_t sz, zmq::message_t& msg)
   {
@@ -45,6 +60,13 @@ namespace ZmqMessage
     }
   }
 
+  void
+  init_msg(const void* t, size_t sz, zmq::message_t& msg,
+    PartAllocator& alloc)
+  {
+    ::memcpy(alloc.init(msg, sz), t, sz);
+  }
+
   bool
   has_more(zmq::socket_t& sock)
   {
@@ -54,6 +76,40 @@ namespace ZmqMessage
     return (more != 0);
   }
 
+  bool
+  wait_readable(zmq::socket_t& sock, long timeout) throw(ZmqErrorType)
+  {
+    zmq::pollitem_t item;
+    item.socket = sock;
+    item.fd = 0;
+    item.events = ZMQ_POLLIN;
+    item.revents = 0;
+    try
+    {
+      return zmq::poll(&item, 1, timeout) > 0;
+    }
+    catch (const zmq::error_t& e)
+    {
+      throw_zmq_exception(e);
+    }
+    return false;
+  }
+
+  Deadline::Deadline(long timeout) :
+    at_(timeout < 0 ? 0 : monotonic_usec() + timeout + 1)
+  {}
+
+  long
+  Deadline::remaining() const
+  {
+    if (!at_)
+    {
+      return -1;
+    }
+    const uint64_t now = monotonic_usec();
+    return at_ > now ? static_cast<long>(at_ - now) : 0;
+  }
+
   int
   relay_raw(zmq::socket_t& src, zmq::socket_t& dst, bool check_first_part)
   {
@@ -63,7 +119,7 @@ namespace ZmqMessage
       more; ++relayed)
     {
       zmq::message_t cur_part;
-      src.recv(&cur_part);
+      recv_msg(src, cur_part);
       more = has_more(src);
       int flag = more ? ZMQ_SNDMORE : 0;
       send_msg(dst, cur_part, flag);
@@ -0,0 +1,258 @@
+/**
+ * @file AllocTest.cpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ *
+ * \test
+ * @brief
+ * We check heap allocations performed by library in steady-state
+ * receive-handle-reply loops.
+ *
+ * Library is built with \ref ZMQMESSAGE_ALLOC_STATS,
+ * so allocations are attributed to library call sites.
+ * For every parts storage policy we run a request-response loop
+ * between 2 threads and assert exact allocation counts
+ * made by responder thread within library.
+ */
+
+#include "pthread.h"
+#include <cstddef>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+#include "../examples/StringFace.hpp"
+
+#define ZMQMESSAGE_LOG_STREAM if(1); else std::cerr
+#define ZMQMESSAGE_STRING_CLASS StringFace
+
+#include "ZmqMessage.hpp"
+#ifdef HEADERONLY
+# include "ZmqMessageImpl.hpp"
+#endif
+
+#include "zmqmessage/AllocHooks.hpp"
+
+#define ARRAY_LEN(arr) sizeof(arr)/sizeof((arr)[0])
+
+const char* endpoint = "inproc://alloc-test";
+
+const char PART1[] = "request-id-0123456789"; //longer than any SSO
+const char PART2[] = "aaaaaaaaaabbbbbbbbbbccccccccccddddddddddeeeeeeeeee"; //50b
+const int BIN_PART = 567098;
+
+const char* req_parts[] = {"id", "payload", "bin part"};
+
+const size_t WARMUP = 10;
+const size_t ITERS = 1000;
+
+zmq::context_t ctx(1);
+
+//allocations made by responder during measured iterations
+ZmqMessage::AllocStats responder_stats;
+
+typedef ZmqMessage::Incoming<
+  ZmqMessage::SimpleRouting, ZmqMessage::StackPartsStorage<3> > ResIncoming;
+
+template <typename Storage>
+struct StorageArg
+{
+  static
+  typename Storage::StorageArg
+  get()
+  {
+    return Storage::default_storage_arg;
+  }
+};
+
+template <>
+struct StorageArg<ZmqMessage::ExternalPartsStorage>
+{
+  static ZmqMessage::Part parts[ARRAY_LEN(req_parts)];
+
+  static
+  ZmqMessage::ExternalPartsStorage::Buffer
+  get()
+  {
+    return ZmqMessage::ExternalPartsStorage::Buffer(
+      parts, ARRAY_LEN(req_parts));
+  }
+};
+
+ZmqMessage::Part
+StorageArg<ZmqMessage::ExternalPartsStorage>::parts[ARRAY_LEN(req_parts)];
+
+template <typename Storage>
+void
+serve_one(zmq::socket_t& s)
+{
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting, Storage> incoming(
+    s, StorageArg<Storage>::get());
+  incoming.receive(ARRAY_LEN(req_parts), req_parts, true);
+
+  StringFace id, payload;
+  int bin = 0;
+  incoming >> id >> payload >> ZmqMessage::Binary >> bin;
+  assert(payload == PART2);
+  assert(bin == BIN_PART);
+
+  ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> outgoing(
+    s, incoming, ZmqMessage::OutOptions::BINARY_MODE);
+  outgoing << id << bin << ZmqMessage::Flush;
+}
+
+template <typename Storage>
+void*
+responder(void*)
+{
+  zmq::socket_t s(ctx, ZMQ_REP);
+  s.connect(endpoint);
+
+  for (size_t i = 0; i < WARMUP; ++i)
+  {
+    serve_one<Storage>(s);
+  }
+
+  ZmqMessage::AllocStats& stats = ZmqMessage::AllocStats::current();
+  stats.reset();
+
+  for (size_t i = 0; i < ITERS; ++i)
+  {
+    serve_one<Storage>(s);
+  }
+
+  responder_stats = stats;
+  return 0;
+}
+
+void
+requester(zmq::socket_t& s)
+{
+  for (size_t i = 0; i < WARMUP + ITERS; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> outgoing(s, 0);
+    outgoing
+      << StringFace(PART1, ARRAY_LEN(PART1)-1)
+      << StringFace(PART2, ARRAY_LEN(PART2)-1)
+      << ZmqMessage::Binary << BIN_PART
+      << ZmqMessage::Flush;
+
+    ResIncoming incoming(s);
+    incoming.receive(2, true);
+    assert(ZmqMessage::get_bin<int>(incoming[1]) == BIN_PART);
+  }
+}
+
+void
+print_stats(const ZmqMessage::AllocStats& stats)
+{
+  for (size_t i = 0; i < ZmqMessage::ALLOC_SITES_NUM; ++i)
+  {
+    ZmqMessage::AllocSite site = static_cast<ZmqMessage::AllocSite>(i);
+    std::cout << "  " << ZmqMessage::AllocStats::site_name(site) << ": "
+      << stats.allocs[i] << " allocs, " << stats.bytes[i] << " bytes"
+      << std::endl;
+  }
+}
+
+template <typename Storage>
+ZmqMessage::AllocStats
+run_loop(const char* name)
+{
+  std::cout << ">>>>>>>>>>>>>  testing " << name << std::endl;
+
+  zmq::socket_t s(ctx, ZMQ_REQ);
+  s.bind(endpoint);
+
+  pthread_t tid;
+  pthread_create(&tid, 0, responder<Storage>, 0);
+  requester(s);
+  pthread_join(tid, 0);
+
+  print_stats(responder_stats);
+  return responder_stats;
+}
+
+/**
+ * Streamable type with text form longer than any small string buffer,
+ * so conversions through streams really hit the heap.
+ */
+struct Wide
+{
+  int val;
+};
+
+std::ostream&
+operator<<(std::ostream& os, const Wide& w)
+{
+  return os << std::setw(40) << w.val;
+}
+
+std::istream&
+operator>>(std::istream& is, Wide& w)
+{
+  return is >> w.val;
+}
+
+/**
+ * Conversions through streams are attributed to their call sites,
+ * and so are parts queued on would-block sends.
+ */
+void
+test_attribution()
+{
+  zmq::socket_t s(ctx, ZMQ_PUSH);
+
+  ZmqMessage::AllocStats& stats = ZmqMessage::AllocStats::current();
+  stats.reset();
+
+  ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(
+    s,
+    ZmqMessage::OutOptions::EMULATE_BLOCK_SENDS |
+    ZmqMessage::OutOptions::CACHE_ON_BLOCK);
+  Wide w1 = {1234567}, w2 = {89};
+  out << w1 << w2 << ZmqMessage::Flush;
+
+  assert(stats.allocs[ZmqMessage::ALLOC_SITE_INIT_MSG] > 0);
+  assert(stats.allocs[ZmqMessage::ALLOC_SITE_SINK_QUEUE] > 0);
+  assert(stats.allocs[ZmqMessage::ALLOC_SITE_ITERATOR] == 0);
+
+  std::auto_ptr<ZmqMessage::Multipart> queued(out.detach());
+  assert(queued->size() == 2);
+
+  int sum = 0;
+  for (ZmqMessage::Multipart::iterator<Wide> it = queued->begin<Wide>();
+       it != queued->end<Wide>(); ++it)
+  {
+    sum += it->val;
+  }
+  assert(sum == 1234567 + 89);
+  assert(stats.allocs[ZmqMessage::ALLOC_SITE_ITERATOR] > 0);
+
+  std::cout << ">>>>>>>>>>>>>  attribution:" << std::endl;
+  print_stats(stats);
+}
+
+int
+main(int, char**)
+{
+  ZmqMessage::AllocStats stats;
+
+  stats = run_loop<ZmqMessage::StackPartsStorage<ARRAY_LEN(req_parts)> >(
+    "StackPartsStorage");
+  assert(stats.library_allocs() == 0);
+
+  stats = run_loop<ZmqMessage::ExternalPartsStorage>("ExternalPartsStorage");
+  assert(stats.library_allocs() == 0);
+
+  //exactly one parts buffer per incoming message
+  stats = run_loop<ZmqMessage::DynamicPartsStorage<> >("DynamicPartsStorage");
+  assert(stats.allocs[ZmqMessage::ALLOC_SITE_PARTS_STORAGE] == ITERS);
+  assert(stats.library_allocs() == ITERS);
+
+  test_attribution();
+  return 0;
+}
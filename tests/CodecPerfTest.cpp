@@ -0,0 +1,158 @@
+/**
+ * @file CodecPerfTest.cpp
+ * @copyright Copyright (c) 2010-2011 Phorm, Inc.
+ * @copyright GNU LGPL v 3.0, see http://www.gnu.org/licenses/lgpl-3.0-standalone.html
+ * @author Andrey Skryabin <andrew@zmqmessage.org>, et al.
+ *
+ *
+ * \test
+ * \brief
+ * Measuring throughput of sending messages with large textual part
+ * with and without compression (ZmqMessage::LzCodec).
+ *
+ * We push 20000 messages (id and ~8K record) from one thread to another
+ * and print elapsed time, throughput and codec counters.
+ * Endpoint may be given as argument (inproc by default),
+ * compression pays off on real network links, e.g.:
+ * @code
+ * CodecPerfTest tcp://127.0.0.1:5599
+ * @endcode
+ */
+
+#include "pthread.h"
+#include <sys/time.h>
+#include <cstddef>
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#define ZMQMESSAGE_LOG_STREAM if(1); else std::cerr
+
+#include "ZmqMessage.hpp"
+#ifdef HEADERONLY
+# include "ZmqMessageImpl.hpp"
+#endif
+
+const char* part_names[] = {"id", "record"};
+
+const size_t ITERS = 20000;
+
+zmq::context_t ctx(1);
+
+std::string record;
+
+struct Run
+{
+  const char* endpoint;
+  bool compress;
+};
+
+double
+now()
+{
+  timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void
+make_record()
+{
+  char buf[128];
+  for (int i = 0; record.size() < 8000; ++i)
+  {
+    snprintf(buf, sizeof(buf),
+      "{\"id\": %d, \"user\": \"user%d\", \"status\": \"active\", "
+      "\"score\": %d.%d},\n", i, i % 97, i * 7 % 1000, i % 10);
+    record += buf;
+  }
+}
+
+void*
+receiver(void* arg)
+{
+  Run* run = static_cast<Run*>(arg);
+  zmq::socket_t s(ctx, ZMQ_PULL);
+  s.connect(run->endpoint);
+
+  ZmqMessage::LzCodec codec;
+  std::string id;
+  std::string rec;
+  for (size_t i = 0; i < ITERS; ++i)
+  {
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting,
+      ZmqMessage::StackPartsStorage<2> > incoming(s);
+    if (run->compress)
+    {
+      incoming.set_codec(&codec);
+    }
+    incoming.receive(2, part_names, true);
+    incoming >> id >> rec;
+    assert(rec.size() == record.size());
+  }
+
+  if (run->compress)
+  {
+    std::cout << "receiver: decoded " << codec.stats().decoded
+      << " parts in " << codec.stats().decode_usec / 1000 << " ms"
+      << std::endl;
+  }
+  return 0;
+}
+
+void
+run_test(Run& run)
+{
+  zmq::socket_t s(ctx, ZMQ_PUSH);
+  s.bind(run.endpoint);
+
+  pthread_t receiver_tid;
+  pthread_create(&receiver_tid, 0, receiver, &run);
+
+  ZmqMessage::LzCodec codec;
+  const double start = now();
+  for (size_t i = 0; i < ITERS; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> outgoing(s, 0);
+    if (run.compress)
+    {
+      outgoing.set_codec(&codec);
+    }
+    outgoing << i << record << ZmqMessage::Flush;
+  }
+  pthread_join(receiver_tid, 0);
+  const double elapsed = now() - start;
+
+  const double mb = static_cast<double>(ITERS) * record.size() / (1 << 20);
+  std::cout << (run.compress ? "compressed" : "plain") << ": elapsed: "
+    << elapsed << " s, " << ITERS / elapsed << " msg/s, "
+    << mb / elapsed << " MB/s of records" << std::endl;
+  if (run.compress)
+  {
+    const ZmqMessage::PartCodec::Stats& stats = codec.stats();
+    std::cout << "sender: encoded " << stats.encoded << " parts"
+      << ", skipped " << stats.skipped
+      << ", ratio " << stats.ratio()
+      << ", in " << stats.encode_usec / 1000 << " ms" << std::endl;
+  }
+}
+
+int
+main(int argc, char** argv)
+{
+  make_record();
+
+  const std::string endpoint = argc > 1 ? argv[1] : "inproc://codec-perf";
+  const std::string endpoint2 = argc > 2 ? argv[2] :
+    (argc > 1 ? endpoint : endpoint + "-lz");
+
+  std::cout << "Testing plain..." << std::endl;
+  Run plain = {endpoint.c_str(), false};
+  run_test(plain);
+
+  std::cout << "Testing compressed..." << std::endl;
+  Run compressed = {endpoint2.c_str(), true};
+  run_test(compressed);
+  return 0;
+}
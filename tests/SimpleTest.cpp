@@ -20,8 +20,12 @@
 #include <cassert>
 #include <cstring>
 #include <unistd.h>
+#include <sys/epoll.h>
 
+#include <map>
+#include <sstream>
 #include <string>
+#include <vector>
 
 #define ZMQMESSAGE_DYNAMIC_DEFAULT_CAPACITY 2
 
@@ -299,6 +303,2458 @@ test_incoming_detach()
   pthread_detach(thr);
 }
 
+void
+test_buffer_pool()
+{
+  ZmqMessage::BufferPool pool(1024, 2);
+  assert(pool.max_buffer_size() == 1024);
+
+  {
+    zmq::context_t ctx(1);
+    zmq::socket_t s_in(ctx, ZMQ_PULL);
+    s_in.bind("inproc://test_buffer_pool");
+    zmq::socket_t s_out(ctx, ZMQ_PUSH);
+    s_out.connect("inproc://test_buffer_pool");
+
+    const std::string pooled(100, 'p');
+    const std::string large(2000, 'l');
+    {
+      ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(
+        ZmqMessage::OutOptions(s_out, 0, 0, &pool));
+      out << pooled << large << "small" << ZmqMessage::Flush;
+    }
+    assert(pool.stats().hits == 1);
+    assert(pool.stats().misses == 1);
+
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting,
+      ZmqMessage::StackPartsStorage<3> > incoming(s_in);
+    incoming.receive_all();
+    assert(incoming.size() == 3);
+    assert(ZmqMessage::get_string<std::string>(incoming[0]) == pooled);
+    assert(ZmqMessage::get_string<std::string>(incoming[1]) == large);
+    assert(ZmqMessage::get_string<std::string>(incoming[2]) == "small");
+  }
+  assert(pool.in_use() == 0);
+
+  {
+    ZmqMessage::Part p1(200, pool);
+    ZmqMessage::Part p2(256, pool);
+    ZmqMessage::Part p3(129, pool); //size class exhausted
+    assert(pool.in_use() == 2);
+    assert(pool.stats().misses == 2);
+    ::memset(p3.msg().data(), 0, 129);
+  }
+  assert(pool.in_use() == 0);
+  assert(pool.stats().recycled == 3);
+}
+
+void
+test_message_builder()
+{
+  ZmqMessage::MessageBuilder builder(1024);
+
+  zmq::context_t ctx(1);
+  zmq::socket_t s_in(ctx, ZMQ_PULL);
+  s_in.bind("inproc://test_message_builder");
+  zmq::socket_t s_out(ctx, ZMQ_PUSH);
+  s_out.connect("inproc://test_message_builder");
+
+  const std::string part1(100, '1');
+  const std::string part2(300, '2');
+  const std::string huge(5000, 'h');
+
+  for (int i = 0; i < 3; ++i)
+  {
+    {
+      ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(
+        ZmqMessage::OutOptions(s_out, 0, 0, &builder));
+      out << part1 << part2 << NUM_TEXT_PART << ZmqMessage::Flush;
+    }
+
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting,
+      ZmqMessage::StackPartsStorage<3> > incoming(s_in);
+    incoming.receive_all();
+    assert(incoming.size() == 3);
+    assert(ZmqMessage::get_string<std::string>(incoming[0]) == part1);
+    assert(ZmqMessage::get_string<std::string>(incoming[1]) == part2);
+    assert(ZmqMessage::get<int>(incoming[2]) == NUM_TEXT_PART);
+    //2 parts sharing one arena
+    assert(static_cast<char*>(incoming[1].msg().data()) ==
+      static_cast<char*>(incoming[0].msg().data()) + 104);
+  }
+  //previous message is consumed when next is built: arena is reused
+  assert(builder.arenas_allocated() == 1);
+
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(
+      ZmqMessage::OutOptions(s_out, 0, 0, &builder));
+    out << huge << part1 << ZmqMessage::Flush;
+  }
+  assert(builder.arenas_allocated() == 3);
+
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting,
+    ZmqMessage::StackPartsStorage<2> > incoming(s_in);
+  incoming.receive_all();
+  builder.reset();
+  assert(ZmqMessage::get_string<std::string>(incoming[0]) == huge);
+  assert(ZmqMessage::get_string<std::string>(incoming[1]) == part1);
+}
+
+void
+test_packed()
+{
+  typedef ZmqMessage::Incoming<ZmqMessage::XRouting,
+    ZmqMessage::DynamicPartsStorage<> > XIncoming;
+
+  zmq::context_t ctx(1);
+  zmq::socket_t s_server(ctx, ZMQ_XREP);
+  s_server.bind("inproc://test_packed");
+  zmq::socket_t s_client(ctx, ZMQ_XREQ);
+  s_client.connect("inproc://test_packed");
+
+  const std::string big(100, 'b');
+  {
+    ZmqMessage::Outgoing<ZmqMessage::XRouting> out(
+      s_client, ZmqMessage::OutOptions::PACKED);
+    out << "id" << big << NUM_TEXT_PART << ZmqMessage::NullMessage
+      << ZmqMessage::Flush;
+  }
+
+  XIncoming request(s_server);
+  request.set_packed(true);
+  request.receive(4, req_parts, true);
+  assert(request.is_terminal());
+
+  std::string id;
+  std::string payload;
+  int num = 0;
+  request >> id >> payload >> num;
+  assert(id == "id");
+  assert(payload == big);
+  assert(num == NUM_TEXT_PART);
+  assert(request[3].msg().size() == 0);
+
+  {
+    //reply with routing of request, body is not packed
+    ZmqMessage::Outgoing<ZmqMessage::XRouting> out(s_server, request, 0);
+    out << "plain" << big << ZmqMessage::Flush;
+  }
+
+  XIncoming response(s_client);
+  response.set_packed(true);
+  response.receive_all();
+  assert(response.size() == 2);
+  assert(ZmqMessage::get_string<std::string>(response[1]) == big);
+
+  {
+    ZmqMessage::Outgoing<ZmqMessage::XRouting> out(
+      s_client, ZmqMessage::OutOptions::PACKED);
+    out << "a" << "b" << ZmqMessage::Flush;
+  }
+  //receiver not in packed mode gets packed frame as is
+  XIncoming raw(s_server);
+  raw.receive_all();
+  assert(raw.size() == 1);
+}
+
+void
+test_codec()
+{
+  std::string json;
+  for (int i = 0; json.size() < 4000; ++i)
+  {
+    json += "{\"id\": 1234, \"name\": \"item\", \"tags\": [\"a\", \"b\"]},";
+    json += static_cast<char>('0' + i % 10);
+  }
+  std::string noise(3000, ' ');
+  unsigned seed = 1;
+  for (size_t i = 0; i < noise.size(); ++i)
+  {
+    seed = seed * 1103515245 + 12345;
+    noise[i] = static_cast<char>(seed >> 16);
+  }
+  //looks like encoded part, must be escaped
+  const std::string marker = std::string("\xf5ZMC", 4) + std::string(20, 'm');
+
+  {
+    //round trip, including overlapping matches and long literal runs
+    ZmqMessage::LzCodec codec(16);
+    const std::string inputs[] = {
+      std::string(5000, 'a'), json, noise, noise + json + noise};
+    for (size_t i = 0; i < ARRAY_LEN(inputs); ++i)
+    {
+      ZmqMessage::Part part(inputs[i].size());
+      ::memcpy(part.msg().data(), inputs[i].data(), inputs[i].size());
+      codec.encode(part);
+      part.set_received(true); //as if it's sent and received
+      codec.decode(part);
+      assert(ZmqMessage::get_string<std::string>(part.msg()) == inputs[i]);
+    }
+    assert(codec.stats().encoded == 3); //but noise
+    assert(codec.stats().decoded == 3);
+
+    //malformed part is left as is
+    ZmqMessage::Part part(json.size());
+    ::memcpy(part.msg().data(), json.data(), json.size());
+    codec.encode(part);
+    ZmqMessage::Part truncated(part.msg().size() - 1);
+    ::memcpy(truncated.msg().data(), part.msg().data(), truncated.msg().size());
+    truncated.set_received(true);
+    codec.decode(truncated);
+    assert(codec.stats().errors == 1);
+    assert(truncated.msg().size() == part.msg().size() - 1);
+  }
+
+  typedef ZmqMessage::Incoming<ZmqMessage::XRouting,
+    ZmqMessage::DynamicPartsStorage<> > XIncoming;
+
+  zmq::context_t ctx(1);
+  zmq::socket_t s_server(ctx, ZMQ_XREP);
+  s_server.bind("inproc://test_codec");
+  zmq::socket_t s_client(ctx, ZMQ_XREQ);
+  s_client.connect("inproc://test_codec");
+
+  ZmqMessage::LzCodec out_codec;
+  {
+    ZmqMessage::Outgoing<ZmqMessage::XRouting> out(s_client, 0);
+    out.set_codec(&out_codec);
+    out << "id" << json << noise << marker << ZmqMessage::Flush;
+  }
+  assert(out_codec.stats().encoded == 1);
+  assert(out_codec.stats().ratio() < 0.5);
+
+  ZmqMessage::LzCodec in_codec;
+  XIncoming request(s_server);
+  request.set_codec(&in_codec);
+  request.receive(4, req_parts, true);
+  assert(in_codec.stats().decoded == 0);
+
+  std::string id;
+  std::string s;
+  request >> id >> ZmqMessage::Skip >> s;
+  assert(id == "id");
+  assert(s == noise);
+  assert(in_codec.stats().decoded == 0); //json is not read yet
+  request >> s;
+  assert(s == marker);
+  assert(in_codec.stats().decoded == 1); //escaped marker
+
+  {
+    //forward still encoded json back, client decodes it
+    ZmqMessage::Outgoing<ZmqMessage::XRouting> out(s_server, request, 0);
+    out.set_codec(&out_codec);
+    ZmqMessage::Part encoded = request.release(1);
+    out << request[2] << encoded << ZmqMessage::Flush;
+  }
+  assert(out_codec.stats().encoded == 1);
+
+  XIncoming response(s_client);
+  response.set_codec(&in_codec);
+  response.receive_all();
+  assert(response.size() == 2);
+  assert(ZmqMessage::get_string<std::string>(response[1]) == json);
+  assert(in_codec.stats().decoded == 2);
+
+  {
+    //packed frame is compressed as a whole
+    ZmqMessage::Outgoing<ZmqMessage::XRouting> out(
+      s_client, ZmqMessage::OutOptions::PACKED);
+    out.set_codec(&out_codec);
+    out << json << "tail" << ZmqMessage::Flush;
+  }
+  assert(out_codec.stats().encoded == 2);
+  XIncoming packed(s_server);
+  packed.set_packed(true);
+  packed.set_codec(&in_codec);
+  packed.receive(2, req_parts, true);
+  assert(ZmqMessage::get_string<std::string>(packed[0]) == json);
+  assert(ZmqMessage::get_string<std::string>(packed[1]) == "tail");
+}
+
+void
+test_relay()
+{
+  zmq::context_t ctx(1);
+  zmq::socket_t client(ctx, ZMQ_PAIR);
+  client.bind("inproc://test_relay_front");
+  zmq::socket_t front(ctx, ZMQ_PAIR);
+  front.connect("inproc://test_relay_front");
+  zmq::socket_t back(ctx, ZMQ_PAIR);
+  back.bind("inproc://test_relay_back");
+  zmq::socket_t server(ctx, ZMQ_PAIR);
+  server.connect("inproc://test_relay_back");
+
+  //inproc pipe holds the sum of both sides' HWM: 4 messages
+  uint64_t hwm = 2;
+  back.setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+  server.setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+
+  const size_t budget = 3;
+  ZmqMessage::Relay relay(front, back, ZmqMessage::Relay::BOTH, budget);
+
+  for (int i = 0; i < 6; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(client, 0);
+    out << i << SECOND_PART << ZmqMessage::Flush;
+  }
+
+  //no more than budget per wakeup
+  assert(relay.poll(-1) == budget);
+  assert(!relay.is_stalled(ZmqMessage::Relay::FORWARD));
+  //destination accepts 4 messages only, reading is paused
+  assert(relay.poll(-1) == 1);
+  assert(relay.is_stalled(ZmqMessage::Relay::FORWARD));
+  assert(relay.stats(ZmqMessage::Relay::FORWARD).stalls == 1);
+  assert(relay.poll(0) == 0);
+
+  int num = -1;
+  for (int i = 0; i < 6; ++i)
+  {
+    //destination is writable again when messages are read
+    while (relay.stats(ZmqMessage::Relay::FORWARD).messages <=
+      static_cast<uint64_t>(i))
+    {
+      assert(relay.poll(-1) > 0);
+    }
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(server);
+    in.receive(2, true);
+    in >> num;
+    assert(num == i);
+  }
+
+  assert(!relay.is_stalled(ZmqMessage::Relay::FORWARD));
+
+  for (int i = 0; i < 4; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(server, 0);
+    out << STATUS << ZmqMessage::Flush;
+  }
+  assert(relay.poll(-1) == budget);
+  assert(relay.poll(-1) == 1);
+  for (int i = 0; i < 4; ++i)
+  {
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> reply(client);
+    reply.receive(1, true);
+    assert(ZmqMessage::get_string<std::string>(reply[0]) == STATUS);
+  }
+
+  const ZmqMessage::Relay::Stats& fwd =
+    relay.stats(ZmqMessage::Relay::FORWARD);
+  assert(fwd.messages == 6);
+  assert(fwd.parts == 12);
+  assert(fwd.stalls >= 1);
+  assert(relay.stats(ZmqMessage::Relay::BACKWARD).messages == 4);
+}
+
+void
+test_fan_out()
+{
+  zmq::context_t ctx(1);
+  zmq::socket_t src_out(ctx, ZMQ_PAIR);
+  src_out.bind("inproc://test_fan_out_src");
+  zmq::socket_t src(ctx, ZMQ_PAIR);
+  src.connect("inproc://test_fan_out_src");
+
+  const char* endpoints[] = {
+    "inproc://test_fan_out_0", "inproc://test_fan_out_1",
+    "inproc://test_fan_out_2"};
+  std::auto_ptr<zmq::socket_t> dst[3];
+  std::auto_ptr<zmq::socket_t> peer[3];
+  //inproc pipe holds the sum of both sides' HWM: 2 messages
+  uint64_t hwm = 1;
+  for (size_t i = 0; i < 3; ++i)
+  {
+    dst[i].reset(new zmq::socket_t(ctx, ZMQ_PUSH));
+    peer[i].reset(new zmq::socket_t(ctx, ZMQ_PULL));
+    if (i < 2)
+    {
+      dst[i]->setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+      peer[i]->setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+    }
+    dst[i]->bind(endpoints[i]);
+    peer[i]->connect(endpoints[i]);
+  }
+
+  ZmqMessage::FanOut fan;
+  assert(fan.add(*dst[0]) == 0);
+  fan.add(*dst[1], ZmqMessage::OutOptions::CACHE_ON_BLOCK);
+  fan.add(*dst[2], 0);
+  fan.add_routing(2, "r", 1);
+  fan.add_routing(2, 0, 0);
+  assert(fan.size() == 3);
+
+  const std::string big(100, 'b');
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(src_out, 0);
+    out << "a" << big << ZmqMessage::Flush;
+  }
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> msg(src);
+  msg.receive(2, true);
+
+  assert(fan.send(msg) == 3);
+  assert(fan.send(msg) == 3);
+  //first two destinations are full now
+  assert(fan.send(msg) == 1);
+  assert(fan.send(msg) == 1);
+  assert(ZmqMessage::get_string<std::string>(msg[1]) == big); //intact
+
+  assert(fan.stats(0).sent == 2);
+  assert(fan.stats(0).dropped == 2);
+  assert(fan.stats(1).sent == 2);
+  assert(fan.stats(1).queued == 2);
+  assert(fan.queued(1) == 2);
+  assert(fan.stats(2).sent == 4);
+
+  for (size_t n = 0; n < 4; ++n)
+  {
+    //queued messages are sent when destination has room again
+    while (fan.stats(1).sent <= n)
+    {
+      fan.flush_queued();
+    }
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(*peer[1]);
+    in.receive(2, true);
+    assert(ZmqMessage::get_string<std::string>(in[1]) == big);
+  }
+  assert(fan.stats(1).sent == 4);
+  assert(fan.queued(1) == 0);
+
+  for (size_t n = 0; n < 4; ++n)
+  {
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(*peer[2]);
+    in.receive(4, true);
+    assert(ZmqMessage::get_string<std::string>(in[0]) == "r");
+    assert(in[1].msg().size() == 0);
+    assert(ZmqMessage::get_string<std::string>(in[2]) == "a");
+  }
+
+  //parts encoded by sender are forwarded as received
+  ZmqMessage::LzCodec out_codec(16);
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(src_out, 0);
+    out.set_codec(&out_codec);
+    out << "a" << big << ZmqMessage::Flush;
+  }
+  assert(out_codec.stats().encoded == 1);
+  ZmqMessage::LzCodec in_codec;
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> encoded(src);
+  encoded.set_codec(&in_codec);
+  encoded.receive(2, true);
+  assert(fan.send(encoded) == 2); //first destination is still full
+  assert(in_codec.stats().decoded == 0);
+  {
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(*peer[2]);
+    in.set_codec(&in_codec);
+    in.receive(4, true);
+    //decoded only here
+    assert(ZmqMessage::get_string<std::string>(in[3]) == big);
+    assert(in_codec.stats().decoded == 1);
+  }
+}
+
+struct ModeRouter
+{
+  zmq::socket_t* ints;
+  zmq::socket_t* strings;
+
+  template <class In>
+  zmq::socket_t*
+  operator()(In& in) const
+  {
+    std::string mode;
+    in >> mode;
+    return mode == "int" ? ints : (mode == "str" ? strings : 0);
+  }
+};
+
+void
+test_route()
+{
+  zmq::context_t ctx(1);
+  zmq::socket_t client(ctx, ZMQ_PAIR);
+  client.bind("inproc://test_route");
+  zmq::socket_t src(ctx, ZMQ_PAIR);
+  src.connect("inproc://test_route");
+  zmq::socket_t ints(ctx, ZMQ_PAIR);
+  ints.bind("inproc://test_route_int");
+  zmq::socket_t ints_peer(ctx, ZMQ_PAIR);
+  ints_peer.connect("inproc://test_route_int");
+  zmq::socket_t strings(ctx, ZMQ_PAIR);
+  strings.bind("inproc://test_route_str");
+  zmq::socket_t strings_peer(ctx, ZMQ_PAIR);
+  strings_peer.connect("inproc://test_route_str");
+
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(client, 0);
+    out << "drop" << "x" << "y" << ZmqMessage::Flush;
+  }
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(client, 0);
+    out << "int" << 1 << 2 << 3 << ZmqMessage::Flush;
+  }
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(client, 0);
+    out << "str" << STATUS << ZmqMessage::Flush;
+  }
+
+  ModeRouter router = {&ints, &strings};
+  typedef ZmqMessage::Incoming<ZmqMessage::SimpleRouting,
+    ZmqMessage::StackPartsStorage<1> > Header;
+  for (int n = 0; n < 3; ++n)
+  {
+    //header only is stored
+    Header incoming(src);
+    zmq::socket_t* dst =
+      ZmqMessage::route<ZmqMessage::SimpleRouting>(incoming, 1, router);
+    assert(dst == (n == 0 ? 0 : (n == 1 ? &ints : &strings)));
+    assert(incoming.is_terminal());
+  }
+
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in_ints(ints_peer);
+  in_ints.receive_all();
+  assert(in_ints.size() == 4);
+  std::string mode;
+  int num = 0;
+  in_ints >> mode >> ZmqMessage::Skip >> ZmqMessage::Skip >> num;
+  assert(mode == "int");
+  assert(num == 3);
+
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in_strings(strings_peer);
+  in_strings.receive_all();
+  assert(in_strings.size() == 2);
+  assert(ZmqMessage::get_string<std::string>(in_strings[1]) == STATUS);
+}
+
+struct LastByteKey
+{
+  uint64_t
+  operator()(ZmqMessage::Multipart& multipart) const
+  {
+    zmq::message_t& msg = multipart[0].msg();
+    return static_cast<const unsigned char*>(msg.data())[msg.size() - 1];
+  }
+};
+
+void
+test_sharded_sink()
+{
+  //same key - same shard, adding shard moves keys only to it
+  size_t moved = 0;
+  size_t hits[4] = {0, 0, 0, 0};
+  for (uint64_t key = 0; key < 1000; ++key)
+  {
+    const uint64_t h = ZmqMessage::ShardedSink::hash(&key, sizeof(key));
+    const size_t s3 = ZmqMessage::ShardedSink::shard_of(h, 3);
+    const size_t s4 = ZmqMessage::ShardedSink::shard_of(h, 4);
+    assert(s3 < 3);
+    assert(s3 == ZmqMessage::ShardedSink::shard_of(h, 3));
+    assert(s4 == s3 || s4 == 3);
+    moved += (s4 != s3);
+    ++hits[s4];
+  }
+  assert(moved > 150 && moved < 350);
+  for (size_t i = 0; i < 4; ++i)
+  {
+    assert(hits[i] > 150);
+  }
+  assert(ZmqMessage::ShardedSink::shard_of(12345, 1) == 0);
+
+  zmq::context_t ctx(1);
+  {
+    //no shards to send to
+    ZmqMessage::LoopbackTransport loop;
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(loop, 0)
+      << "key" << ZmqMessage::Flush;
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> msg(loop);
+    msg.receive_all();
+    ZmqMessage::ShardedSink empty;
+    bool thrown = false;
+    try
+    {
+      empty.send(msg, 0);
+    }
+    catch (const ZmqMessage::ZmqErrorType&)
+    {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+
+  zmq::socket_t src_out(ctx, ZMQ_PAIR);
+  src_out.bind("inproc://test_sharded_src");
+  zmq::socket_t src(ctx, ZMQ_PAIR);
+  src.connect("inproc://test_sharded_src");
+
+  const char* endpoints[] = {
+    "inproc://test_sharded_0", "inproc://test_sharded_1"};
+  std::auto_ptr<zmq::socket_t> dst[2];
+  std::auto_ptr<zmq::socket_t> peer[2];
+  ZmqMessage::ShardedSink shards(ZmqMessage::OutOptions::CACHE_ON_BLOCK, 1);
+  //inproc pipe holds the sum of both sides' HWM: 2 messages
+  uint64_t hwm = 1;
+  for (size_t i = 0; i < 2; ++i)
+  {
+    dst[i].reset(new zmq::socket_t(ctx, ZMQ_PUSH));
+    dst[i]->setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+    dst[i]->bind(endpoints[i]);
+    peer[i].reset(new zmq::socket_t(ctx, ZMQ_PULL));
+    peer[i]->setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+    peer[i]->connect(endpoints[i]);
+    assert(shards.add(*dst[i]) == i);
+  }
+
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(src_out, 0);
+    out << "user-1" << "payload" << ZmqMessage::Flush;
+  }
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> msg(src);
+  msg.receive(2, true);
+
+  const size_t shard = shards.send(msg, 0);
+  assert(shard < 2);
+  assert(shards.send(msg, 0) == shard);
+  assert(shards.send(msg, 0) == shard); //queued
+  assert(shards.send(msg, 0, 1) == shard); //dropped
+  assert(shards.stats(shard).sent == 2);
+  assert(shards.stats(shard).queued == 1);
+  assert(shards.stats(shard).dropped == 1);
+  assert(shards.stats(1 - shard).sent == 0);
+
+  for (size_t n = 0; n < 3; ++n)
+  {
+    //queued message is sent when destination has room again
+    while (shards.stats(shard).sent <= n)
+    {
+      shards.flush_queued();
+    }
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(*peer[shard]);
+    in.receive(2, true);
+    assert(ZmqMessage::get_string<std::string>(in[0]) == "user-1");
+  }
+  assert(shards.queued(shard) == 0);
+  assert(shards.stats(shard).sent == 3);
+
+  bool thrown = false;
+  try
+  {
+    shards.send_to(2, msg);
+  }
+  catch (const ZmqMessage::ZmqErrorType&)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+
+  //'1' == 49 -> key 49
+  const size_t by = shards.send_by(msg, LastByteKey(), 1);
+  assert(by == ZmqMessage::ShardedSink::shard_of('1', 2));
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(*peer[by]);
+  in.receive(1, true);
+  assert(ZmqMessage::get_string<std::string>(in[0]) == "payload");
+}
+
+struct WheelChecker : public ZmqMessage::TimerHandler
+{
+  ZmqMessage::Private::TimerWheel* wheel;
+  std::map<ZmqMessage::TimerId, uint64_t> expected;
+  size_t fired;
+  ZmqMessage::TimerId periodic;
+  size_t periodic_fired;
+
+  void
+  on_timer(ZmqMessage::TimerId id)
+  {
+    const uint64_t tick = wheel->now() - 1;
+    if (id == periodic)
+    {
+      assert(tick == 100 + 7 * periodic_fired);
+      if (++periodic_fired == 10)
+      {
+        assert(wheel->cancel(id));
+      }
+      return;
+    }
+    assert(expected[id] == tick);
+    expected.erase(id);
+    ++fired;
+  }
+};
+
+void
+test_timer_wheel()
+{
+  ZmqMessage::Private::TimerWheel wheel(5);
+  WheelChecker checker;
+  checker.wheel = &wheel;
+  checker.fired = 0;
+  checker.periodic_fired = 0;
+  checker.periodic = wheel.add(100, 7, checker);
+
+  uint64_t seed = 1;
+  std::vector<ZmqMessage::TimerId> ids;
+  for (size_t i = 0; i < 2000; ++i)
+  {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    const uint64_t expires = 5 + ((seed >> 33) % (1 << (4 + i % 20)));
+    const ZmqMessage::TimerId id = wheel.add(expires, 0, checker);
+    checker.expected[id] = expires;
+    ids.push_back(id);
+  }
+  //far away timer is rescheduled
+  const ZmqMessage::TimerId far = wheel.add(1ULL << 27, 0, checker);
+  checker.expected[far] = 1ULL << 27;
+
+  size_t cancelled = 0;
+  for (size_t i = 0; i < ids.size(); i += 10)
+  {
+    if (checker.expected[ids[i]] > 1000)
+    {
+      assert(wheel.cancel(ids[i]));
+      checker.expected.erase(ids[i]);
+      ++cancelled;
+    }
+  }
+  assert(wheel.size() == 2000 + 2 - cancelled);
+
+  uint64_t tick = 5;
+  while (wheel.size())
+  {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    tick += (seed >> 33) % 5000;
+    wheel.advance(tick);
+    //nothing is late
+    for (std::map<ZmqMessage::TimerId, uint64_t>::iterator it =
+           checker.expected.begin(); it != checker.expected.end(); ++it)
+    {
+      assert(it->second > tick);
+    }
+    assert(wheel.next_expiry() > tick);
+  }
+  assert(checker.fired == 2000 + 1 - cancelled);
+  assert(checker.periodic_fired == 10);
+  assert(!wheel.cancel(far));
+  assert(wheel.next_expiry() == ZmqMessage::Private::TimerWheel::NEVER);
+}
+
+struct NamedHandler : public ZmqMessage::Reactor::IncomingHandler<
+  ZmqMessage::SimpleRouting>
+{
+  std::string name;
+  std::vector<std::string>* log;
+  size_t writables;
+
+  void
+  handle(ZmqMessage::Incoming<ZmqMessage::SimpleRouting>& incoming)
+  {
+    incoming.receive(1, false); //the rest is dropped
+    log->push_back(name + ":" +
+      ZmqMessage::get_string<std::string>(incoming[0]));
+  }
+
+  bool
+  on_writable(zmq::socket_t&)
+  {
+    ++writables;
+    return false;
+  }
+};
+
+struct CountingTimer : public ZmqMessage::TimerHandler
+{
+  ZmqMessage::Reactor* reactor;
+  size_t fired;
+  size_t limit;
+
+  CountingTimer(ZmqMessage::Reactor& r, size_t l) :
+    reactor(&r), fired(0), limit(l)
+  {}
+
+  void
+  on_timer(ZmqMessage::TimerId id)
+  {
+    if (++fired == limit)
+    {
+      reactor->cancel_timer(id);
+    }
+  }
+};
+
+void
+test_reactor()
+{
+  zmq::context_t ctx(1);
+  zmq::socket_t low_out(ctx, ZMQ_PAIR);
+  low_out.bind("inproc://test_reactor_low");
+  zmq::socket_t low(ctx, ZMQ_PAIR);
+  low.connect("inproc://test_reactor_low");
+  zmq::socket_t high_out(ctx, ZMQ_PAIR);
+  high_out.bind("inproc://test_reactor_high");
+  zmq::socket_t high(ctx, ZMQ_PAIR);
+  high.connect("inproc://test_reactor_high");
+
+  for (int i = 0; i < 5; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> lo(low_out, 0);
+    lo << i << "tail" << ZmqMessage::Flush;
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> hi(high_out, 0);
+    hi << i << ZmqMessage::Flush;
+  }
+
+  std::vector<std::string> log;
+  NamedHandler low_handler;
+  low_handler.name = "low";
+  low_handler.log = &log;
+  low_handler.writables = 0;
+  NamedHandler high_handler = low_handler;
+  high_handler.name = "high";
+
+  ZmqMessage::Reactor reactor;
+  reactor.add(low, low_handler, 0, 2);
+  reactor.add(high, high_handler, 1);
+  reactor.watch_writable(low);
+
+  assert(reactor.poll(0) == 5 + 2 + 1);
+  assert(log.size() == 7);
+  assert(log[0] == "high:0");
+  assert(log[4] == "high:4");
+  assert(log[5] == "low:0");
+  assert(log[6] == "low:1");
+  assert(low_handler.writables == 1);
+
+  assert(reactor.poll(0) == 2); //not writable any more
+  assert(log.back() == "low:3");
+  assert(reactor.remove(high));
+  assert(!reactor.remove(high));
+  assert(reactor.poll(0) == 1);
+  assert(log.back() == "low:4");
+
+  CountingTimer timer(reactor, 3);
+  CountingTimer once(reactor, 0);
+  reactor.add_timer(2000, timer, 1000);
+  const ZmqMessage::TimerId id = reactor.add_timer(1000, once);
+  assert(reactor.timers() == 2);
+  while (reactor.timers())
+  {
+    reactor.poll(-1); //woken up by timers
+  }
+  assert(timer.fired == 3);
+  assert(once.fired == 1);
+  assert(!reactor.cancel_timer(id));
+
+  const ZmqMessage::Reactor::Stats& stats = reactor.stats();
+  assert(stats.messages == 10);
+  assert(stats.writables == 1);
+  assert(stats.timers == 4);
+  uint64_t iterations = 0;
+  for (size_t i = 0; i < ZmqMessage::Reactor::Stats::HISTOGRAM_SIZE; ++i)
+  {
+    iterations += stats.histogram[i];
+  }
+  assert(iterations == stats.iterations);
+  assert(stats.max_busy_usec <= stats.busy_usec);
+}
+
+void* test_spin_wait_sender(void* arg)
+{
+  zmq::context_t& ctx = *static_cast<zmq::context_t*>(arg);
+  zmq::socket_t s(ctx, ZMQ_PUSH);
+  s.connect("inproc://test_spin_wait");
+  ::usleep(20000); //longer than spinning
+  ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(s, 0);
+  out << "late" << 2 << ZmqMessage::Flush;
+  return 0;
+}
+
+void
+test_spin_wait()
+{
+  zmq::context_t ctx(1);
+  zmq::socket_t s_in(ctx, ZMQ_PULL);
+  s_in.bind("inproc://test_spin_wait");
+  zmq::socket_t s_out(ctx, ZMQ_PUSH);
+  s_out.connect("inproc://test_spin_wait");
+
+  ZmqMessage::SpinWait spin(10);
+  for (int i = 0; i < 3; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(s_out, 0);
+    out << "early" << i << ZmqMessage::Flush;
+  }
+  for (int i = 0; i < 3; ++i)
+  {
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> incoming(s_in);
+    incoming.set_spin_wait(&spin);
+    assert(incoming.spin_wait() == &spin);
+    incoming.receive(2, true);
+    int num = -1;
+    incoming >> ZmqMessage::Skip >> num;
+    assert(num == i);
+  }
+  //only first part of message is counted
+  assert(spin.stats().immediate == 3);
+  assert(spin.stats().spin_nsec == 0);
+
+  pthread_t thr;
+  pthread_create(&thr, NULL, &test_spin_wait_sender, &ctx);
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> incoming(s_in);
+  incoming.set_spin_wait(&spin);
+  incoming.receive(2, true);
+  assert(ZmqMessage::get_string<std::string>(incoming[0]) == "late");
+  pthread_join(thr, NULL);
+
+  const ZmqMessage::SpinWait::Stats& stats = spin.stats();
+  assert(stats.immediate + stats.spin_hits + stats.blocks == 4);
+  assert(stats.blocks == 1);
+  assert(stats.spin_nsec > 0);
+  assert(spin.average_gap() > 0);
+}
+
+void
+test_try_receive()
+{
+  typedef ZmqMessage::Incoming<ZmqMessage::SimpleRouting> Incoming;
+
+  zmq::context_t ctx(1);
+  zmq::socket_t s_in(ctx, ZMQ_PULL);
+  s_in.bind("inproc://test_try_receive");
+  zmq::socket_t s_out(ctx, ZMQ_PUSH);
+  s_out.connect("inproc://test_try_receive");
+
+  {
+    ZmqMessage::Deadline deadline(5000);
+    Incoming incoming(s_in);
+    assert(!incoming.try_receive_all(deadline.remaining()));
+    assert(deadline.expired());
+    assert(incoming.size() == 0);
+    assert(ZmqMessage::Deadline(-1).remaining() == -1);
+  }
+
+  for (int i = 0; i < 3; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(s_out, 0);
+    out << "a" << "b" << "c" << ZmqMessage::Flush;
+  }
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(s_out, 0);
+    out << "last" << ZmqMessage::Flush;
+  }
+
+  //too many parts: the rest is dropped
+  bool thrown = false;
+  try
+  {
+    Incoming incoming(s_in);
+    incoming.try_receive(0, 2, true);
+  }
+  catch (const ZmqMessage::MessageFormatError&)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+
+  //too few parts
+  thrown = false;
+  try
+  {
+    Incoming incoming(s_in);
+    incoming.try_receive(-1, 4, false);
+  }
+  catch (const ZmqMessage::MessageFormatError&)
+  {
+    thrown = true;
+  }
+  assert(thrown);
+
+  {
+    const char* names[] = {"first"};
+    Incoming incoming(s_in);
+    assert(incoming.try_receive_up_to(0, 1, names, 2));
+    assert(incoming.size() == 2);
+    assert(!incoming.is_terminal());
+    incoming.drop_tail();
+  }
+
+  Incoming incoming(s_in);
+  assert(incoming.try_receive_all(1000, 1));
+  assert(incoming.size() == 1);
+  assert(ZmqMessage::get_string<std::string>(incoming[0]) == "last");
+
+  Incoming empty(s_in);
+  assert(!empty.try_receive(0, 1, true));
+}
+
+struct FlushCounter : public ZmqMessage::AsyncLoop::FlushHandler
+{
+  size_t flushed;
+
+  void
+  on_flushed(zmq::socket_t&)
+  {
+    ++flushed;
+  }
+};
+
+struct FeedingHandler : public NamedHandler
+{
+  zmq::socket_t* feed;
+  zmq::socket_t* fed; //watched socket connected to feed
+
+  void
+  handle(ZmqMessage::Incoming<ZmqMessage::SimpleRouting>& incoming)
+  {
+    NamedHandler::handle(incoming);
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(*feed, 0)
+      << "fed" << ZmqMessage::Flush;
+    //consumes edge of fed socket
+    uint32_t events = 0;
+    size_t sz = sizeof(events);
+    fed->getsockopt(ZMQ_EVENTS, &events, &sz);
+  }
+};
+
+void
+test_async_loop()
+{
+  zmq::context_t ctx(1);
+  //inproc pipe holds the sum of both sides' HWM: 2 messages
+  uint64_t hwm = 1;
+  zmq::socket_t pull(ctx, ZMQ_PULL);
+  pull.setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+  pull.bind("inproc://test_async_loop");
+  zmq::socket_t push(ctx, ZMQ_PUSH);
+  push.setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+  push.connect("inproc://test_async_loop");
+
+  std::vector<std::string> log;
+  NamedHandler first;
+  first.name = "first";
+  first.log = &log;
+  first.writables = 0;
+  NamedHandler second = first;
+  second.name = "second";
+  NamedHandler third = first;
+  third.name = "third";
+
+  ZmqMessage::AsyncLoop loop;
+  loop.async_receive(pull, first);
+  loop.async_receive(pull, second);
+  loop.async_receive(pull, third);
+  assert(loop.pending() == 3);
+  assert(loop.poll(0) == 0);
+
+  const unsigned options = ZmqMessage::OutOptions::NONBLOCK |
+    ZmqMessage::OutOptions::CACHE_ON_BLOCK;
+  ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> sent(push, options);
+  sent << "0" << "x" << ZmqMessage::Flush;
+  assert(!sent.is_queued());
+  assert(!loop.async_flush(sent)); //nothing to wait for
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> filler(push, options);
+    filler << "1" << ZmqMessage::Flush;
+    assert(!filler.is_queued());
+  }
+
+  ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> queued(push, options);
+  queued << "2" << ZmqMessage::Flush;
+  assert(queued.is_queued());
+  FlushCounter counter;
+  counter.flushed = 0;
+  assert(loop.async_flush(queued, &counter));
+  assert(!queued.is_queued());
+  assert(loop.pending() == 4);
+
+  //messages sent are received, then queued one is sent and received
+  while (loop.pending())
+  {
+    loop.poll(100000);
+  }
+  assert(counter.flushed == 1);
+  assert(log.size() == 3);
+  assert(log[0] == "first:0");
+  assert(log[1] == "second:1");
+  assert(log[2] == "third:2");
+
+  //handler feeding socket checked earlier in the same poll
+  zmq::socket_t pull_a(ctx, ZMQ_PULL);
+  pull_a.bind("inproc://test_async_loop_a");
+  zmq::socket_t pull_b(ctx, ZMQ_PULL);
+  pull_b.bind("inproc://test_async_loop_b");
+  zmq::socket_t& early = &pull_a < &pull_b ? pull_a : pull_b;
+  zmq::socket_t& late = &pull_a < &pull_b ? pull_b : pull_a;
+  zmq::socket_t push_a(ctx, ZMQ_PUSH);
+  push_a.connect("inproc://test_async_loop_a");
+  zmq::socket_t push_b(ctx, ZMQ_PUSH);
+  push_b.connect("inproc://test_async_loop_b");
+  FeedingHandler feeding;
+  feeding.name = "feeding";
+  feeding.log = &log;
+  feeding.feed = &early == &pull_a ? &push_a : &push_b;
+  feeding.fed = &early;
+  ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(
+    &late == &pull_a ? push_a : push_b, 0) << "go" << ZmqMessage::Flush;
+  loop.async_receive(early, first);
+  loop.async_receive(late, feeding);
+  assert(loop.poll(0) == 2);
+  assert(loop.pending() == 0);
+  assert(log[3] == "feeding:go");
+  assert(log[4] == "first:fed");
+}
+
+void
+test_socket_watcher()
+{
+  zmq::context_t ctx(1);
+  //inproc pipe holds the sum of both sides' HWM: 2 messages
+  uint64_t hwm = 1;
+  zmq::socket_t pull(ctx, ZMQ_PULL);
+  pull.setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+  pull.bind("inproc://test_socket_watcher");
+  zmq::socket_t push(ctx, ZMQ_PUSH);
+  push.setsockopt(ZMQ_HWM, &hwm, sizeof(hwm));
+  push.connect("inproc://test_socket_watcher");
+
+  std::vector<std::string> log;
+  NamedHandler receiver;
+  receiver.name = "in";
+  receiver.log = &log;
+  receiver.writables = 0;
+  NamedHandler idle = receiver;
+  idle.name = "idle";
+
+  ZmqMessage::SocketWatcher in(pull, receiver, 2);
+  ZmqMessage::SocketWatcher out(push, idle);
+  assert(in.fd() >= 0);
+
+  int epoll_fd = ::epoll_create(1);
+  epoll_event ev;
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.ptr = &in;
+  ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, in.fd(), &ev);
+  assert(!in.on_ready());
+
+  const unsigned options = ZmqMessage::OutOptions::NONBLOCK |
+    ZmqMessage::OutOptions::CACHE_ON_BLOCK;
+  for (int i = 0; i < 4; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> sink(push, options);
+    sink << std::string(1, '0' + i) << ZmqMessage::Flush;
+    assert(sink.is_queued() == (i > 1));
+    assert(out.queue(sink) == (i > 1));
+  }
+  assert(out.queued() == 2);
+  assert(!out.on_ready());
+  assert(out.queued() == 2);
+  {
+    ZmqMessage::LoopbackTransport loopback;
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> sink(loopback, 0);
+    bool thrown = false;
+    try
+    {
+      out.queue(sink);
+    }
+    catch (const ZmqMessage::ZmqErrorType&)
+    {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+
+  //messages are received as the queue is drained
+  while (log.size() < 4)
+  {
+    epoll_event events[1];
+    if (::epoll_wait(epoll_fd, events, 1, 0) > 0)
+    {
+      assert(events[0].data.ptr == &in);
+    }
+    in.on_ready();
+    out.on_ready();
+  }
+  ::close(epoll_fd);
+  assert(out.queued() == 0);
+  assert(out.out_stats().sent == 2);
+  assert(log[0] == "in:0");
+  assert(log[3] == "in:3");
+  assert(in.stats().messages == 4);
+
+  //budget limits messages per wakeup
+  zmq::socket_t many(ctx, ZMQ_PUSH);
+  many.connect("inproc://test_socket_watcher");
+  for (int i = 0; i < 3; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> sink(many, 0);
+    sink << "m" << ZmqMessage::Flush;
+  }
+  assert(in.on_ready());
+  assert(log.size() == 6);
+  assert(!in.on_ready());
+  assert(log.size() == 7);
+}
+
+struct ReplyLog : public ZmqMessage::RpcClient::ResponseHandler
+{
+  std::vector<std::string>* log;
+
+  void
+  on_response(ZmqMessage::RpcClient::RequestId,
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting>& reply)
+  {
+    std::string body;
+    reply >> body;
+    log->push_back(body);
+  }
+
+  void
+  on_timeout(ZmqMessage::RpcClient::RequestId)
+  {
+    log->push_back("timeout");
+  }
+};
+
+void
+test_rpc_client()
+{
+  typedef ZmqMessage::Incoming<ZmqMessage::XRouting> Request;
+  typedef ZmqMessage::Outgoing<ZmqMessage::XRouting> Reply;
+
+  zmq::context_t ctx(1);
+  zmq::socket_t server(ctx, ZMQ_XREP);
+  server.bind("inproc://test_rpc_client");
+  zmq::socket_t sock(ctx, ZMQ_XREQ);
+  sock.connect("inproc://test_rpc_client");
+
+  zmq::socket_t src_out(ctx, ZMQ_PAIR);
+  src_out.bind("inproc://test_rpc_client_src");
+  zmq::socket_t src(ctx, ZMQ_PAIR);
+  src.connect("inproc://test_rpc_client_src");
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(src_out, 0);
+    out << "a" << "b" << "c" << ZmqMessage::Flush;
+  }
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> bodies(src);
+  bodies.receive(3, true);
+
+  std::vector<std::string> log;
+  ReplyLog handler;
+  handler.log = &log;
+
+  ZmqMessage::RpcClient client(sock, 2);
+  assert(client.call(bodies, handler, -1, 0, 1));
+  assert(client.call(bodies, handler, -1, 1, 2));
+  assert(!client.call(bodies, handler, -1, 2, 3));
+  assert(client.in_flight() == 2);
+  assert(client.stats().rejected == 1);
+
+  //replies come in other order
+  {
+    Request first(server);
+    first.receive_all();
+    Request second(server);
+    second.receive_all();
+    assert(second.size() == 1);
+    Reply(server, second, 0) << "re:" + ZmqMessage::get_string<std::string>(
+      second[0]) << ZmqMessage::Flush;
+    Reply(server, first, 0) << "re:" + ZmqMessage::get_string<std::string>(
+      first[0]) << ZmqMessage::Flush;
+  }
+  assert(client.poll(100000) == 2);
+  assert(log.size() == 2);
+  assert(log[0] == "re:b");
+  assert(log[1] == "re:a");
+  assert(client.in_flight() == 0);
+
+  //ids wrap around hash table
+  for (int round = 0; round < 20; ++round)
+  {
+    client.call(bodies, handler, -1, 0, 1);
+    client.call(bodies, handler, -1, 2, 3);
+    Request first(server);
+    first.receive_all();
+    Request second(server);
+    second.receive_all();
+    Reply(server, second, 0) << "2" << ZmqMessage::Flush;
+    Reply(server, first, 0) << "1" << ZmqMessage::Flush;
+    while (client.in_flight())
+    {
+      client.poll(100000);
+    }
+  }
+  assert(log.size() == 42);
+  assert(log[40] == "2");
+  assert(log[41] == "1");
+
+  //late response is dropped
+  assert(client.call(bodies, handler, 10000, 2, 3));
+  assert(client.poll(-1) == 1);
+  assert(log.back() == "timeout");
+  {
+    Request late(server);
+    late.receive_all();
+    Reply(server, late, 0) << "late" << ZmqMessage::Flush;
+  }
+  assert(client.poll(100000) == 0);
+  assert(client.stats().unmatched == 1);
+  assert(client.stats().timeouts == 1);
+
+  const ZmqMessage::RpcClient::RequestId cancelled =
+    client.call(bodies, handler, -1, 0, 1);
+  assert(client.cancel(cancelled));
+  assert(!client.cancel(cancelled));
+  assert(client.in_flight() == 0);
+  {
+    Request ignored(server);
+    ignored.receive_all();
+  }
+
+  ZmqMessage::RpcClient::Future future;
+  client.call(bodies, future, 1000000, 0, 2);
+  assert(!client.wait(future, 0));
+  {
+    Request req(server);
+    req.receive_all();
+    assert(req.size() == 2);
+    Reply(server, req, 0) << "x" << "y" << ZmqMessage::Flush;
+  }
+  assert(client.wait(future, -1));
+  assert(!future.timed_out());
+  assert(future.parts().size() == 2);
+  assert(ZmqMessage::get_string<std::string>(future.parts()[1]) == "y");
+  assert(client.stats().responses == 43);
+  assert(client.stats().requests == 45);
+}
+
+void
+test_route_handle()
+{
+  zmq::context_t ctx(1);
+  zmq::socket_t server(ctx, ZMQ_XREP);
+  server.bind("inproc://test_route_handle");
+  zmq::socket_t client1(ctx, ZMQ_XREQ);
+  client1.connect("inproc://test_route_handle");
+  zmq::socket_t client2(ctx, ZMQ_XREQ);
+  client2.connect("inproc://test_route_handle");
+
+  ZmqMessage::Outgoing<ZmqMessage::XRouting>(client1, 0)
+    << "one" << ZmqMessage::Flush;
+  ZmqMessage::Outgoing<ZmqMessage::XRouting>(client2, 0)
+    << "two" << ZmqMessage::Flush;
+  ZmqMessage::Outgoing<ZmqMessage::XRouting>(client1, 0)
+    << "three" << ZmqMessage::Flush;
+
+  ZmqMessage::ReplyTable pending;
+  std::vector<ZmqMessage::ReplyTable::Ticket> tickets;
+  std::vector<std::string> bodies;
+  for (int i = 0; i < 3; ++i)
+  {
+    ZmqMessage::Incoming<ZmqMessage::XRouting> req(server);
+    req.receive_all();
+    ZmqMessage::RouteHandle route(req);
+    assert(route.size() == 2); //identity and delimiter
+    tickets.push_back(pending.add(route));
+    bodies.push_back(ZmqMessage::get_string<std::string>(req[0]));
+  }
+  assert(pending.size() == 3);
+  assert(bodies[0] == "one" && bodies[2] == "three");
+
+  const ZmqMessage::RouteHandle r1 = *pending.find(tickets[0]);
+  const ZmqMessage::RouteHandle r2 = *pending.find(tickets[1]);
+  const ZmqMessage::RouteHandle r3 = *pending.find(tickets[2]);
+  assert(r1 == r3 && r1.hash() == r3.hash());
+  assert(r1 != r2);
+  assert((r1 < r2) != (r2 < r1));
+  assert(!(r1 < r3) && !(r3 < r1));
+  assert(ZmqMessage::RouteHandle::Hash()(r1) == ZmqMessage::RouteHandle::Hash()(r3));
+  assert(ZmqMessage::RouteHandle() < r1);
+  assert(ZmqMessage::RouteHandle() == ZmqMessage::RouteHandle());
+
+  std::map<ZmqMessage::RouteHandle, int> per_client;
+  per_client[r1] += 1;
+  per_client[r2] += 1;
+  per_client[r3] += 1;
+  assert(per_client.size() == 2);
+  assert(per_client[r1] == 2);
+
+  //reply out of order, after requests are gone
+  for (int i = 2; i >= 0; --i)
+  {
+    ZmqMessage::RouteHandle route;
+    assert(pending.take(tickets[i], route));
+    assert(!pending.take(tickets[i], route));
+    ZmqMessage::Outgoing<ZmqMessage::XRouting>(server, route, 0)
+      << "re:" + bodies[i] << ZmqMessage::Flush;
+  }
+  assert(pending.size() == 0);
+
+  const char* expected1[] = {"re:three", "re:one"};
+  for (int i = 0; i < 2; ++i)
+  {
+    ZmqMessage::Incoming<ZmqMessage::XRouting> rep(client1);
+    rep.receive(1, true);
+    assert(ZmqMessage::get_string<std::string>(rep[0]) == expected1[i]);
+  }
+  ZmqMessage::Incoming<ZmqMessage::XRouting> rep(client2);
+  rep.receive(1, true);
+  assert(ZmqMessage::get_string<std::string>(rep[0]) == "re:two");
+
+  pending.add(r1);
+  pending.add(r2);
+  pending.add(r3);
+  assert(pending.erase(r1) == 2);
+  assert(pending.size() == 1);
+}
+
+void
+test_broker_serve(zmq::socket_t& worker)
+{
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> req(worker);
+  req.receive(3, true);
+  ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> rep(worker, req, 0);
+  rep << req[0] << req[1] <<
+    "re:" + ZmqMessage::get_string<std::string>(req[2]) << ZmqMessage::Flush;
+}
+
+void
+test_broker()
+{
+  zmq::context_t ctx(1);
+  zmq::socket_t front(ctx, ZMQ_XREP);
+  front.bind("inproc://test_broker_front");
+  zmq::socket_t back(ctx, ZMQ_XREP);
+  back.bind("inproc://test_broker_back");
+
+  std::auto_ptr<zmq::socket_t> clients[3];
+  for (int i = 0; i < 3; ++i)
+  {
+    clients[i].reset(new zmq::socket_t(ctx, ZMQ_REQ));
+    clients[i]->connect("inproc://test_broker_front");
+  }
+  zmq::socket_t w1(ctx, ZMQ_REQ);
+  w1.connect("inproc://test_broker_back");
+  zmq::socket_t w2(ctx, ZMQ_REQ);
+  w2.connect("inproc://test_broker_back");
+
+  ZmqMessage::Broker broker(front, back, 2);
+  for (int i = 0; i < 3; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(*clients[i], 0);
+    out << "r" + std::string(1, '0' + i) << ZmqMessage::Flush;
+  }
+  //backlog is full: third request is left in socket
+  while (broker.backlog() < 2)
+  {
+    broker.poll(100000);
+  }
+  assert(broker.poll(0) == 0);
+  assert(broker.stats().requests == 2);
+
+  ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(w1, 0)
+    << ZmqMessage::Broker::READY << ZmqMessage::Flush;
+  while (broker.busy_workers() < 1 || broker.backlog() < 2)
+  {
+    broker.poll(100000);
+  }
+  assert(broker.idle_workers() == 0);
+
+  ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(w2, 0)
+    << ZmqMessage::Broker::READY << ZmqMessage::Flush;
+  while (broker.busy_workers() < 2)
+  {
+    broker.poll(100000);
+  }
+  assert(broker.backlog() == 1);
+
+  //oldest requests went to workers in order they became ready
+  test_broker_serve(w1);
+  test_broker_serve(w2);
+  while (broker.stats().replies < 2 || broker.backlog())
+  {
+    broker.poll(100000);
+  }
+  test_broker_serve(w1); //least recently used
+  while (broker.stats().replies < 3)
+  {
+    broker.poll(100000);
+  }
+  assert(broker.idle_workers() == 2);
+  assert(broker.busy_workers() == 0);
+
+  for (int i = 0; i < 3; ++i)
+  {
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> rep(*clients[i]);
+    rep.receive(1, true);
+    assert(ZmqMessage::get_string<std::string>(rep[0]) ==
+      "re:r" + std::string(1, '0' + i));
+  }
+
+  const ZmqMessage::Broker::Stats& stats = broker.stats();
+  assert(stats.requests == 3);
+  assert(stats.malformed == 0);
+  assert(stats.max_wait_usec > 0);
+  assert(stats.wait_usec >= stats.max_wait_usec);
+  assert(broker.utilization() > 0 && broker.utilization() < 1);
+}
+
+struct GatherLog : public ZmqMessage::ScatterGather::Handler
+{
+  std::vector<std::string> replies;
+  std::vector<size_t> backends;
+  size_t done;
+  size_t last_replies;
+
+  GatherLog() : done(0), last_replies(0)
+  {}
+
+  void
+  on_reply(ZmqMessage::ScatterGather::RequestId, size_t backend,
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting>& reply)
+  {
+    std::string body;
+    reply >> body;
+    replies.push_back(body);
+    backends.push_back(backend);
+  }
+
+  void
+  on_done(ZmqMessage::ScatterGather::RequestId, size_t replies)
+  {
+    ++done;
+    last_replies = replies;
+  }
+};
+
+bool
+test_gather_serve(zmq::socket_t& server, const std::string& body)
+{
+  if (!ZmqMessage::wait_readable(server, 0))
+  {
+    return false;
+  }
+  ZmqMessage::Incoming<ZmqMessage::XRouting> req(server);
+  req.receive_all();
+  if (!body.empty())
+  {
+    ZmqMessage::Outgoing<ZmqMessage::XRouting>(server, req, 0)
+      << body << ZmqMessage::Flush;
+  }
+  return true;
+}
+
+void
+test_scatter_gather()
+{
+  zmq::context_t ctx(1);
+  const char* endpoints[] = {
+    "inproc://test_sg_0", "inproc://test_sg_1", "inproc://test_sg_2"};
+  std::auto_ptr<zmq::socket_t> servers[3];
+  std::auto_ptr<zmq::socket_t> backends[3];
+  ZmqMessage::ScatterGather sg;
+  for (size_t i = 0; i < 3; ++i)
+  {
+    servers[i].reset(new zmq::socket_t(ctx, ZMQ_XREP));
+    servers[i]->bind(endpoints[i]);
+    backends[i].reset(new zmq::socket_t(ctx, ZMQ_XREQ));
+    backends[i]->connect(endpoints[i]);
+    assert(sg.add(*backends[i]) == i);
+  }
+
+  zmq::socket_t src_out(ctx, ZMQ_PAIR);
+  src_out.bind("inproc://test_sg_src");
+  zmq::socket_t src(ctx, ZMQ_PAIR);
+  src.connect("inproc://test_sg_src");
+  ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(src_out, 0)
+    << "req" << ZmqMessage::Flush;
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> request(src);
+  request.receive(1, true);
+
+  //first of three replies
+  GatherLog log;
+  assert(sg.send(request, log, 3, 1));
+  assert(test_gather_serve(*servers[1], "fast"));
+  while (!log.done)
+  {
+    sg.poll(100000);
+  }
+  assert(log.replies.size() == 1 && log.replies[0] == "fast");
+  assert(log.backends[0] == 1);
+  assert(sg.pending() == 0);
+  //late replies are dropped
+  assert(test_gather_serve(*servers[0], "slow"));
+  assert(test_gather_serve(*servers[2], "slow"));
+  sg.poll(10000);
+  assert(log.replies.size() == 1 && log.done == 1);
+
+  //quorum of two
+  assert(sg.send(request, log, 3, 2));
+  for (size_t i = 0; i < 3; ++i)
+  {
+    assert(test_gather_serve(*servers[i], "q"));
+  }
+  while (log.done < 2)
+  {
+    sg.poll(100000);
+  }
+  assert(log.last_replies == 2);
+  assert(log.replies.size() == 3);
+
+  //timeout
+  assert(sg.send(request, log, 1, 1, 5000));
+  while (log.done < 3)
+  {
+    sg.poll(-1);
+  }
+  assert(log.last_replies == 0);
+  assert(sg.stats().timeouts == 1);
+  for (size_t i = 0; i < 3; ++i)
+  {
+    test_gather_serve(*servers[i], "");
+  }
+
+  //more replies needed than copies sent: completed by the only one
+  assert(sg.send(request, log, 1, 2));
+  for (size_t i = 0; i < 3; ++i)
+  {
+    test_gather_serve(*servers[i], "single");
+  }
+  while (log.done < 4)
+  {
+    sg.poll(100000);
+  }
+  assert(log.last_replies == 1);
+  assert(log.replies.back() == "single");
+
+  //hedge: first backend does not reply, duplicate goes to the next one
+  assert(sg.hedge_delay() == -1);
+  sg.set_hedging(90, 5000);
+  assert(sg.hedge_delay() == 5000);
+  assert(sg.send(request, log, 1, 1, 1000000));
+  size_t silent = 3;
+  for (size_t i = 0; i < 3; ++i)
+  {
+    if (test_gather_serve(*servers[i], ""))
+    {
+      silent = i;
+    }
+  }
+  assert(silent < 3);
+  sg.poll(1000000); //hedge is sent after delay
+  assert(sg.stats().hedges == 1);
+  assert(test_gather_serve(*servers[(silent + 1) % 3], "hedged"));
+  while (log.done < 5)
+  {
+    sg.poll(100000);
+  }
+  assert(log.replies.back() == "hedged");
+  assert(sg.stats().hedge_wins == 1);
+  assert(sg.stats().completed == 4);
+  assert(sg.stats().requests == 5);
+}
+
+struct TopicLog : public ZmqMessage::TopicDispatcher::Handler
+{
+  std::string name;
+  std::vector<std::string>* log;
+
+  void
+  handle(ZmqMessage::Incoming<ZmqMessage::SimpleRouting>& incoming)
+  {
+    incoming.receive_all();
+    log->push_back(name + ":" +
+      ZmqMessage::get_string<std::string>(incoming[incoming.size() - 1]));
+  }
+};
+
+void
+test_topic_dispatcher()
+{
+  zmq::context_t ctx(1);
+  zmq::socket_t pub(ctx, ZMQ_PUB);
+  pub.bind("inproc://test_topic_dispatcher");
+  zmq::socket_t sub(ctx, ZMQ_SUB);
+  sub.connect("inproc://test_topic_dispatcher");
+
+  std::vector<std::string> log;
+  TopicLog all, a, ab, b;
+  all.name = "all";
+  a.name = "a";
+  ab.name = "ab";
+  b.name = "b";
+  all.log = a.log = ab.log = b.log = &log;
+
+  ZmqMessage::TopicDispatcher topics(sub);
+  assert(!topics.match("a", 1));
+  topics.add("a", a);
+  topics.add("ab", ab);
+  topics.add("b", b);
+  assert(topics.match("abc", 3) == &ab);
+  assert(topics.match("ax", 2) == &a);
+  assert(topics.match("a", 1) == &a);
+  assert(!topics.match("c", 1));
+  topics.add("", all);
+  assert(topics.match("c", 1) == &all);
+  assert(topics.match("", 0) == &all);
+  assert(topics.remove(""));
+  assert(!topics.remove(""));
+
+  //"ab" is covered by "a"
+  assert(topics.subscribe() == 2);
+  topics.add("abc", ab);
+  assert(topics.subscribe() == 0);
+  assert(topics.remove("a"));
+  //"ab" is subscribed, "a" is unsubscribed
+  assert(topics.subscribe() == 2);
+
+  const char* sent[] = {"ab1", "a2", "b3", "abc4"};
+  for (size_t i = 0; i < 4; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(pub, 0)
+      << std::string(sent[i], 1 + (i == 0 || i == 3) + (i == 3))
+      << sent[i] << ZmqMessage::Flush;
+  }
+  while (ZmqMessage::wait_readable(sub, 10000))
+  {
+    topics.on_readable(sub);
+  }
+  assert(log.size() == 3);
+  assert(log[0] == "ab:ab1");
+  assert(log[1] == "b:b3");
+  assert(log[2] == "ab:abc4");
+  assert(topics.unmatched() == 0);
+
+  //many topics
+  ZmqMessage::TopicDispatcher many(sub);
+  std::vector<TopicLog> handlers(1000);
+  for (size_t i = 0; i < handlers.size(); ++i)
+  {
+    std::ostringstream topic;
+    topic << "t" << i;
+    handlers[i].name = topic.str();
+    many.add(topic.str(), handlers[i]);
+  }
+  assert(many.size() == 1000);
+  for (size_t i = 0; i < handlers.size(); ++i)
+  {
+    const std::string topic = handlers[i].name + ".x";
+    assert(many.match(topic.data(), topic.size()) == &handlers[i]);
+  }
+}
+
+struct ConflateLog : public ZmqMessage::Conflater::Handler
+{
+  std::vector<std::string> log;
+
+  void
+  on_message(ZmqMessage::Conflater::Parts& parts, size_t received)
+  {
+    std::ostringstream os;
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+      os << ZmqMessage::get_string(parts[i].msg()) << ":";
+    }
+    os << received;
+    log.push_back(os.str());
+  }
+};
+
+struct LengthKey : public ZmqMessage::Conflater::KeyExtractor
+{
+  uint64_t
+  key(ZmqMessage::Conflater::Parts& parts)
+  {
+    return parts.back().msg().size();
+  }
+};
+
+void
+test_conflater()
+{
+  zmq::context_t ctx(1);
+  zmq::socket_t pull(ctx, ZMQ_PULL);
+  pull.bind("inproc://test_conflater");
+  zmq::socket_t push(ctx, ZMQ_PUSH);
+  push.connect("inproc://test_conflater");
+
+  const char* sent[][2] = {
+    {"a", "1"}, {"b", "1"}, {"a", "2"}, {"c", "1"}, {"a", "33"}, {"b", "2"}
+  };
+  for (size_t i = 0; i < 6; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(push, 0)
+      << sent[i][0] << sent[i][1] << ZmqMessage::Flush;
+  }
+  ZmqMessage::wait_readable(pull, 100000);
+
+  ConflateLog log;
+  ZmqMessage::Conflater conflater(pull, 0);
+  assert(conflater.drain(log) == 3);
+  assert(log.log.size() == 3);
+  assert(log.log[0] == "a:33:3");
+  assert(log.log[1] == "b:2:2");
+  assert(log.log[2] == "c:1:1");
+  assert(conflater.stats().received == 6);
+  assert(conflater.stats().delivered == 3);
+  assert(conflater.stats().collapsed == 3);
+  assert(conflater.drain(log) == 0);
+
+  //table is full: the rest is left for the next drain
+  for (size_t i = 0; i < 6; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(push, 0)
+      << sent[i][0] << sent[i][1] << ZmqMessage::Flush;
+  }
+  ZmqMessage::wait_readable(pull, 100000);
+  ZmqMessage::Conflater small(pull, 0, 2);
+  log.log.clear();
+  assert(small.drain(log) == 2);
+  assert(log.log[0] == "a:1:1");
+  assert(log.log[1] == "b:1:1");
+  assert(small.drain(log) == 2);
+  assert(log.log[2] == "a:2:1");
+  assert(log.log[3] == "c:1:1");
+  assert(small.drain(log) == 2);
+  assert(log.log[4] == "a:33:1");
+  assert(log.log[5] == "b:2:1");
+
+  //key extractor: conflate by length of value
+  for (size_t i = 0; i < 6; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(push, 0)
+      << sent[i][0] << sent[i][1] << ZmqMessage::Flush;
+  }
+  ZmqMessage::wait_readable(pull, 100000);
+  LengthKey length;
+  ZmqMessage::Conflater by_length(pull, length);
+  log.log.clear();
+  assert(by_length.drain(log, 4) == 1);
+  assert(log.log[0] == "c:1:4");
+  assert(by_length.drain(log) == 2);
+  assert(log.log[1] == "a:33:1");
+  assert(log.log[2] == "b:2:1");
+  assert(by_length.stats().collapsed == 3);
+}
+
+struct ChannelProducer
+{
+  ZmqMessage::LocalChannel* channel;
+  size_t id;
+  size_t count;
+};
+
+void*
+channel_producer(void* arg)
+{
+  ChannelProducer* producer = static_cast<ChannelProducer*>(arg);
+  for (size_t i = 0; i < producer->count; )
+  {
+    std::auto_ptr<ZmqMessage::Multipart> msg(
+      new ZmqMessage::LocalChannel::Message(2));
+    ZmqMessage::LocalChannel::Message& m =
+      static_cast<ZmqMessage::LocalChannel::Message&>(*msg);
+    m.add(&producer->id, sizeof(producer->id));
+    m.add(&i, sizeof(i));
+    if (producer->channel->send(msg))
+    {
+      ++i;
+    }
+    else
+    {
+      producer->channel->wait_writable(-1);
+    }
+  }
+  return 0;
+}
+
+void
+test_local_channel()
+{
+  ZmqMessage::LocalChannel channel(3);
+  assert(channel.capacity() == 4);
+  assert(!channel.receive());
+  assert(!channel.wait(0));
+
+  std::auto_ptr<ZmqMessage::Multipart> msg(
+    new ZmqMessage::LocalChannel::Message);
+  ZmqMessage::Part& first =
+    static_cast<ZmqMessage::LocalChannel::Message&>(*msg).add();
+  const void* data = first.msg().data();
+  static_cast<ZmqMessage::LocalChannel::Message&>(*msg).add("abc", 3);
+  assert(channel.send(msg));
+  assert(!msg.get());
+  assert(channel.stats().wakeups == 1);
+  assert(channel.wait(0));
+
+  std::auto_ptr<ZmqMessage::Multipart> got(channel.receive());
+  assert(got.get());
+  assert(got->size() == 2);
+  //parts are not copied
+  assert((*got)[0].msg().data() == data);
+  assert(ZmqMessage::get_string((*got)[1].msg()) == "abc");
+
+  //full channel leaves message with caller
+  for (size_t i = 0; i < 4; ++i)
+  {
+    msg.reset(new ZmqMessage::LocalChannel::Message);
+    assert(channel.send(msg));
+  }
+  msg.reset(new ZmqMessage::LocalChannel::Message);
+  assert(!channel.send(msg));
+  assert(msg.get());
+  assert(channel.stats().rejected == 1);
+  assert(channel.size() == 4);
+  //busy receiver is not signaled
+  assert(channel.stats().wakeups == 1);
+  assert(!channel.wait_writable(0));
+  got.reset(channel.receive());
+  assert(channel.wait_writable(0));
+  assert(channel.send(msg));
+
+  //detached Incoming is sent as is
+  zmq::context_t ctx(1);
+  zmq::socket_t pull(ctx, ZMQ_PULL);
+  pull.bind("inproc://test_local_channel");
+  zmq::socket_t push(ctx, ZMQ_PUSH);
+  push.connect("inproc://test_local_channel");
+  ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(push, 0)
+    << "x" << "y" << ZmqMessage::Flush;
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> incoming(pull);
+  incoming.receive_all();
+  ZmqMessage::LocalChannel unbounded;
+  msg.reset(incoming.detach());
+  assert(unbounded.send(msg));
+  got.reset(unbounded.receive());
+  assert(got->size() == 2);
+  assert(ZmqMessage::get_string((*got)[1].msg()) == "y");
+
+  //many producers, receiver polls descriptor
+  ZmqMessage::LocalChannel shared(64);
+  ChannelProducer producers[4];
+  pthread_t tids[4];
+  for (size_t i = 0; i < 4; ++i)
+  {
+    producers[i].channel = &shared;
+    producers[i].id = i;
+    producers[i].count = 10000;
+    pthread_create(&tids[i], 0, channel_producer, &producers[i]);
+  }
+  std::vector<size_t> next(4, 0);
+  for (size_t n = 0; n < 40000; )
+  {
+    std::auto_ptr<ZmqMessage::Multipart> m(shared.receive());
+    if (!m.get())
+    {
+      zmq::pollitem_t item = {0, shared.fd(), ZMQ_POLLIN, 0};
+      zmq::poll(&item, 1, -1);
+      continue;
+    }
+    size_t id, seq;
+    ::memcpy(&id, (*m)[0].msg().data(), sizeof(id));
+    ::memcpy(&seq, (*m)[1].msg().data(), sizeof(seq));
+    //order of each producer is kept
+    assert(seq == next[id]);
+    ++next[id];
+    ++n;
+  }
+  for (size_t i = 0; i < 4; ++i)
+  {
+    pthread_join(tids[i], 0);
+  }
+  assert(!shared.receive());
+  assert(shared.stats().received == 40000);
+}
+
+void*
+blocked_channel_sender(void* arg)
+{
+  ZmqMessage::LocalChannelTransport* sender =
+    static_cast<ZmqMessage::LocalChannelTransport*>(arg);
+  //waits until receiver takes a message
+  ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(*sender, 0)
+    << 2 << "z" << ZmqMessage::Flush;
+  return 0;
+}
+
+void
+test_transport()
+{
+  ZmqMessage::LoopbackTransport loop;
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+    out << "a" << "b" << ZmqMessage::Flush;
+  }
+  assert(loop.queued() == 2);
+  assert(ZmqMessage::wait_readable(loop, 0));
+  {
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+    assert(in.transport() == &loop);
+    in.receive_all();
+    assert(in.size() == 2);
+    assert(in.is_terminal());
+    assert(ZmqMessage::get_string(in[1]) == "b");
+  }
+  assert(!ZmqMessage::wait_readable(loop, -1));
+
+  //would block: queueing and dropping
+  loop.set_blocked(true);
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop,
+      ZmqMessage::OutOptions::NONBLOCK |
+      ZmqMessage::OutOptions::CACHE_ON_BLOCK);
+    out << "x" << "y" << ZmqMessage::Flush;
+    assert(out.is_queued());
+    assert(!out.has_dst());
+    //no socket to wait for
+    ZmqMessage::AsyncLoop async;
+    bool thrown = false;
+    try
+    {
+      async.async_flush(out);
+    }
+    catch (const ZmqMessage::ZmqErrorType&)
+    {
+      thrown = true;
+    }
+    assert(thrown);
+    assert(out.is_queued());
+    std::auto_ptr<ZmqMessage::Multipart> queued(out.detach());
+    assert(queued->size() == 2);
+  }
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop,
+      ZmqMessage::OutOptions::NONBLOCK |
+      ZmqMessage::OutOptions::DROP_ON_BLOCK);
+    out << "x" << "y" << ZmqMessage::Flush;
+    assert(out.is_dropping());
+  }
+  assert(loop.queued() == 0);
+  loop.set_blocked(false);
+
+  //X routing is received and sent back
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+    out << "peer" << "" << "request" << ZmqMessage::Flush;
+  }
+  {
+    ZmqMessage::Incoming<ZmqMessage::XRouting> in(loop);
+    in.receive(1, true);
+    assert(ZmqMessage::get_string(in[0]) == "request");
+    ZmqMessage::Outgoing<ZmqMessage::XRouting> out(loop, in, 0);
+    out << "reply" << ZmqMessage::Flush;
+  }
+  assert(loop.queued() == 3);
+  {
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+    in.receive_all();
+    assert(ZmqMessage::get_string(in[0]) == "peer");
+    assert(ZmqMessage::get_string(in[2]) == "reply");
+  }
+
+  //tail not received is relayed
+  ZmqMessage::LoopbackTransport other;
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+    out << "h" << "t1" << "t2" << ZmqMessage::Flush;
+  }
+  {
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+    in.receive(1, false);
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(other, 0);
+    out.splice_from(in);
+  }
+  assert(loop.queued() == 0);
+  assert(other.queued() == 3);
+
+  //in-process channel
+  ZmqMessage::LocalChannel channel(2);
+  ZmqMessage::LocalChannelTransport sender(channel);
+  ZmqMessage::LocalChannelTransport receiver(channel);
+  for (int i = 0; i < 2; ++i)
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(sender, 0);
+    out << i << "z" << ZmqMessage::Flush;
+  }
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(sender,
+      ZmqMessage::OutOptions::NONBLOCK |
+      ZmqMessage::OutOptions::DROP_ON_BLOCK);
+    out << 2 << "z" << ZmqMessage::Flush;
+    assert(out.is_dropping());
+  }
+  assert(channel.size() == 2);
+  assert(!channel.wait_writable(0));
+  pthread_t thr;
+  pthread_create(&thr, NULL, &blocked_channel_sender, &sender);
+  ::usleep(10000);
+  for (int i = 0; i < 3; ++i)
+  {
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(receiver);
+    if (i == 2)
+    {
+      pthread_join(thr, 0);
+    }
+    assert(in.try_receive_all(0));
+    int n = -1;
+    in >> n;
+    assert(n == i);
+    assert(in.size() == 2);
+  }
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(receiver);
+  assert(!in.try_receive_all(0));
+}
+
+struct HandoffObject
+{
+  static int alive;
+
+  std::string value;
+
+  explicit
+  HandoffObject(const std::string& v) : value(v)
+  {
+    ++alive;
+  }
+
+  ~HandoffObject()
+  {
+    --alive;
+  }
+};
+
+int HandoffObject::alive = 0;
+
+void
+test_handoff()
+{
+  zmq::context_t ctx(1);
+  zmq::socket_t pull(ctx, ZMQ_PULL);
+  pull.bind("inproc://test_handoff");
+  zmq::socket_t push(ctx, ZMQ_PUSH);
+  push.connect("inproc://test_handoff");
+
+  {
+    std::auto_ptr<HandoffObject> obj(new HandoffObject("a"));
+    HandoffObject* const sent = obj.get();
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(push, 0)
+      << "obj" << ZmqMessage::handoff(obj) << ZmqMessage::Flush;
+    assert(!obj.get());
+
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(pull);
+    in.receive_all();
+    ZmqMessage::Part shared;
+    shared.copy(in[1]);
+    std::auto_ptr<HandoffObject> got;
+    in >> ZmqMessage::Skip >> ZmqMessage::handoff(got);
+    assert(got.get() == sent);
+    assert(got->value == "a");
+
+    //shared part is claimed once
+    ZmqMessage::LoopbackTransport loop;
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(loop, 0)
+      << shared << ZmqMessage::Flush;
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in_shared(loop);
+    in_shared.receive_all();
+    bool thrown = false;
+    try
+    {
+      std::auto_ptr<HandoffObject> again;
+      in_shared >> ZmqMessage::handoff(again);
+    }
+    catch (const ZmqMessage::MessageFormatError&)
+    {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+  assert(HandoffObject::alive == 0);
+
+  //type is checked, object is deleted with unclaimed part
+  {
+    std::auto_ptr<HandoffObject> obj(new HandoffObject("b"));
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(push, 0)
+      << ZmqMessage::handoff(obj) << ZmqMessage::Flush;
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(pull);
+    in.receive_all();
+    bool thrown = false;
+    try
+    {
+      std::auto_ptr<std::string> wrong;
+      in >> ZmqMessage::handoff(wrong);
+    }
+    catch (const ZmqMessage::MessageFormatError&)
+    {
+      thrown = true;
+    }
+    assert(thrown);
+    assert(HandoffObject::alive == 1);
+  }
+  assert(HandoffObject::alive == 0);
+
+  //copy of part (as received over tcp://) is refused
+  {
+    std::auto_ptr<HandoffObject> obj(new HandoffObject("c"));
+    ZmqMessage::LoopbackTransport loop;
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(loop, 0)
+      << ZmqMessage::handoff(obj) << ZmqMessage::Flush;
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+    in.receive_all();
+    zmq::message_t& msg = in[0].msg();
+    zmq::message_t copied(msg.size());
+    ::memcpy(copied.data(), msg.data(), msg.size());
+    ZmqMessage::LoopbackTransport other;
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(other, 0)
+      << ZmqMessage::RawMessage(copied.data(), copied.size())
+      << ZmqMessage::Flush;
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in_copy(other);
+    in_copy.receive_all();
+    bool thrown = false;
+    try
+    {
+      std::auto_ptr<HandoffObject> got;
+      in_copy >> ZmqMessage::handoff(got);
+    }
+    catch (const ZmqMessage::MessageFormatError&)
+    {
+      thrown = true;
+    }
+    assert(thrown);
+
+    std::auto_ptr<HandoffObject> got;
+    in >> ZmqMessage::handoff(got);
+    assert(got->value == "c");
+  }
+  assert(HandoffObject::alive == 0);
+
+  //dropped message deletes object
+  {
+    std::auto_ptr<HandoffObject> obj(new HandoffObject("d"));
+    ZmqMessage::LoopbackTransport loop;
+    loop.set_blocked(true);
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting>(loop,
+      ZmqMessage::OutOptions::NONBLOCK |
+      ZmqMessage::OutOptions::DROP_ON_BLOCK)
+      << ZmqMessage::handoff(obj) << ZmqMessage::Flush;
+    assert(!obj.get());
+  }
+  assert(HandoffObject::alive == 0);
+
+  //codec does not copy the part, packed frame would: it's refused
+  {
+    std::auto_ptr<HandoffObject> obj(new HandoffObject("e"));
+    std::ostringstream name;
+    name << "/zmqmessage_test_handoff_" << ::getpid();
+    ZmqMessage::ShmCodec codec(name.str(), 4096, 16);
+    ZmqMessage::LoopbackTransport loop;
+    {
+      ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+      out.set_codec(&codec);
+      out << ZmqMessage::handoff(obj) << ZmqMessage::Flush;
+    }
+    assert(codec.stats().encoded == 0);
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+    in.set_codec(&codec);
+    in.receive_all();
+    std::auto_ptr<HandoffObject> got;
+    in >> ZmqMessage::handoff(got);
+    assert(got->value == "e");
+
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> packed(loop,
+      ZmqMessage::OutOptions::PACKED);
+    bool thrown = false;
+    try
+    {
+      packed << ZmqMessage::handoff(got);
+    }
+    catch (const ZmqMessage::ZmqErrorType&)
+    {
+      thrown = true;
+    }
+    assert(thrown);
+    assert(got.get());
+  }
+  assert(HandoffObject::alive == 0);
+}
+
+void
+test_mapped_file()
+{
+  char path[] = "/tmp/zmqmessage_test_mapped_XXXXXX";
+  const int fd = ::mkstemp(path);
+  assert(fd >= 0);
+  std::string content;
+  for (int i = 0; i < 1000; ++i)
+  {
+    content += static_cast<char>('a' + i % 26);
+  }
+  assert(::write(fd, content.data(), content.size()) ==
+    static_cast<ssize_t>(content.size()));
+
+  ZmqMessage::LoopbackTransport loop;
+  {
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+    out << "file";
+    {
+      ZmqMessage::MappedFile file(path);
+      assert(file.size() == 1000);
+      assert(file.chunks(300) == 4);
+      assert(file.append_to(out, 300) == 4);
+    }
+    //region is not page-aligned
+    ZmqMessage::MappedFile region(fd, 10, 20);
+    assert(std::string(region.data(), region.size()) ==
+      content.substr(10, 20));
+    out << region.part(5, 3) << ZmqMessage::Flush;
+  }
+  ::close(fd);
+  ::unlink(path);
+
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+  in.receive(2, false);
+  assert(ZmqMessage::get_string(in[0]) == "file");
+  assert(in[1].msg().size() == 300);
+
+  int pipe_fd[2];
+  assert(::pipe(pipe_fd) == 0);
+  assert(in.write_to(pipe_fd[1], 1) == 1003);
+  assert(in.is_terminal());
+  ::close(pipe_fd[1]);
+  std::string written;
+  char buf[256];
+  for (ssize_t rc; (rc = ::read(pipe_fd[0], buf, sizeof(buf))) > 0; )
+  {
+    written.append(buf, rc);
+  }
+  ::close(pipe_fd[0]);
+  assert(written == content + content.substr(15, 3));
+}
+
+void
+test_shm_codec()
+{
+  assert(ZmqMessage::ShmCodec::is_local("ipc:///tmp/feed"));
+  assert(ZmqMessage::ShmCodec::is_local("inproc://feed"));
+  assert(!ZmqMessage::ShmCodec::is_local("tcp://127.0.0.1:5555"));
+
+  std::ostringstream name;
+  name << "/zmqmessage_test_shm_" << ::getpid();
+  const std::string a(1500, 'a');
+  const std::string b(1500, 'b');
+  const std::string c(1500, 'c');
+  const std::string marker = std::string("\xf5ZMC", 4) + std::string(20, 'm');
+
+  ZmqMessage::ShmCodec consumer(name.str());
+  ZmqMessage::LoopbackTransport loop;
+  {
+    //ring holds two blocks of 1600 bytes
+    ZmqMessage::ShmCodec producer(name.str(), 4096, 1000);
+    {
+      ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+      out.set_codec(&producer);
+      out << "small" << a << b << c << marker << ZmqMessage::Flush;
+    }
+    assert(producer.stats().encoded == 2);
+    assert(producer.stats().skipped == 3); //small, no room for c, marker
+    assert(producer.in_use() == 3200);
+
+    {
+      ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+      in.set_codec(&consumer);
+      in.receive_all();
+      //decoded on receive, not on access
+      assert(consumer.stats().decoded == 3);
+      assert(in.size() == 5);
+      {
+        ZmqMessage::Part released = in.release(1);
+        assert(ZmqMessage::get_string<std::string>(released.msg()) == a);
+      }
+      assert(producer.in_use() == 1600);
+      assert(ZmqMessage::get_string<std::string>(in[0]) == "small");
+      assert(ZmqMessage::get_string<std::string>(in[2]) == b);
+      assert(ZmqMessage::get_string<std::string>(in[3]) == c);
+      assert(ZmqMessage::get_string<std::string>(in[4]) == marker);
+      assert(producer.in_use() == 1600);
+    }
+    assert(producer.in_use() == 0);
+
+    //a is freed, c takes its place as there is no room after b
+    {
+      ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+      out.set_codec(&producer);
+      out << a << b << ZmqMessage::Flush;
+    }
+    {
+      ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+      in.set_codec(&consumer);
+      in.receive_all();
+      in.release(0);
+      {
+        ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+        out.set_codec(&producer);
+        out << c << ZmqMessage::Flush;
+      }
+      assert(producer.stats().encoded == 5);
+      assert(producer.in_use() == 3200);
+      ZmqMessage::Incoming<ZmqMessage::SimpleRouting> next(loop);
+      next.set_codec(&consumer);
+      next.receive_all();
+      assert(ZmqMessage::get_string<std::string>(in[1]) == b);
+      assert(ZmqMessage::get_string<std::string>(next[0]) == c);
+    }
+    assert(producer.in_use() == 0);
+
+    //block of a is lost (consumer without codec), the rest is reused
+    {
+      ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+      out.set_codec(&producer);
+      out << a << ZmqMessage::Flush;
+    }
+    {
+      ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+      in.receive_all();
+      assert(ZmqMessage::PartCodec::is_encoded(in[0].msg()));
+    }
+    for (int i = 0; i < 5; ++i)
+    {
+      {
+        ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+        out.set_codec(&producer);
+        out << b << ZmqMessage::Flush;
+      }
+      ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+      in.set_codec(&consumer);
+      in.receive_all();
+      assert(ZmqMessage::get_string<std::string>(in[0]) == b);
+    }
+    assert(producer.stats().encoded == 11);
+    assert(producer.in_use() == 1600);
+  }
+
+  {
+    //segment created anew is mapped again
+    ZmqMessage::ShmCodec producer(name.str(), 4096, 1000);
+    {
+      ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+      out.set_codec(&producer);
+      out << b << ZmqMessage::Flush;
+    }
+    ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+    in.set_codec(&consumer);
+    in.receive_all();
+    assert(ZmqMessage::get_string<std::string>(in[0]) == b);
+    assert(consumer.stats().errors == 0);
+  }
+
+  //descriptor of removed segment is left as is
+  {
+    ZmqMessage::ShmCodec producer(name.str(), 4096, 1000);
+    ZmqMessage::Outgoing<ZmqMessage::SimpleRouting> out(loop, 0);
+    out.set_codec(&producer);
+    out << a << ZmqMessage::Flush;
+  }
+  ZmqMessage::Incoming<ZmqMessage::SimpleRouting> in(loop);
+  in.set_codec(&consumer);
+  in.receive_all();
+  assert(consumer.stats().errors == 1);
+  assert(ZmqMessage::PartCodec::is_encoded(in[0].msg()));
+}
+
 template <typename Storage>
 void
 test_for_storage()
@@ -326,5 +2782,30 @@ int main()
   test_time();
   test_detach();
   test_incoming_detach();
+  test_buffer_pool();
+  test_message_builder();
+  test_packed();
+  test_codec();
+  test_relay();
+  test_fan_out();
+  test_route();
+  test_sharded_sink();
+  test_timer_wheel();
+  test_reactor();
+  test_spin_wait();
+  test_try_receive();
+  test_async_loop();
+  test_socket_watcher();
+  test_rpc_client();
+  test_route_handle();
+  test_broker();
+  test_scatter_gather();
+  test_topic_dispatcher();
+  test_conflater();
+  test_local_channel();
+  test_transport();
+  test_handoff();
+  test_mapped_file();
+  test_shm_codec();
   return 0;
 }